@@ -0,0 +1,587 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <zlib.h>
+
+#ifdef WITH_PARI
+#include <pari/pari.h>
+#endif
+
+#include "clgrp.h"
+#include "sieve.h"
+
+// BENCHMARK OF COMPUTE_GROUP_BJT
+// Replays the discriminants of an LMFDB sample file, such as
+// crates/clgrp/testdata/lmfdb_bjt_samples.tsv, grouped by the number of
+// digits of |D|. The maximal orders go through compute_group_bjt the way clgrp
+// runs with precomputed class numbers, and their class groups are checked
+// against the file. The orders of index ell^2 then go through
+// compute_group_ell. Each decade reports the time and the operations per
+// discriminant and the memory of the tables.
+//
+// With an ell samples file, such as
+// crates/clgrp/testdata/lmfdb_bjt_ell_samples.tsv, the orders are checked
+// against the class groups it holds for them, computed by a full search on
+// the discriminant of each order.
+//
+// With a baseline file the report is compared against it, and a decade that
+// got slower or takes more operations than tolerance percent allows fails the
+// run. A missing baseline file is written from the report.
+
+#define MAX_DECADES 20
+#define MAX_LINE 1024
+
+// each decade is replayed until it took at least this long, 0.2 seconds
+#ifndef BENCH_NS
+#define BENCH_NS 2e8
+#endif
+
+typedef struct
+{
+	long D;								// negative
+	int h;
+	int rank;
+	int inv[MAX_RANK];
+	int init_pow, h_star;
+} sample_t;
+
+typedef struct
+{
+	int count;
+	sample_t * samples;
+} decade_t;
+
+// the class group of the order of index ell^2 of D
+typedef struct
+{
+	long D;								// negative, of the maximal order
+	long ell;
+	int kron;
+	int rank;
+	int inv[MAX_RANK];
+} ell_sample_t;
+
+// a line of the report and of the baseline, ell 0 for the maximal orders
+typedef struct
+{
+	int digits;
+	long ell;
+	double ns;
+	double ops;
+} bench_t;
+
+static int cmp_desc(const void * a, const void * b)
+{
+	return *(const int *) b - *(const int *) a;
+}
+
+// reads the last three columns of each line: D, h and the invariant factors
+// separated by commas, at most per_decade of each decade
+static void read_samples(decade_t * decades, const char * path, const int per_decade)
+{
+	char line[MAX_LINE], data[MAX_LINE], * field[16], * s, * end;
+	int n, digits;
+	sample_t sample;
+
+	gzFile in = gzopen(path, "rb");
+
+	if (in == NULL)
+	{
+		sprintf(data, "Unable to open the file %s\n", path);
+		perror(data);
+		exit(1);
+	}
+
+	while (gzgets(in, line, MAX_LINE) != NULL)
+	{
+		if (line[0] == '#')
+		{
+			continue;
+		}
+
+		for (n = 0, s = strtok(line, "\t\n"); s != NULL && n < 16; s = strtok(NULL, "\t\n"))
+		{
+			field[n++] = s;
+		}
+
+		if (n < 3)
+		{
+			continue;
+		}
+
+		sample.D = atol(field[n - 3]);
+		sample.h = atoi(field[n - 2]);
+		sample.rank = 0;
+
+		for (s = field[n - 1]; *s != '\0' && sample.rank < MAX_RANK; s = (*end == ',') ? end + 1 : end)
+		{
+			sample.inv[sample.rank++] = strtol(s, &end, 10);
+
+			if (end == s)
+			{
+				sample.rank--;
+				break;
+			}
+		}
+
+		qsort(sample.inv, sample.rank, sizeof(int), &cmp_desc);
+
+		digits = (int) log10(ABS(sample.D)) + 1;
+
+		if (sample.D >= 0 || digits >= MAX_DECADES || decades[digits].count == per_decade)
+		{
+			continue;
+		}
+
+		decades[digits].samples[decades[digits].count++] = sample;
+	}
+
+	gzclose(in);
+}
+
+static int cmp_ell_sample(const void * a, const void * b)
+{
+	const ell_sample_t * x = (const ell_sample_t *) a, * y = (const ell_sample_t *) b;
+
+	if (x->D != y->D)
+	{
+		return (x->D < y->D) ? -1 : 1;
+	}
+
+	return (x->ell > y->ell) - (x->ell < y->ell);
+}
+
+// reads the lines D, ell, (D/ell) and the invariant factors separated by
+// commas, sorted by D and ell, into the array returned
+static ell_sample_t * read_ell_samples(const char * path, int * count)
+{
+	char line[MAX_LINE], data[MAX_LINE], * field[4], * s, * end;
+	int n, allocated = 1024;
+	ell_sample_t * samples = (ell_sample_t *) malloc(allocated * sizeof(ell_sample_t)), * sample;
+
+	gzFile in = gzopen(path, "rb");
+
+	if (in == NULL)
+	{
+		sprintf(data, "Unable to open the file %s\n", path);
+		perror(data);
+		exit(1);
+	}
+
+	*count = 0;
+
+	while (gzgets(in, line, MAX_LINE) != NULL)
+	{
+		if (line[0] == '#')
+		{
+			continue;
+		}
+
+		for (n = 0, s = strtok(line, "\t\n"); s != NULL && n < 4; s = strtok(NULL, "\t\n"))
+		{
+			field[n++] = s;
+		}
+
+		if (n < 4)
+		{
+			continue;
+		}
+
+		if (*count == allocated)
+		{
+			allocated <<= 1;
+			samples = (ell_sample_t *) realloc(samples, allocated * sizeof(ell_sample_t));
+		}
+
+		sample = samples + (*count)++;
+		sample->D = atol(field[0]);
+		sample->ell = atol(field[1]);
+		sample->kron = atoi(field[2]);
+		sample->rank = 0;
+
+		for (s = field[3]; *s != '\0' && sample->rank < MAX_RANK; s = (*end == ',') ? end + 1 : end)
+		{
+			sample->inv[sample->rank++] = strtol(s, &end, 10);
+
+			if (end == s)
+			{
+				sample->rank--;
+				break;
+			}
+		}
+
+		qsort(sample->inv, sample->rank, sizeof(int), &cmp_desc);
+	}
+
+	gzclose(in);
+	qsort(samples, *count, sizeof(ell_sample_t), &cmp_ell_sample);
+
+	return samples;
+}
+
+// checks the row compute_group_ell wrote for D and ell against the ell
+// samples, returns 0 on a mismatch, counts the orders they do not hold
+static int check_ell(const ell_sample_t * samples, const int count, const long D, const long ell, const int * row, long * unchecked)
+{
+	ell_sample_t key;
+	int sorted[MAX_RANK], r;
+
+	key.D = D;
+	key.ell = ell;
+
+	const ell_sample_t * expected = (const ell_sample_t *) bsearch(&key, samples, count, sizeof(ell_sample_t), &cmp_ell_sample);
+
+	// the split orders are only recorded
+	if (expected == NULL)
+	{
+		*unchecked += (row[0] != 1);
+		return 1;
+	}
+
+	if (row[0] != expected->kron || row[1] != expected->rank)
+	{
+		printf("MISMATCH: D=%ld, ell=%ld, the rank or (D/ell) differs\n", D, ell);
+		return 0;
+	}
+
+	memcpy(sorted, row + 2, row[1] * sizeof(int));
+	qsort(sorted, row[1], sizeof(int), &cmp_desc);
+
+	for (r = 0; r < row[1] && sorted[r] == expected->inv[r]; r++);
+
+	if (r != row[1])
+	{
+		printf("MISMATCH: D=%ld, ell=%ld, the invariant factors differ\n", D, ell);
+		return 0;
+	}
+
+	return 1;
+}
+
+static double bench_time()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static size_t table_bytes(const oatab_t * t)
+{
+	return t->allocated * (t->item_size + t->payload_size + sizeof(uint32_t)) + (t->mask + 1) * sizeof(oaslot_t);
+}
+
+// fills b from count discriminants that took ns and prints it
+static void bench_record(bench_t * b, const int digits, const long ell, const long count, const double ns,
+				bjt_stats_t * s, oatab_t * R, oatab_t * Q)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	bjt_stats_add_table(s, R);
+	bjt_stats_add_table(s, Q);
+
+	b->digits = digits;
+	b->ell = ell;
+	b->ns = ns / count;
+	b->ops = (double) bjt_stats_ops(s) / count;
+
+	if (b->ell == 0)
+	{
+		printf("10^%d: ", b->digits - 1);
+	}
+	else
+	{
+		printf("10^%d l%ld: ", b->digits - 1, b->ell);
+	}
+
+	printf("%ld runs, %.0f ns, %.1f ops, %.1f baby steps, %.1f giant steps, %.2f probes per discriminant, occupancy %ld, tables %zu KB, maxrss %ld KB, aborted %ld\n",
+		count, b->ns, b->ops, (double) s->baby / count, (double) s->giant / count, (s->finds > 0) ? (double) s->probes / s->finds : 0.0,
+		s->occupancy, (table_bytes(R) + table_bytes(Q)) >> 10, usage.ru_maxrss, s->aborted);
+	fflush(stdout);
+}
+
+int main(int argc, char * argv[])
+{
+	if (argc < 3 || argc > 7)
+	{
+		printf("Format: ./bench_bjt [samples] [per_decade] [ells] [baseline] [tolerance] [ell_samples]\n");
+		printf("samples is a .tsv or .tsv.gz file with D, h and the invariant factors in its last columns.\n");
+		printf("Set ells to \"null\" to only replay the maximal orders, tolerance is in percent, 10 by default.\n");
+		printf("ell_samples holds D, ell, (D/ell) and the invariant factors of the orders of index ell^2 to check.\n");
+		exit(1);
+	}
+
+	const char * path = argv[1];
+	const int per_decade = atoi(argv[2]);
+	const char * baseline = (argc >= 5) ? argv[4] : NULL;
+	const double tolerance = (argc >= 6) ? atof(argv[5]) : 10;
+
+	if (per_decade < 1)
+	{
+		perror("per_decade should be positive.\n");
+		exit(1);
+	}
+
+	ell_list_t ells;
+	ells.count = 0;
+
+	if (argc >= 4 && strcmp(argv[3], "null") != 0 && !ell_list_parse(&ells, argv[3]))
+	{
+		perror("ells should be a comma separated list of at most 8 primes.\n");
+		exit(1);
+	}
+
+	#ifdef WITH_PARI
+	pari_init(1000000, 0);
+	#endif
+
+	decade_t decades[MAX_DECADES];
+	int d, i, e, r, rank, h_rem, p, q, replays, failed = 0, results = 0;
+	int result[15], sorted[15], row[MAX_RANK + 2];
+	long D_max = 0, h_max = 0, ell_max = 1;
+	double start;
+
+	for (d = 0; d < MAX_DECADES; d++)
+	{
+		decades[d].count = 0;
+		decades[d].samples = (sample_t *) malloc(per_decade * sizeof(sample_t));
+	}
+
+	read_samples(decades, path, per_decade);
+
+	int ell_sample_count = 0;
+	long unchecked = 0;
+	ell_sample_t * ell_samples = (argc == 7) ? read_ell_samples(argv[6], &ell_sample_count) : NULL;
+
+	for (d = 0; d < MAX_DECADES; d++)
+	{
+		for (i = 0; i < decades[d].count; i++)
+		{
+			D_max = MAX(D_max, -decades[d].samples[i].D);
+			h_max = MAX(h_max, decades[d].samples[i].h);
+		}
+	}
+
+	for (e = 0; e < ells.count; e++)
+	{
+		ell_max = MAX(ell_max, ells.ell[e]);
+	}
+
+	// the smallest prime factors of the class numbers, also those of the orders
+	h_max = h_max * ell_max * (ell_max + 1) + 1;
+	int * spf = (int *) malloc(h_max * sizeof(int));
+	spf_sieve(h_max, spf);
+	ells.spf = spf;
+
+	// the tables grow on demand for the orders of index ell^2
+	int table_size = next_prime((((int) sqrt(h_upper_bound(-D_max))) << 1) - 1);
+
+	if (table_size == -1)
+	{
+		perror("Not enough primes in liboptarith/primes.h\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	oatab_t R, Q, R_s128, Q_s128;
+	form_table_init(&R, table_size);
+	form_table_init(&Q, table_size);
+	bjt_tables_s128_init(&R_s128, &Q_s128, table_size);
+
+	bench_t * bench = (bench_t *) malloc(MAX_DECADES * (1 + ells.count) * sizeof(bench_t));
+	bjt_stats_t stats;
+
+	for (d = 0; d < MAX_DECADES; d++)
+	{
+		decade_t * decade = decades + d;
+
+		if (decade->count == 0)
+		{
+			continue;
+		}
+
+		// h_star and init_pow as tab_prepare gets them from h
+		for (i = 0; i < decade->count; i++)
+		{
+			sample_t * sample = decade->samples + i;
+
+			for (sample->init_pow = 1, h_rem = sample->h; h_rem > 1; )
+			{
+				p = spf[h_rem];
+
+				for (q = 1; h_rem % p == 0; h_rem /= p)
+				{
+					q *= p;
+				}
+
+				if (q == p)
+				{
+					sample->init_pow *= p;
+				}
+			}
+
+			sample->h_star = sample->h / sample->init_pow;
+		}
+
+		// the maximal orders, checked on the first replay
+		bjt_stats_init(&stats);
+		start = bench_time();
+
+		for (replays = 0; replays == 0 || bench_time() - start < BENCH_NS; replays++)
+		{
+			for (i = 0; i < decade->count; i++)
+			{
+				sample_t * sample = decade->samples + i;
+
+				rank = compute_group_bjt_seeded(result, sample->D, sample->init_pow, sample->h_star, 0, &R, &Q, NULL, &stats);
+
+				if (replays > 0)
+				{
+					continue;
+				}
+
+				if (rank < 0 || result[0] * sample->init_pow != sample->h)
+				{
+					printf("MISMATCH: D=%ld, h=%d, expected %d\n", sample->D, (rank < 0) ? -1 : result[0] * sample->init_pow, sample->h);
+					failed = 1;
+					continue;
+				}
+
+				result[1] *= sample->init_pow;
+				memcpy(sorted, result + 1, rank * sizeof(int));
+				qsort(sorted, rank, sizeof(int), &cmp_desc);
+
+				for (r = 0; r < rank && r < sample->rank && sorted[r] == sample->inv[r]; r++);
+
+				if (r != rank || rank != sample->rank)
+				{
+					printf("MISMATCH: D=%ld, the invariant factors differ\n", sample->D);
+					failed = 1;
+				}
+
+				// the ell path starts from the row clgrp would have written
+				memcpy(sample->inv, result + 1, rank * sizeof(int));
+				sample->rank = rank;
+			}
+		}
+
+		bench_record(bench + results++, d, 0, decade->count * replays, bench_time() - start, &stats, &R, &Q);
+
+		// the orders of index ell^2
+		for (e = 0; e < ells.count; e++)
+		{
+			bjt_stats_init(&stats);
+			start = bench_time();
+
+			for (replays = 0; replays == 0 || bench_time() - start < BENCH_NS; replays++)
+			{
+				for (i = 0; i < decade->count; i++)
+				{
+					sample_t * sample = decade->samples + i;
+					compute_group_ell(row, -sample->D, sample->h, sample->inv, sample->rank, ells.ell[e], spf, &R, &Q, &R_s128, &Q_s128, &stats);
+
+					// checked on the first replay
+					if (replays == 0 && ell_samples && !check_ell(ell_samples, ell_sample_count, sample->D, ells.ell[e], row, &unchecked))
+					{
+						failed = 1;
+					}
+				}
+			}
+
+			bench_record(bench + results++, d, ells.ell[e], decade->count * replays, bench_time() - start, &stats, &R, &Q);
+		}
+	}
+
+	if (ell_samples && unchecked > 0)
+	{
+		printf("%ld orders of index ell^2 are not in %s and went unchecked\n", unchecked, argv[6]);
+	}
+
+	if (baseline && access(baseline, F_OK) != -1)
+	{
+		FILE * in = fopen(baseline, "r");
+		bench_t base;
+
+		while (fscanf(in, "%d %ld %lf %lf", &base.digits, &base.ell, &base.ns, &base.ops) == 4)
+		{
+			for (i = 0; i < results; i++)
+			{
+				if (bench[i].digits != base.digits || bench[i].ell != base.ell)
+				{
+					continue;
+				}
+
+				if (bench[i].ns > base.ns * (1 + tolerance / 100) || bench[i].ops > base.ops * (1 + tolerance / 100))
+				{
+					printf("REGRESSION: 10^%d l%ld: %.0f ns, %.1f ops per discriminant, baseline %.0f ns, %.1f ops\n",
+						base.digits - 1, base.ell, bench[i].ns, bench[i].ops, base.ns, base.ops);
+					failed = 1;
+				}
+			}
+		}
+
+		fclose(in);
+	}
+	else if (baseline)
+	{
+		FILE * out = fopen(baseline, "w");
+
+		if (out == NULL)
+		{
+			perror("Unable to write the baseline\n");
+			exit(1);
+		}
+
+		for (i = 0; i < results; i++)
+		{
+			fprintf(out, "%d %ld %.0f %.1f\n", bench[i].digits, bench[i].ell, bench[i].ns, bench[i].ops);
+		}
+
+		fclose(out);
+		printf("Baseline written to %s\n", baseline);
+	}
+
+	oatab_clear(&R);
+	oatab_clear(&Q);
+	bjt_tables_s128_clear(&R_s128, &Q_s128);
+
+	for (d = 0; d < MAX_DECADES; d++)
+	{
+		free(decades[d].samples);
+	}
+
+	free(bench);
+	free(spf);
+	free(ell_samples);
+
+	#ifdef WITH_PARI
+	pari_close();
+	#endif
+
+	return failed;
+}
@@ -0,0 +1,586 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <unistd.h>
+
+#include "clb.h"
+
+#define CLB_HEADER_SIZE 24
+#define CLB_ENTRY_SIZE 28
+#define CLB_TRAILER_SIZE 24
+
+static void clb_fail(const char * path, const char * what)
+{
+	char data[600];
+
+	sprintf(data, "Unable to %s %s", what, path);
+	perror(data);
+	fflush(stderr);
+	exit(1);
+}
+
+static void clb_corrupt(const char * path)
+{
+	fprintf(stderr, "Corrupt binary tabulation %s\n", path);
+	fflush(stderr);
+	exit(1);
+}
+
+
+// LITTLE ENDIAN AND VARINT CODING
+
+static __inline__
+void clb_put32(unsigned char * p, const uint32_t x)
+{
+	p[0] = x; p[1] = x >> 8; p[2] = x >> 16; p[3] = x >> 24;
+}
+
+static __inline__
+void clb_put64(unsigned char * p, const uint64_t x)
+{
+	clb_put32(p, (uint32_t) x);
+	clb_put32(p + 4, (uint32_t) (x >> 32));
+}
+
+static __inline__
+uint32_t clb_get32(const unsigned char * p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static __inline__
+uint64_t clb_get64(const unsigned char * p)
+{
+	return clb_get32(p) | ((uint64_t) clb_get32(p + 4) << 32);
+}
+
+static __inline__
+unsigned char * clb_put_varint(unsigned char * p, uint32_t x)
+{
+	while (x >= 0x80)
+	{
+		*p++ = (x & 0x7F) | 0x80;
+		x >>= 7;
+	}
+	*p++ = x;
+
+	return p;
+}
+
+static __inline__
+uint32_t clb_get_varint(const unsigned char * p, size_t * pos)
+{
+	register uint32_t x = 0;
+	register int shift = 0;
+
+	do
+	{
+		x |= (uint32_t) (p[*pos] & 0x7F) << shift;
+		shift += 7;
+	} while (p[(*pos)++] & 0x80);
+
+	return x;
+}
+
+
+
+static void clb_put_entry(unsigned char * entry, const clb_block_t * b)
+{
+	clb_put64(entry, (uint64_t) b->D_base);
+	clb_put64(entry + 8, b->offset);
+	clb_put32(entry + 16, b->size);
+	clb_put32(entry + 20, b->raw);
+	clb_put32(entry + 24, b->count);
+}
+
+static void clb_get_entry(const unsigned char * entry, clb_block_t * b)
+{
+	b->D_base = (int64_t) clb_get64(entry);
+	b->offset = clb_get64(entry + 8);
+	b->size = clb_get32(entry + 16);
+	b->raw = clb_get32(entry + 20);
+	b->count = clb_get32(entry + 24);
+}
+
+
+
+// WRITER IMPLEMENTATION
+
+static void clbout_flush(clbout_t * s)
+{
+	uLongf size = compressBound(s->raw_len);
+	clb_block_t * b;
+
+	if (s->count == 0)
+	{
+		return;
+	}
+
+	if (compress2(s->out, &size, s->raw, s->raw_len, 6) != Z_OK)
+	{
+		clb_fail(s->path, "compress a block of");
+	}
+
+	if (fwrite(s->out, 1, size, s->fd) != size)
+	{
+		clb_fail(s->path, "write");
+	}
+
+	b = s->blocks + s->total - 1;
+	b->offset = s->offset;
+	b->size = size;
+	b->raw = s->raw_len;
+	b->count = s->count;
+
+	s->offset += size;
+	s->raw_len = 0;
+	s->count = 0;
+}
+
+void clbout_open(clbout_t * s, const char * path, const int a, const int m, const int index)
+{
+	unsigned char header[CLB_HEADER_SIZE];
+	char name[600];
+
+	// an index left over from an earlier run
+	sprintf(name, "%s.idx", path);
+	remove(name);
+
+	s->path = strdup(path);
+	s->fd = fopen(path, "wb");
+
+	if (s->fd == NULL)
+	{
+		clb_fail(path, "open");
+	}
+
+	s->a = a;
+	s->m = m;
+	s->index = index;
+
+	memcpy(header, "CLGRPBIN", 8);
+	clb_put32(header + 8, CLB_VERSION);
+	clb_put32(header + 12, a);
+	clb_put32(header + 16, m);
+	clb_put32(header + 20, index);
+
+	if (fwrite(header, 1, CLB_HEADER_SIZE, s->fd) != CLB_HEADER_SIZE)
+	{
+		clb_fail(path, "write");
+	}
+
+	s->raw = (unsigned char *) malloc(CLB_BLOCK_RECORDS * CLB_MAX_RECORD);
+	s->out = (unsigned char *) malloc(compressBound(CLB_BLOCK_RECORDS * CLB_MAX_RECORD));
+	s->raw_len = 0;
+	s->count = 0;
+
+	s->total = 0;
+	s->saved = 0;
+	s->allocated = 16;
+	s->blocks = (clb_block_t *) malloc(s->allocated * sizeof(clb_block_t));
+	s->offset = CLB_HEADER_SIZE;
+}
+
+void clbout_resume(clbout_t * s, const char * path, const int a, const int m, const int index, const long offset)
+{
+	unsigned char entry[CLB_ENTRY_SIZE];
+	char name[600];
+	FILE * idx;
+	clb_block_t b;
+
+	s->path = strdup(path);
+	s->fd = fopen(path, "r+b");
+
+	if (s->fd == NULL || ftruncate(fileno(s->fd), offset) != 0 || fseek(s->fd, offset, SEEK_SET) != 0)
+	{
+		clb_fail(path, "resume");
+	}
+
+	s->a = a;
+	s->m = m;
+	s->index = index;
+
+	s->raw = (unsigned char *) malloc(CLB_BLOCK_RECORDS * CLB_MAX_RECORD);
+	s->out = (unsigned char *) malloc(compressBound(CLB_BLOCK_RECORDS * CLB_MAX_RECORD));
+	s->raw_len = 0;
+	s->count = 0;
+
+	s->total = 0;
+	s->allocated = 16;
+	s->blocks = (clb_block_t *) malloc(s->allocated * sizeof(clb_block_t));
+	s->offset = offset;
+
+	// the blocks before offset, the index may hold more from after the checkpoint
+	sprintf(name, "%s.idx", path);
+
+	if ((idx = fopen(name, "rb")) == NULL)
+	{
+		clb_fail(name, "open");
+	}
+
+	while (fread(entry, 1, CLB_ENTRY_SIZE, idx) == CLB_ENTRY_SIZE)
+	{
+		clb_get_entry(entry, &b);
+
+		if (b.offset + b.size > (uint64_t) offset)
+		{
+			break;
+		}
+
+		if (s->total == s->allocated)
+		{
+			s->allocated <<= 1;
+			s->blocks = (clb_block_t *) realloc(s->blocks, s->allocated * sizeof(clb_block_t));
+		}
+
+		s->blocks[s->total++] = b;
+	}
+
+	if (s->total == 0 ? offset != CLB_HEADER_SIZE : s->blocks[s->total - 1].offset + s->blocks[s->total - 1].size != (uint64_t) offset)
+	{
+		clb_corrupt(path);
+	}
+
+	fclose(idx);
+
+	if (truncate(name, s->total * CLB_ENTRY_SIZE) != 0)
+	{
+		clb_fail(name, "truncate");
+	}
+
+	s->saved = s->total;
+}
+
+long clbout_checkpoint(clbout_t * s)
+{
+	unsigned char entry[CLB_ENTRY_SIZE];
+	char name[600];
+	FILE * idx;
+
+	clbout_flush(s);
+
+	if (fflush(s->fd) != 0)
+	{
+		clb_fail(s->path, "write");
+	}
+
+	sprintf(name, "%s.idx", s->path);
+
+	if ((idx = fopen(name, "ab")) == NULL)
+	{
+		clb_fail(name, "open");
+	}
+
+	for (; s->saved < s->total; s->saved++)
+	{
+		clb_put_entry(entry, s->blocks + s->saved);
+
+		if (fwrite(entry, 1, CLB_ENTRY_SIZE, idx) != CLB_ENTRY_SIZE)
+		{
+			clb_fail(name, "write");
+		}
+	}
+
+	if (fclose(idx) != 0)
+	{
+		clb_fail(name, "write");
+	}
+
+	return s->offset;
+}
+
+void clbout_record(clbout_t * s, const long D, const int dist, const int h, const int * inv, const int rank)
+{
+	unsigned char * p = s->raw + s->raw_len;
+	int i;
+
+	// start a new block
+	if (s->count == 0)
+	{
+		if (s->total == s->allocated)
+		{
+			s->allocated <<= 1;
+			s->blocks = (clb_block_t *) realloc(s->blocks, s->allocated * sizeof(clb_block_t));
+		}
+
+		s->blocks[s->total++].D_base = D - (long) dist * s->m;
+	}
+
+	p = clb_put_varint(p, dist);
+	p = clb_put_varint(p, h);
+	p = clb_put_varint(p, rank);
+
+	for (i = 0; i < rank; i++)
+	{
+		p = clb_put_varint(p, inv[i]);
+	}
+
+	s->raw_len = p - s->raw;
+
+	if (++s->count == CLB_BLOCK_RECORDS)
+	{
+		clbout_flush(s);
+	}
+}
+
+void clbout_close(clbout_t * s)
+{
+	unsigned char entry[CLB_ENTRY_SIZE];
+	char name[600];
+	size_t i;
+
+	clbout_flush(s);
+
+	for (i = 0; i < s->total; i++)
+	{
+		clb_put_entry(entry, s->blocks + i);
+
+		if (fwrite(entry, 1, CLB_ENTRY_SIZE, s->fd) != CLB_ENTRY_SIZE)
+		{
+			clb_fail(s->path, "write");
+		}
+	}
+
+	clb_put64(entry, s->offset);
+	clb_put64(entry + 8, s->total);
+	memcpy(entry + 16, "CLGRPIDX", 8);
+
+	if (fwrite(entry, 1, CLB_TRAILER_SIZE, s->fd) != CLB_TRAILER_SIZE || fclose(s->fd) != 0)
+	{
+		clb_fail(s->path, "write");
+	}
+
+	sprintf(name, "%s.clb", s->path);
+
+	if (rename(s->path, name) != 0)
+	{
+		clb_fail(s->path, "rename");
+	}
+
+	sprintf(name, "%s.idx", s->path);
+	remove(name);
+
+	free(s->raw);
+	free(s->out);
+	free(s->blocks);
+	free(s->path);
+}
+
+
+
+// READER IMPLEMENTATION
+
+static void clbin_load(clbin_t * s, const size_t i)
+{
+	const clb_block_t * b = s->blocks + i;
+	uLongf raw = b->raw;
+
+	if (fseek(s->fd, b->offset, SEEK_SET) != 0 || fread(s->in, 1, b->size, s->fd) != b->size)
+	{
+		clb_fail(s->path, "read");
+	}
+
+	if (uncompress(s->raw, &raw, s->in, b->size) != Z_OK || raw != b->raw)
+	{
+		clb_corrupt(s->path);
+	}
+
+	s->block = i + 1;
+	s->pos = 0;
+	s->raw_len = raw;
+	s->left = b->count;
+	s->D = b->D_base;
+}
+
+void clbin_open(clbin_t * s, const char * path)
+{
+	unsigned char buf[CLB_ENTRY_SIZE];
+	uint64_t offset;
+	size_t i, max_size = 1, max_raw = 1;
+
+	s->path = strdup(path);
+	s->fd = fopen(path, "rb");
+
+	if (s->fd == NULL)
+	{
+		clb_fail(path, "open");
+	}
+
+	if (fread(buf, 1, CLB_HEADER_SIZE, s->fd) != CLB_HEADER_SIZE || memcmp(buf, "CLGRPBIN", 8) != 0 || clb_get32(buf + 8) != CLB_VERSION)
+	{
+		clb_corrupt(path);
+	}
+
+	s->a = clb_get32(buf + 12);
+	s->m = clb_get32(buf + 16);
+	s->index = clb_get32(buf + 20);
+
+	if (fseek(s->fd, -CLB_TRAILER_SIZE, SEEK_END) != 0 || fread(buf, 1, CLB_TRAILER_SIZE, s->fd) != CLB_TRAILER_SIZE || memcmp(buf + 16, "CLGRPIDX", 8) != 0)
+	{
+		clb_corrupt(path);
+	}
+
+	offset = clb_get64(buf);
+	s->total = clb_get64(buf + 8);
+	s->blocks = (clb_block_t *) malloc((s->total + 1) * sizeof(clb_block_t));
+
+	if (fseek(s->fd, offset, SEEK_SET) != 0)
+	{
+		clb_corrupt(path);
+	}
+
+	for (i = 0; i < s->total; i++)
+	{
+		if (fread(buf, 1, CLB_ENTRY_SIZE, s->fd) != CLB_ENTRY_SIZE)
+		{
+			clb_corrupt(path);
+		}
+
+		clb_get_entry(buf, s->blocks + i);
+
+		max_size = (s->blocks[i].size > max_size) ? s->blocks[i].size : max_size;
+		max_raw = (s->blocks[i].raw > max_raw) ? s->blocks[i].raw : max_raw;
+	}
+
+	s->in = (unsigned char *) malloc(max_size);
+	s->raw = (unsigned char *) malloc(max_raw);
+	s->block = 0;
+	s->pos = 0;
+	s->raw_len = 0;
+	s->left = 0;
+	s->D = 0;
+}
+
+void clbin_seek(clbin_t * s, const long D)
+{
+	size_t lo = 0, hi = s->total, mid, pos;
+	uint32_t left, rank;
+	long D_prev;
+
+	if (s->total == 0)
+	{
+		return;
+	}
+
+	// last block whose records all come after its D_base < D
+	while (hi - lo > 1)
+	{
+		mid = (lo + hi) >> 1;
+
+		if (s->blocks[mid].D_base < D)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	clbin_load(s, lo);
+
+	// skip the records below D, a block may end below D as well
+	for (;;)
+	{
+		if (s->left == 0)
+		{
+			if (s->block == s->total)
+			{
+				return;
+			}
+
+			clbin_load(s, s->block);
+		}
+
+		pos = s->pos;
+		left = s->left;
+		D_prev = s->D;
+
+		s->D += (long) clb_get_varint(s->raw, &s->pos) * s->m;
+
+		if (s->D >= D)
+		{
+			s->pos = pos;
+			s->left = left;
+			s->D = D_prev;
+			return;
+		}
+
+		clb_get_varint(s->raw, &s->pos);
+		for (rank = clb_get_varint(s->raw, &s->pos); rank > 0; rank--)
+		{
+			clb_get_varint(s->raw, &s->pos);
+		}
+		s->left--;
+	}
+}
+
+int clbin_record(clbin_t * s, long * D, int * dist, int * h, int * inv, int * rank)
+{
+	int i;
+
+	if (s->left == 0)
+	{
+		if (s->block == s->total)
+		{
+			return 0;
+		}
+
+		clbin_load(s, s->block);
+	}
+
+	*dist = clb_get_varint(s->raw, &s->pos);
+	*h = clb_get_varint(s->raw, &s->pos);
+	*rank = clb_get_varint(s->raw, &s->pos);
+
+	if (*rank > CLB_MAX_RANK)
+	{
+		clb_corrupt(s->path);
+	}
+
+	for (i = 0; i < *rank; i++)
+	{
+		inv[i] = clb_get_varint(s->raw, &s->pos);
+	}
+
+	if (s->pos > s->raw_len)
+	{
+		clb_corrupt(s->path);
+	}
+
+	s->D += (long) *dist * s->m;
+	*D = s->D;
+	s->left--;
+
+	return 1;
+}
+
+void clbin_close(clbin_t * s)
+{
+	fclose(s->fd);
+	free(s->blocks);
+	free(s->in);
+	free(s->raw);
+	free(s->path);
+}
@@ -0,0 +1,131 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#ifndef CLB_H_
+#define CLB_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+// BINARY TABULATION FORMAT
+// A .clb file holds the same records as the text tabulation, one per
+// fundamental discriminant: dist, h and the invariant factors c1 | ... | ct.
+// Every field is an unsigned LEB128 varint, a record being
+//
+//   dist h t c1 ... ct
+//
+// Records are grouped into blocks of at most CLB_BLOCK_RECORDS, and each block
+// is compressed on its own with zlib. The file is laid out as
+//
+//   header   "CLGRPBIN" version a m index         8 + 4 * 4 bytes
+//   blocks   zlib streams
+//   index    one clb_block_t per block            28 bytes each
+//   trailer  index offset, block count "CLGRPIDX" 8 + 8 + 8 bytes
+//
+// and all integers outside of the blocks are little endian. D_base of a block
+// is |D| before its first record, so that |D| of every record in the block is
+// D_base plus the running sum of dist * m.
+
+#define CLB_VERSION 1
+
+#ifndef CLB_BLOCK_RECORDS
+#define CLB_BLOCK_RECORDS (1 << 16)
+#endif
+
+// the BJT engine finds at most MAX_RANK = 10 invariant factors
+#define CLB_MAX_RANK 10
+
+// upper bound on the encoded size of a record, 5 bytes per field
+#define CLB_MAX_RECORD (5 * (CLB_MAX_RANK + 3))
+
+typedef struct
+{
+	int64_t D_base;						// |D| before the first record
+	uint64_t offset;					// file offset of the zlib stream
+	uint32_t size;						// compressed size
+	uint32_t raw;						// uncompressed size
+	uint32_t count;						// number of records
+} clb_block_t;
+
+typedef struct
+{
+	FILE * fd;
+	char * path;
+	int a, m, index;
+
+	unsigned char * raw;				// records of the current block
+	size_t raw_len;
+	uint32_t count;
+	unsigned char * out;				// compressed block
+
+	clb_block_t * blocks;
+	size_t total, allocated;
+	size_t saved;						// blocks in path.idx
+	uint64_t offset;					// where the next block goes
+} clbout_t;
+
+typedef struct
+{
+	FILE * fd;
+	char * path;
+	int a, m, index;
+
+	clb_block_t * blocks;
+	size_t total;
+	size_t block;						// next block to load
+
+	unsigned char * raw;				// records of the loaded block
+	unsigned char * in;
+	size_t pos, raw_len;
+	uint32_t left;						// records left in the loaded block
+	long D;								// |D| of the last record read
+} clbin_t;
+
+
+// WRITER
+// The file is written under path and renamed to path.clb on clbout_close.
+
+void clbout_open(clbout_t * s, const char * path, const int a, const int m, const int index);
+
+void clbout_record(clbout_t * s, const long D, const int dist, const int h, const int * inv, const int rank);
+
+void clbout_close(clbout_t * s);
+
+// flushes the current block and returns the offset after it, the blocks so
+// far are appended to path.idx for clbout_resume
+long clbout_checkpoint(clbout_t * s);
+
+// reopens the partial file path at offset from a checkpoint
+void clbout_resume(clbout_t * s, const char * path, const int a, const int m, const int index, const long offset);
+
+
+// READER
+
+void clbin_open(clbin_t * s, const char * path);
+
+// positions the reader at the first record with |D| >= D
+void clbin_seek(clbin_t * s, const long D);
+
+// returns 0 at the end of the file, inv must hold CLB_MAX_RANK entries
+int clbin_record(clbin_t * s, long * D, int * dist, int * h, int * inv, int * rank);
+
+void clbin_close(clbin_t * s);
+
+#endif /* CLB_H_ */
@@ -0,0 +1,100 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clb.h"
+#include "gzio.h"
+
+// formats a record in the text layout of tabulate_bjt, returns its length
+static int format_record(char * line, const long first, const int h, const int * inv, const int rank)
+{
+	char * p = line + sprintf(line, "%ld\t%u\t", first, h);
+	int r;
+
+	for (r = 0; r < rank - 1; r++)
+	{
+		p += sprintf(p, "%d ", inv[r]);
+	}
+	p += sprintf(p, "%d\n", inv[rank - 1]);
+
+	return p - line;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc != 2 && argc != 4)
+	{
+		printf("Format: ./clb2txt [file.clb] or ./clb2txt [file.clb] [D_lo] [D_hi]\n");
+		printf("Converts file.clb to file.gz in the text layout written by clgrp, or prints\n");
+		printf("|D|, h and the invariant factors for D_lo <= |D| < D_hi.\n");
+		exit(1);
+	}
+
+	char line[256], name[500];
+	int dist, h, rank, inv[CLB_MAX_RANK];
+	long D;
+
+	clbin_t in;
+	clbin_open(&in, argv[1]);
+
+	if (argc == 2)
+	{
+		const size_t len = strlen(argv[1]);
+
+		if (len < 4 || len >= sizeof(name) || strcmp(argv[1] + len - 4, ".clb") != 0)
+		{
+			printf("The file %s does not end in .clb\n", argv[1]);
+			exit(1);
+		}
+
+		memcpy(name, argv[1], len - 4);
+		name[len - 4] = '\0';
+
+		gzout_t out;
+		gzout_open(&out, name, GZ_THREADED);
+
+		while (clbin_record(&in, &D, &dist, &h, inv, &rank))
+		{
+			gzout_write(&out, line, format_record(line, dist, h, inv, rank));
+		}
+
+		gzout_close(&out);
+	}
+	else
+	{
+		const long D_lo = atol(argv[2]);
+		const long D_hi = atol(argv[3]);
+
+		clbin_seek(&in, D_lo);
+
+		while (clbin_record(&in, &D, &dist, &h, inv, &rank) && D < D_hi)
+		{
+			format_record(line, D, h, inv, rank);
+			fputs(line, stdout);
+		}
+	}
+
+	clbin_close(&in);
+
+	return 0;
+}
@@ -0,0 +1,420 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "clc.h"
+
+// MPI_File_write_at takes an int count
+#define CLC_CHUNK (1 << 30)
+
+static void clc_fail(const char * path, const char * what)
+{
+	char data[600];
+
+	sprintf(data, "Unable to %s %s", what, path);
+	perror(data);
+	fflush(stderr);
+	exit(1);
+}
+
+static void clc_corrupt(const char * path, const char * what)
+{
+	fprintf(stderr, "The container %s %s\n", path, what);
+	fflush(stderr);
+	exit(1);
+}
+
+
+// LITTLE ENDIAN CODING
+
+static __inline__
+void clc_put64(unsigned char * p, const uint64_t x)
+{
+	for (int i = 0; i < 8; i++)
+	{
+		p[i] = x >> (8 * i);
+	}
+}
+
+static __inline__
+uint64_t clc_get64(const unsigned char * p)
+{
+	uint64_t x = 0;
+
+	for (int i = 7; i >= 0; i--)
+	{
+		x = (x << 8) | p[i];
+	}
+
+	return x;
+}
+
+static void clc_put_header(unsigned char * head, const int a, const int m, const long ell, const long D_total)
+{
+	memcpy(head, "CLGRPCLC", 8);
+	clc_put64(head + 8, (uint32_t) CLC_VERSION | ((uint64_t) (uint32_t) a << 32));
+	clc_put64(head + 16, (uint32_t) m | ((uint64_t) (uint32_t) ell << 32));
+	clc_put64(head + 24, (uint64_t) D_total);
+}
+
+static void clc_put_entry(unsigned char * entry, const clc_entry_t * e)
+{
+	clc_put64(entry, (uint32_t) e->index | ((uint64_t) (uint32_t) e->part << 32));
+	clc_put64(entry + 8, (uint64_t) e->D_lo);
+	clc_put64(entry + 16, (uint64_t) e->D_hi);
+	clc_put64(entry + 24, e->offset);
+	clc_put64(entry + 32, e->length);
+}
+
+// decodes the n entries of buf into e, dropping the unused slots, returns their number
+static size_t clc_get_entries(clc_entry_t * e, const unsigned char * buf, const size_t n)
+{
+	size_t i, total = 0;
+	uint64_t x;
+
+	for (i = 0; i < n; i++, buf += CLC_ENTRY_SIZE)
+	{
+		x = clc_get64(buf);
+		e[total].index = (int32_t) (uint32_t) x;
+		e[total].part = (int32_t) (uint32_t) (x >> 32);
+		e[total].D_lo = (int64_t) clc_get64(buf + 8);
+		e[total].D_hi = (int64_t) clc_get64(buf + 16);
+		e[total].offset = clc_get64(buf + 24);
+		e[total].length = clc_get64(buf + 32);
+
+		total += (e[total].length > 0);
+	}
+
+	return total;
+}
+
+void clc_name(char * name, const char * folder, const int a, const int m, const long ell)
+{
+	if (ell == 0)
+	{
+		sprintf(name, "%s/cl%dmod%d.clc", folder, a, m);
+	}
+	else
+	{
+		sprintf(name, "%s/cl%dmod%dl%ld.clc", folder, a, m, ell);
+	}
+}
+
+static const clc_entry_t * clc_find(const clc_entry_t * entries, const size_t total, const int index, const int part)
+{
+	for (size_t i = 0; i < total; i++)
+	{
+		if (entries[i].index == index && entries[i].part == part)
+		{
+			return entries + i;
+		}
+	}
+
+	return NULL;
+}
+
+
+
+// WRITER IMPLEMENTATION
+
+static void clcout_write_at(const clcout_t * s, MPI_File fd, MPI_Offset offset, const char * data, size_t len)
+{
+	int n;
+
+	while (len > 0)
+	{
+		n = (len < CLC_CHUNK) ? len : CLC_CHUNK;
+
+		if (MPI_File_write_at(fd, offset, (void *) data, n, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+		{
+			clc_fail(s->path, "write");
+		}
+
+		offset += n;
+		data += n;
+		len -= n;
+	}
+}
+
+// on the first rank, writes the header of a new container or checks that of
+// an existing one, and loads the index
+static void clcout_load(clcout_t * s, const int a, const int m, const long ell, const long D_total)
+{
+	unsigned char head[CLC_HEADER_SIZE], found[CLC_HEADER_SIZE];
+	unsigned char * buf;
+	MPI_Offset size;
+	size_t n;
+
+	clc_put_header(head, a, m, ell, D_total);
+
+	if (MPI_File_get_size(s->fd, &size) != MPI_SUCCESS)
+	{
+		clc_fail(s->path, "read");
+	}
+
+	if (size == 0)
+	{
+		clcout_write_at(s, s->fd, 0, (const char *) head, CLC_HEADER_SIZE);
+		size = CLC_HEADER_SIZE;
+	}
+	else if (size < CLC_HEADER_SIZE
+			|| MPI_File_read_at(s->fd, 0, found, CLC_HEADER_SIZE, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS
+			|| memcmp(head, found, CLC_HEADER_SIZE) != 0)
+	{
+		clc_corrupt(s->path, "is not a container of this class, version and D_total");
+	}
+
+	s->next[0] = size;
+
+	if (MPI_File_get_size(s->idx, &size) != MPI_SUCCESS)
+	{
+		clc_fail(s->path, "read the index of");
+	}
+
+	// a partial entry at the end is a slot that was never written
+	n = size / CLC_ENTRY_SIZE;
+	s->next[1] = n;
+
+	buf = (unsigned char *) malloc(n * CLC_ENTRY_SIZE + 1);
+	s->entries = (clc_entry_t *) malloc((n + 1) * sizeof(clc_entry_t));
+
+	if (n > 0 && MPI_File_read_at(s->idx, 0, buf, n * CLC_ENTRY_SIZE, MPI_BYTE, MPI_STATUS_IGNORE) != MPI_SUCCESS)
+	{
+		clc_fail(s->path, "read the index of");
+	}
+
+	s->total = clc_get_entries(s->entries, buf, n);
+	free(buf);
+}
+
+void clcout_open(clcout_t * s, MPI_Comm comm, const char * folder, const int a, const int m, const long ell, const long D_total)
+{
+	char name[520];
+	uint64_t total;
+	int rank;
+
+	MPI_Comm_rank(comm, &rank);
+
+	clc_name(name, folder, a, m, ell);
+	s->path = strdup(name);
+	s->total = 0;
+
+	if (MPI_File_open(comm, s->path, MPI_MODE_CREATE | MPI_MODE_RDWR, MPI_INFO_NULL, &s->fd) != MPI_SUCCESS)
+	{
+		clc_fail(s->path, "open");
+	}
+
+	sprintf(name, "%s.idx", s->path);
+
+	if (MPI_File_open(comm, name, MPI_MODE_CREATE | MPI_MODE_RDWR, MPI_INFO_NULL, &s->idx) != MPI_SUCCESS)
+	{
+		clc_fail(name, "open");
+	}
+
+	if (MPI_Win_allocate((rank == 0) ? 2 * sizeof(int64_t) : 0, sizeof(int64_t), MPI_INFO_NULL, comm, &s->next, &s->win) != MPI_SUCCESS)
+	{
+		clc_fail(s->path, "allocate the offsets of");
+	}
+
+	MPI_Win_lock_all(MPI_MODE_NOCHECK, s->win);
+
+	if (rank == 0)
+	{
+		clcout_load(s, a, m, ell, D_total);
+		MPI_Win_sync(s->win);
+	}
+
+	// the offsets are in place once the index arrives
+	total = s->total;
+	MPI_Bcast(&total, 1, MPI_UINT64_T, 0, comm);
+
+	if (rank != 0)
+	{
+		s->total = total;
+		s->entries = (clc_entry_t *) malloc((total + 1) * sizeof(clc_entry_t));
+	}
+
+	MPI_Bcast(s->entries, total * sizeof(clc_entry_t), MPI_BYTE, 0, comm);
+}
+
+int clcout_exists(const clcout_t * s, const int index, const int part)
+{
+	return clc_find(s->entries, s->total, index, part) != NULL;
+}
+
+void clcout_append(clcout_t * s, const int index, const int part, const long D_lo, const long D_hi, const char * data, const size_t len)
+{
+	unsigned char entry[CLC_ENTRY_SIZE];
+	int64_t add = len, one = 1, offset, slot;
+	clc_entry_t e;
+
+	MPI_Fetch_and_op(&add, &offset, MPI_INT64_T, 0, 0, MPI_SUM, s->win);
+	MPI_Win_flush(0, s->win);
+
+	clcout_write_at(s, s->fd, offset, data, len);
+
+	e.index = index;
+	e.part = part;
+	e.D_lo = D_lo;
+	e.D_hi = D_hi;
+	e.offset = offset;
+	e.length = len;
+	clc_put_entry(entry, &e);
+
+	MPI_Fetch_and_op(&one, &slot, MPI_INT64_T, 0, 1, MPI_SUM, s->win);
+	MPI_Win_flush(0, s->win);
+
+	clcout_write_at(s, s->idx, slot * CLC_ENTRY_SIZE, (const char *) entry, CLC_ENTRY_SIZE);
+}
+
+void clcout_close(clcout_t * s)
+{
+	MPI_Win_unlock_all(s->win);
+	MPI_Win_free(&s->win);
+
+	if (MPI_File_close(&s->fd) != MPI_SUCCESS || MPI_File_close(&s->idx) != MPI_SUCCESS)
+	{
+		clc_fail(s->path, "close");
+	}
+
+	free(s->entries);
+	free(s->path);
+}
+
+
+
+// READER IMPLEMENTATION
+
+void clcin_open(clcin_t * s, const char * path)
+{
+	unsigned char head[CLC_HEADER_SIZE], * buf;
+	char name[520];
+	FILE * idx;
+	long size;
+	size_t n;
+	uint64_t x;
+
+	s->path = strdup(path);
+	s->fd = fopen(path, "rb");
+
+	if (s->fd == NULL)
+	{
+		clc_fail(path, "open");
+	}
+
+	if (fread(head, 1, CLC_HEADER_SIZE, s->fd) != CLC_HEADER_SIZE || memcmp(head, "CLGRPCLC", 8) != 0)
+	{
+		clc_corrupt(path, "has no header");
+	}
+
+	x = clc_get64(head + 8);
+
+	if ((uint32_t) x != CLC_VERSION)
+	{
+		clc_corrupt(path, "is of another version");
+	}
+
+	s->a = (int32_t) (x >> 32);
+	x = clc_get64(head + 16);
+	s->m = (int32_t) (uint32_t) x;
+	s->ell = (int32_t) (x >> 32);
+	s->D_total = (int64_t) clc_get64(head + 24);
+
+	sprintf(name, "%s.idx", path);
+	idx = fopen(name, "rb");
+
+	if (idx == NULL || fseek(idx, 0, SEEK_END) != 0 || (size = ftell(idx)) < 0 || fseek(idx, 0, SEEK_SET) != 0)
+	{
+		clc_fail(name, "open");
+	}
+
+	n = size / CLC_ENTRY_SIZE;
+	buf = (unsigned char *) malloc(n * CLC_ENTRY_SIZE + 1);
+	s->entries = (clc_entry_t *) malloc((n + 1) * sizeof(clc_entry_t));
+
+	if (fread(buf, CLC_ENTRY_SIZE, n, idx) != n)
+	{
+		clc_fail(name, "read");
+	}
+
+	s->total = clc_get_entries(s->entries, buf, n);
+
+	free(buf);
+	fclose(idx);
+}
+
+const clc_entry_t * clcin_find(const clcin_t * s, const int index, const int part)
+{
+	return clc_find(s->entries, s->total, index, part);
+}
+
+// the copy lives under name.tmp until it is complete, like the .gz of clgrp
+void clcin_extract(const clcin_t * s, const clc_entry_t * e, const char * name)
+{
+	char tmp[520], buf[1 << 16];
+	uint64_t left = e->length;
+	size_t n;
+	FILE * out;
+
+	sprintf(tmp, "%s.tmp", name);
+	out = fopen(tmp, "wb");
+
+	if (out == NULL)
+	{
+		clc_fail(tmp, "open");
+	}
+
+	if (fseeko(s->fd, e->offset, SEEK_SET) != 0)
+	{
+		clc_fail(s->path, "read");
+	}
+
+	while (left > 0)
+	{
+		n = (left < sizeof(buf)) ? left : sizeof(buf);
+
+		if (fread(buf, 1, n, s->fd) != n)
+		{
+			clc_corrupt(s->path, "ends inside of a segment");
+		}
+
+		if (fwrite(buf, 1, n, out) != n)
+		{
+			clc_fail(tmp, "write");
+		}
+
+		left -= n;
+	}
+
+	if (fclose(out) != 0 || rename(tmp, name) != 0)
+	{
+		clc_fail(name, "write");
+	}
+}
+
+void clcin_close(clcin_t * s)
+{
+	fclose(s->fd);
+	free(s->entries);
+	free(s->path);
+}
@@ -0,0 +1,120 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#ifndef CLC_H_
+#define CLC_H_
+
+#include <mpi.h>
+
+#include <stdio.h>
+#include <stdint.h>
+
+// OUTPUT CONTAINER
+// With -DWITH_CONTAINER_OUTPUT clgrp writes all of the files of a class into
+// one container folder/cl[a]mod[m].clc, and those of each ell into
+// folder/cl[a]mod[m]l[ell].clc, rather than a file per index in a folder of
+// its own, which spares a parallel file system the metadata operations of
+// thousands of files. A container is laid out as
+//
+//   header    "CLGRPCLC" version a m ell D_total     8 + 4 * 4 + 8 bytes
+//   segments  one per file or part, in the order they were finished
+//
+// and its index path.idx holds one clc_entry_t per segment, 40 bytes each, all
+// integers being little endian. A segment is byte for byte the .gz file that
+// clgrp writes for the file or part otherwise. Entries of length 0 are slots
+// reserved by a rank that did not get to write them.
+//
+// The worker ranks open the containers together, then append independently:
+// a segment and its entry go to offsets reserved with an atomic fetch and add
+// on a window of the first worker, and the entry is only written after its
+// segment, so that the index never refers to a partial segment. clc2gz turns a
+// container back into the legacy files, stitching the parts.
+
+#define CLC_VERSION 1
+
+#define CLC_HEADER_SIZE 32
+#define CLC_ENTRY_SIZE 40
+
+typedef struct
+{
+	int32_t index;
+	int32_t part;						// -1 for a whole file
+	int64_t D_lo;						// the segment covers D_lo <= |D| < D_hi
+	int64_t D_hi;
+	uint64_t offset;
+	uint64_t length;
+} clc_entry_t;
+
+typedef struct
+{
+	MPI_File fd;
+	MPI_File idx;
+	MPI_Win win;						// the next offset and the next slot, on the first rank
+	int64_t * next;
+	char * path;
+
+	clc_entry_t * entries;				// what the container held when it was opened
+	size_t total;
+} clcout_t;
+
+typedef struct
+{
+	FILE * fd;
+	char * path;
+	int a, m;
+	long ell;							// 0 for the class itself
+	long D_total;
+
+	clc_entry_t * entries;
+	size_t total;
+} clcin_t;
+
+// the name of the container of the class a mod m, or of its orders of index
+// ell^2 if ell is not 0
+void clc_name(char * name, const char * folder, const int a, const int m, const long ell);
+
+
+// WRITER
+
+// collective over comm, creates the container if there is none
+void clcout_open(clcout_t * s, MPI_Comm comm, const char * folder, const int a, const int m, const long ell, const long D_total);
+
+// returns 1 if the container already held the segment when it was opened
+int clcout_exists(const clcout_t * s, const int index, const int part);
+
+void clcout_append(clcout_t * s, const int index, const int part, const long D_lo, const long D_hi, const char * data, const size_t len);
+
+// collective over the comm of clcout_open
+void clcout_close(clcout_t * s);
+
+
+// READER
+
+void clcin_open(clcin_t * s, const char * path);
+
+// the entry of the segment, NULL if there is none
+const clc_entry_t * clcin_find(const clcin_t * s, const int index, const int part);
+
+// copies the segment to the file name
+void clcin_extract(const clcin_t * s, const clc_entry_t * e, const char * name);
+
+void clcin_close(clcin_t * s);
+
+#endif /* CLC_H_ */
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "clc.h"
+#include "clgrp.h"
+
+// the legacy name of file index of the container, or of one of its parts
+static void segment_name(char * name, const clcin_t * in, const char * folder, const int index, const int part)
+{
+	char * p = name;
+
+	if (in->ell == 0)
+	{
+		p += sprintf(p, "%s/cl%dmod%d/cl%dmod%d.%d", folder, in->a, in->m, in->a, in->m, index);
+	}
+	else
+	{
+		p += sprintf(p, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d", folder, in->a, in->m, in->ell, in->a, in->m, in->ell, index);
+	}
+
+	if (part >= 0)
+	{
+		p += sprintf(p, ".part%d", part);
+	}
+
+	strcpy(p, ".gz");
+}
+
+// writes file index, stitching its parts, returns 0 if the container lacks some of it
+static int extract(const clcin_t * in, const char * folder, const int index)
+{
+	const int parts = bjt_parts(in->D_total);
+	const clc_entry_t * e = clcin_find(in, index, -1);
+	char name[600];
+	int part;
+
+	segment_name(name, in, folder, index, -1);
+
+	if (access(name, F_OK) != -1)
+	{
+		printf("The file %s exists, skipping.\n", name);
+		return 1;
+	}
+
+	if (e != NULL)
+	{
+		clcin_extract(in, e, name);
+		return 1;
+	}
+
+	for (part = 0; part < parts; part++)
+	{
+		if (clcin_find(in, index, part) == NULL)
+		{
+			printf("The container %s lacks file %d, part %d.\n", in->path, index, part);
+			return 0;
+		}
+	}
+
+	for (part = 0; part < parts; part++)
+	{
+		segment_name(name, in, folder, index, part);
+		clcin_extract(in, clcin_find(in, index, part), name);
+	}
+
+	if (in->ell == 0)
+	{
+		stitch_bjt(index, in->D_total, NULL, folder, in->a, in->m, NULL);
+	}
+	else
+	{
+		stitch_bjt_ell(index, in->D_total, folder, in->a, in->m, in->ell);
+	}
+
+	return 1;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc != 2 && argc != 4)
+	{
+		printf("Format: ./clc2gz [file.clc] or ./clc2gz [file.clc] [folder] [index]\n");
+		printf("Lists the segments of the container file.clc written by clgrp with -DWITH_CONTAINER_OUTPUT,\n");
+		printf("or extracts the file [index], or all of them if [index] is -1, into [folder] as clgrp\n");
+		printf("writes it without, i.e. [folder]/cl[a]mod[m]/cl[a]mod[m].[index].gz.\n");
+		exit(1);
+	}
+
+	char name[600];
+	size_t i;
+	int index, missing = 0;
+
+	clcin_t in;
+	clcin_open(&in, argv[1]);
+
+	if (argc == 2)
+	{
+		printf("a=%d, m=%d, ell=%ld, D_total=%ld, %zu segments\n", in.a, in.m, in.ell, in.D_total, in.total);
+
+		for (i = 0; i < in.total; i++)
+		{
+			printf("%d\t%d\t%ld\t%ld\t%llu\t%llu\n", in.entries[i].index, in.entries[i].part, (long) in.entries[i].D_lo, (long) in.entries[i].D_hi,
+					(unsigned long long) in.entries[i].offset, (unsigned long long) in.entries[i].length);
+		}
+	}
+	else
+	{
+		const char * folder = argv[2];
+		index = atoi(argv[3]);
+
+		if (in.ell == 0)
+		{
+			sprintf(name, "%s/cl%dmod%d", folder, in.a, in.m);
+		}
+		else
+		{
+			sprintf(name, "%s/cl%dmod%dl%ld", folder, in.a, in.m, in.ell);
+		}
+		mkdir(name, 0744);
+
+		if (index >= 0)
+		{
+			missing = !extract(&in, folder, index);
+		}
+		else
+		{
+			int last = -1;
+
+			for (i = 0; i < in.total; i++)
+			{
+				last = (in.entries[i].index > last) ? in.entries[i].index : last;
+			}
+
+			// the files with at least one segment
+			char * held = (char *) calloc(last + 1, 1);
+
+			for (i = 0; i < in.total; i++)
+			{
+				held[in.entries[i].index] = 1;
+			}
+
+			for (index = 0; index <= last; index++)
+			{
+				if (held[index])
+				{
+					missing += !extract(&in, folder, index);
+				}
+			}
+
+			free(held);
+		}
+	}
+
+	clcin_close(&in);
+
+	return (missing > 0);
+}
@@ -34,17 +34,24 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include <liboptarith/primes.h>
 #include <liboptarith/sqrtmodp_list.h>
 
 #include "clgrp.h"
 #include "sieve.h"
+#include "gzio.h"
+#include "clb.h"
 
 #ifdef WITH_PARI
 #include <pari/pari.h>
 #endif
 
+#ifdef WITH_S128_QFORMS
+#include <gmp.h>
+#endif
+
 #ifndef MIN
 #define MIN(X,Y) (((X) < (Y)) ? (X) : (Y))
 #endif
@@ -98,37 +105,78 @@ void pari_verify(int * result, const long D)
 }
 #endif
 
-void qform_pow_s32(group_pow_t * pow, qform_t * R, const qform_t * A, int32_t exp)
+// POWERING
+// The exponents of next() and of the R/Q update repeat across the generators
+// of a discriminant and across discriminants sharing init_pow, so their signed
+// binary (non-adjacent form) digits are kept in a small cache per thread. A
+// digit -1 composes with the inverse, which costs nothing for forms, and
+// leaves a third of the digits nonzero on average rather than half.
+
+#ifndef POW_CACHE
+#define POW_CACHE 64					// entries, a power of 2
+#endif
+
+typedef struct
+{
+	uint32_t exp;
+	int len;
+	int8_t digit[33];					// most significant first, digit[0] = 1
+} pow_naf_t;
+
+static __thread pow_naf_t pow_cache[POW_CACHE];
+
+// the digits of exp, signed or plain binary whichever takes fewer squarings
+// and compositions, the (len - 1) + (weight - 1) of the loop of qform_pow_s32
+static const pow_naf_t * pow_naf(const uint32_t exp)
 {
-	if (exp < 0)
+	pow_naf_t * naf = pow_cache + ((exp * 2654435761U) >> 16) % POW_CACHE;
+	int8_t digit[33];
+	uint64_t n = exp;
+	int len = 0, cost = 0, i;
+
+	if (naf->exp == exp)
 	{
-		s64_qform_group_t * group = (s64_qform_group_t *) pow->group;
-		s64_qform_t B;
-		s64_qform_set(group, &B, A);
-		s64_qform_inverse(group, &B);
-		qform_pow_u32(pow, R, &B, -exp);
+		return naf;
 	}
-	else
+
+	while (n > 0)
 	{
-		qform_pow_u32(pow, R, A, exp);
+		digit[len] = (n & 1) ? 2 - (int8_t) (n & 3) : 0;
+		n = (n - digit[len]) >> 1;
+		cost += (digit[len] != 0);
+		len++;
 	}
-}
 
-	
-// init_pow = class_number / order of the p-group
-int next(group_pow_t * gp, form_t * R, const int init_pow, int prime_index, const int ell)
-{
-	s64_qform_group_t * group = (s64_qform_group_t *) gp->group;
+	naf->exp = exp;
 
-		s64_qform_set_id(group, &R->form);
+	if (len + cost < 64 - __builtin_clzll(exp) + __builtin_popcount(exp))
+	{
+		naf->len = len;
 
-		while (s64_qform_is_id(group, &R->form))
+		for (i = 0; i < len; i++)
 		{
-			 while (s64_qform_is_primeform(group, &R->form, prime_list[++prime_index]) == 0);
+			naf->digit[i] = digit[len - 1 - i];
+		}
+	}
+	else
+	{
+		naf->len = 64 - __builtin_clzll(exp);
 
-			qform_pow_s32(gp, &R->form, &R->form, init_pow);
+		for (i = 0; i < naf->len; i++)
+		{
+			naf->digit[i] = (exp >> (naf->len - 1 - i)) & 1;
 		}
-	return prime_index;
+	}
+
+	return naf;
+}
+
+// the first prime index from i on that split does not rule out
+static __inline__ int split_next(const uint64_t split, const int i)
+{
+	const uint64_t rest = (i < SPLIT_PRIMES) ? (split >> i) : 0;
+
+	return (rest != 0) ? i + __builtin_ctzll(rest) : MAX(i, SPLIT_PRIMES);
 }
 
 // uses Olivier Ramare's upper bounds on L(1,x)
@@ -205,792 +253,1808 @@ int h_lower_bound(const long D)
 	return h_star;
 }
 
-
-// Ramachandran's thesis, p. 47
-int compute_group_bjt(int * result, const long D, const int init_pow, const int h_star, const int ell, htab_t * R, htab_t * Q)
+long h_lower_bound_primes(const long D)
 {
-#ifdef DEBUG
-printf("h_star=%d\n", h_star);
-#endif
-
-	mat_t M = mat_init(MAX_RANK);
-
-	s64_qform_group_t group;
-	s64_qform_group_init(&group);
-	s64_qform_group_set_discriminant_s64(&group, D);
-	// group.conductor_ell = ell;
-
-	group_pow_t gp;
-	group_pow_init(&gp, &group.desc.group);
+	return Q_table[(long) (log10(ABS(D))) / 5] << 1;
+}
 
-	form_t * e, * it;
+// adds wt * log(P / (P - (-D/P))) to E[f] for D = D_first + f * m. Along the
+// progression (-D/P) has period P, so its terms are computed once and then
+// added a period at a time, a loop the compiler vectorises.
+static void hlb_add(double * restrict E, double * restrict period, const long D_first, const int m, const long count, const long P, const double wt)
+{
+	const long len = MIN(P, count);
+	const long step = m % P;
+	const double v_minus = wt * log(((double) P) / (P + 1));
+	const double v_plus = wt * log(((double) P) / (P - 1));
+	long j, f, n, rem = D_first % P;
 
-	form_t ne;
-	s64_qform_set_id(&group, &ne.form);
-	vec_init(&ne.value);
-	vec_push_back(&ne.value, 0);
-	htab_insert(R, &ne);
-	vec_init(&ne.value);
-	vec_push_back(&ne.value, 0);
-	htab_insert(Q, &ne);
+	for (j = 0; j < len; j++)
+	{
+		// the residue of -D is P - rem
+		period[j] = (rem == 0) ? 0.0 : ((sqrtmodp[P][P - rem] > 0) ? v_plus : v_minus);
+		rem += step;
+		rem -= (rem >= P) ? P : 0;
+	}
 
-	int omega = 2, h = 1, det = 1, s, y, u = 0, i, j = 0, k, prime_index = -1, rank = 0, q, n, t;
-	size_t R_size, R_prev_size, Q_size, cur_index;
+	for (f = 0; f < count; f += len)
+	{
+		n = MIN(len, count - f);
 
-	s64_qform_t g, g_inv, a, b, c, temp;
+		for (j = 0; j < n; j++)
+		{
+			E[f + j] += period[j];
+		}
+	}
+}
 
-	char is_break;
+// the same products as h_lower_bound, taken in the same order for each D
+static void hlb_range(int * h_star, double * E, double * period, const long D_first, const int m, const long count, const long r)
+{
+	const long Q = Q_table[r];
+	const long Q2 = Q << 1;
+	const double C = C_table[r];
+	long P, prime_index, f, i;
+	double wt, h;
 
+	for (f = 0; f < count; f++)
+	{
+		E[f] = 0.0;
+	}
 
-  // fprintf(stderr, "starting loop h=%d < h_star=%d\n", h, h_star);
-  // fflush(stderr);
+	prime_index = 0;
+	P = prime_list[prime_index];
 
-	while (h < h_star)
-	{
-#ifdef DEBUG
-printf("\n\n\nNEW ITERATION: j=%d\n", j);
-printf("INITIAL b:\n");
-for (int p = 0; p <= j; p++)
-{
-	printf("b_vec[%d]=", p);
-	for (int l = 0; l <= p; l++)
+	while (P < Q)
 	{
-		printf(" %d", M[p][l]);
+		hlb_add(E, period, D_first, m, count, P, 1.0);
+		P = prime_list[++prime_index];
 	}
-	printf("\n");
-}
-#endif
 
-	 //  fprintf(stderr, "iteration: h=%d, j=%d\n", h, j);
-		// fprintf(stderr, "\tINITIAL b:\n");
-		// for (int p = 0; p <= j; p++)
-		// {
-		// 	fprintf(stderr, "\tb_vec[%d]=", p);
-		// 	for (int l = 0; l <= p; l++)
-		// 	{
-		// 		fprintf(stderr, "\t %d", M[p][l]);
-		// 	}
-		// 	fprintf(stderr, "\t\n");
-		// }
-	 //  fprintf(stderr, "start\n");
-	 //  fflush(stderr);
-
-		Q_size = htab_size(Q);
-		R_prev_size = htab_size(R);
-		cur_index = R_prev_size;
-
-		// initializations
-		prime_index = next(&gp, &ne, init_pow, prime_index, ell);
-		s64_qform_set(&group, &g, &ne.form);
-
-#ifdef DEBUG
-printf("g[%d]=", j);
-s64_qform_print(&group, &g);
-printf(", <- prime_index=%d\n", prime_index);
-#endif
+	wt = 1.0;
+	for (i = Q; i <= P; i++)
+	{
+		wt -= i * log(i) / C;
+	}
 
-	  // fprintf(stderr, "\tg[%d]=Qfb(%"PRId32", %"PRId32", %"PRId64"), <- prime_index=%d\n", j, g.a, g.b, g.c, prime_index);
-	  // fflush(stderr);
+	while (P < Q2)
+	{
+		hlb_add(E, period, D_first, m, count, P, wt);
+		P = prime_list[++prime_index];
+		wt -= ((P - 1) * log(P - 1) + P * log(P)) / C;
+	}
 
-		s = 1;
-		y = omega;
-		u = omega;
-		s64_qform_set(&group, &g_inv, &g);
-		s64_qform_inverse(&group, &g_inv);
-		s64_qform_set_id(&group, &a);
-		qform_pow_u32(&gp, &b, &g, omega);
-		s64_qform_set(&group, &c, &b);
+	for (f = 0; f < count; f++)
+	{
+		const long D_abs = D_first + f * m;
 
-		is_break = 0;
+		h = (exp(E[f]) * sqrt(D_abs)) / (M_SQRT2 * M_PI);
 
-		// check if current generator is contained in current subgroup
-		if (j > 0)
+		if ((D_abs & 7) == 3)
 		{
-#ifdef DEBUG
-printf("\n\nContained in current subgroup?\n");
-#endif
-		  // fprintf(stderr, "\tContained in current subgroup?\n");
-		  // fflush(stderr);
-
-			for (i = 0; i < Q_size; i++)
-			{
-				is_break = 0;
-				it = (form_t *) htab_get(Q, i);
-				
-				s64_qform_compose(&group, &temp, &it->form, &g);
-				e = (form_t *) htab_find(R, &temp);
-
-				if (e != NULL)
-				{
-					n = MIN(MIN(e->value.size, it->value.size), j);
-					for (k = 0; k < n; k++)
-					{
-						if (it->value.v[k] + e->value.v[k] >= M[k][k])
-						{
-							is_break = 1;
-							break;
-						}
-					}
-
-					if (!is_break)
-					{
-#ifdef DEBUG
-printf("Yes! ");
-s64_qform_print(&group, &e->form);
-printf("\n");
-#endif
-					  // fprintf(stderr, "\tYes! Qfb(%"PRId32", %"PRId32", %"PRId64")\n", e->form.a, e->form.b, e->form.c);
-					  // fflush(stderr);
-
-						M[j][j] = 1;
-						break;
-					}
-				}
-			}
+			h /= 3.0;
 		}
 
-		while (M[j][j] == 0)
-		{
-#ifdef DEBUG
-printf("\nBaby steps, s=%d, u=%d\n", s, u);
-#endif
-		  // fprintf(stderr, "\tBaby steps, s=%d, u=%d\n", s, u);
-		  // fflush(stderr);
-			// compute new baby steps
-			for (i = s; i <= u; i++)
-			{
-				// Robust calculation using binary exponentiation to avoid drift
-				qform_pow_s32(&gp, &a, &g, -i);
+		h_star[f] = (int) h;
 
-				if (a.a == 1)
-				{
-					M[j][j] = i;
-					break;
-				}
+		if (h_star[f] < 5)
+		{
+			h_star[f]++;
+		}
+	}
+}
 
-				if (s == 1 && i > 1)
-				{
-					for (t = 0; t < R_prev_size; t++)
-					{
-						it = (form_t *) htab_get(R, t);
-				
-#ifdef DEBUG
-printf("From hash table we got form ");
-s64_qform_print(&group, &it->form);
-printf("\n");
-#endif
-						is_break = 0;
-						s64_qform_compose(&group, &temp, &it->form, &a);
-						e = (form_t *) htab_find(Q, &temp);
-
-						if (e != NULL)
-						{
-							n = MIN(MIN(e->value.size, it->value.size), j);
-							for (k = 0; k < n; k++)
-							{
-								if (it->value.v[k] + e->value.v[k] >= M[k][k])
-								{
-									is_break = 1;
-									break;
-								}
-							}
-
-							if (!is_break)
-							{
-#ifdef DEBUG
-printf("s=%d, i=%d, Found ", s, i);
-s64_qform_print(&group, &e->form);
-printf(" = ");
-s64_qform_print(&group, &it->form);
-printf(" * ");
-s64_qform_print(&group, &a);
-printf("\n");
-#endif
-								vec_add(M[j], &it->value, &e->value); 
-								M[j][j] = i;
-								
-#ifdef DEBUG
-printf("b_vec[%d]=", j);
-for (int l = 0; l <= j; l++)
+static long hlb_decade(const long D_abs)
 {
-printf(" %d", M[j][l]);
+	return ((long) (log10(D_abs)) / 5);
 }
-printf("\n");
-#endif
-								goto giant_steps;
-							}
-						}
-						else
-						{
-							is_break = 1;
-						}
-
-						if (is_break)
-						{
-							s64_qform_set(&group,&ne.form, &temp);
-							vec_init(&ne.value);
-							vec_copy(&ne.value, &it->value);
-							vec_set(&ne.value, i, j);
-							htab_insert(R, &ne);
-							cur_index++;
-
-#ifdef DEBUG
-printf("s=%d, i=%d, Adding ", s, i);
-s64_qform_print(&group, &temp);
-printf(" <->");
-for (int l = 0; l <= j; l++)
-{
-printf(" %d", ne.value.v[l]);
-}
-printf(" to R\n");
-#endif
-						}
-					}
-				}
-				else
-				{
-					for (t = 0; t < R_prev_size; t++)
-					{
-						it = (form_t *) htab_get(R, t);
-				
-#ifdef DEBUG
-printf("t=%d, R_prev_size=%lu, From hash table we got form ", t, R_prev_size);
-s64_qform_print(&group, &it->form);
-printf("\n");
-#endif
-						s64_qform_compose(&group, &ne.form, &it->form, &a);
-						vec_init(&ne.value);
-						vec_copy(&ne.value, &it->value);
-						vec_set(&ne.value, i, j);
 
-#ifdef DEBUG
-printf("s=%d, i=%d, Adding ", s, i);
-s64_qform_print(&group, &ne.form);
-printf(" <->");
-for (int l = 0; l <= j; l++)
+void h_lower_bound_block(int * h_star, const long D_first, const int m, const long count)
 {
-printf(" %d", ne.value.v[l]);
-}
-printf(" to R\n");
-#endif
+	double * E = (double *) malloc(count * sizeof(double));
+	double * period = (double *) malloc((Q_table[hlb_decade(D_first + (count - 1) * m)] << 1) * sizeof(double));
+	long start, end, mid, lo, r;
 
-						htab_insert(R, &ne);
-						cur_index++;
-					}
-				}
-			}
+	// Q and C change with the decade of D, at 10^5, 10^10 and 10^15
+	for (start = 0; start < count; start = end)
+	{
+		r = hlb_decade(D_first + start * m);
 
-			// compute giant steps
-			giant_steps:
-#ifdef DEBUG
-printf("\nGiant steps\n");
-#endif
-		  // fprintf(stderr, "\tGiant steps\n");
-		  // fflush(stderr);
+		// the first row past the decade, by bisection
+		for (lo = start, end = count; end - lo > 1; )
+		{
+			mid = (lo + end) >> 1;
 
-			while (M[j][j] == 0 && y < u * u)
+			if (hlb_decade(D_first + mid * m) == r)
 			{
-#ifdef DEBUG
-printf("y=%d, u=%d, b = ", y, u);
-s64_qform_print(&group, &b);
-printf("\n");
-#endif
-			  // fprintf(stderr, "\ty=%d, u=%d, b = Qfb(%"PRId32", %"PRId32", %"PRId64")\n", y, u, b.a, b.b, b.c);
-			  // fflush(stderr);
-
-				for (t = 0; t < Q_size; t++)
-				{
-					it = htab_get(Q, t);
-					is_break = 0;
-					s64_qform_compose(&group, &temp, &it->form, &b);
-
-#ifdef DEBUG
-printf("Looking for ");
-s64_qform_print(&group, &temp);
-printf(" = ");
-s64_qform_print(&group, &it->form);
-printf(" * ");
-s64_qform_print(&group, &b);
-printf("\n");
-#endif					
-				  // fprintf(stderr, "\tLooking for Qfb(%"PRId32", %"PRId32", %"PRId64") = Qfb(%"PRId32", %"PRId32", %"PRId64") * Qfb(%"PRId32", %"PRId32", %"PRId64")\n", temp.a, temp.b, temp.c, it->form.a, it->form.b, it->form.c, b.a, b.b, b.c);
-				  // fflush(stderr);
-
-					e = htab_find(R, &temp);
-
-					if (e != NULL)
-					{
-						n = MIN(MIN(it->value.size, e->value.size), j);
-						for (k = 0; k < n; k++)
-						{
-							if (it->value.v[k] + e->value.v[k] >= M[k][k])
-							{
-								is_break = 1;
-								break;
-							}
-						}
-
-						if (!is_break)
-						{
-							vec_add(M[j], &it->value, &e->value);
-							M[j][j] += y;
-
-							if (M[j][j] == 0)
-							{
-								printf("b_vec is zero!\n");
-								continue;
-							}
-
-#ifdef DEBUG
-printf("Found ");
-s64_qform_print(&group, &e->form);
-printf(" = ");
-s64_qform_print(&group, &it->form);
-printf(" * ");
-s64_qform_print(&group, &b);
-printf("\nb_vec[%d]=", j);
-for (int l = 0; l <= j; l++)
-{
-	printf(" %d", M[j][l]);
-}
-printf("\n");
-#endif
-							goto double_step;
-						}
-					}
-				}
-
-				y += u;
-				s64_qform_compose(&group, &b, &b, &c);
+				lo = mid;
+			}
+			else
+			{
+				end = mid;
 			}
-
-			// double step width
-			double_step:
-#ifdef DEBUG
-printf("Doubling step width...\n");
-#endif
-		  // fprintf(stderr, "\tDoubling step width...\n");
-		  // fflush(stderr);
-			s = u + 1;
-			u *= 2;
-			s64_qform_square(&group, &c, &c);
 		}
 
-		if (M[j][j] > 1)
-		{
-
-#ifdef DEBUG
-printf("RESULT:\n");
-for (int p = 0; p <= j; p++)
-{
-	printf("b_vec[%d]=", p);
-	for (int l = 0; l <= p; l++)
-	{
-		printf(" %d", M[p][l]);
+		hlb_range(h_star + start, E, period, D_first + start * m, m, end - start, r);
 	}
-	printf("\n");
-}
-#endif
-
-			// fprintf(stderr, "\tRESULT:\n");
-			// for (int p = 0; p <= j; p++)
-			// {
-			// 	fprintf(stderr, "\t\tb_vec[%d]=", p);
-			// 	for (int l = 0; l <= p; l++)
-			// 	{
-			// 		fprintf(stderr, "\t\t %d", M[p][l]);
-			// 	}
-			// 	fprintf(stderr, "\t\t\n");
-			// }
-		 //  fflush(stderr);
-
-			h *= M[j][j];
-
-			if (h < h_star)
-			{
-				// update R and Q
-				q = (int) ceil(sqrt(M[j][j]));
-				det *= q;
-				R_size = htab_size(R);
-
-#ifdef DEBUG
-printf("\n\nUpdating R and Q\nq=%d, det=%d, R_size=%lu\n", q, det, R_size);
-#endif
-				// fprintf(stderr, "\tUpdating R and Q: q=%d, det=%d, R_size=%lu\n", q, det, R_size);
-			 //  fflush(stderr);
 
+	free(E);
+	free(period);
+}
 
-				for (t = R_size - 1; t >= det; t--)
-				{
-#ifdef DEBUG
-form_t * foo = (form_t *) htab_get(R, t);
-printf("Removing ");
-s64_qform_print(&group, &foo->form);
-printf(" <-> ");
-vec_print(&foo->value);
-printf("\n");
-#endif
-					// form_t * foo = (form_t *) htab_get(R, t);
-				 //  fprintf(stderr, "Removing Qfb(%"PRId32", %"PRId32", %"PRId64") <-> ", foo->form.a, foo->form.b, foo->form.c);
-					// fprintf(stderr, "%d", foo->value.v[0]);
-					// for (size_t i = 1; i < foo->value.size; i++)
-					// {
-					// 	fprintf(stderr, " %d", foo->value.v[i]);
-					// }
-					// fprintf(stderr, "\n");
-				 //  fflush(stderr);
-
-					htab_delete_from(R, t);
-				}
+uint64_t split_primes(const long D)
+{
+	long P, r;
 
-			  // fprintf(stderr, "\tRemoves done.\n");
-			  // fflush(stderr);
-
-				Q_size = htab_size(Q);
-			  // fprintf(stderr, "\tQ_size done.\n");
-			  // fflush(stderr);
-			  // fprintf(stderr, "\tq=%d\n",q);
-			  // fflush(stderr);
-			  // fprintf(stderr, "\tg=Qfb(%"PRId32", %"PRId32", %"PRId64")\n",g.a, g.b, g.c);
-			  // fflush(stderr);
-				qform_pow_u32(&gp, &c, &g, q);
-			  // fprintf(stderr, "\tPow done.\n");
-			  // fflush(stderr);
-				s64_qform_set_id(&group, &b);
-			  // fprintf(stderr, "\tSet id done.\n");
-			  // fflush(stderr);
-
-				for (i = 1; (i < q) && (i * q < M[j][j]); i++)
-				{
-					s64_qform_compose(&group, &b, &b, &c);
-#ifdef DEBUG
-printf("g^%d = ", i * q);
-s64_qform_print(&group, &b);
-printf("\n");
-#endif
-				  // fprintf(stderr, "\tg^%d = Qfb(%"PRId32", %"PRId32", %"PRId64")\n", i * q, b.a, b.b, b.c);
-				  // fflush(stderr);
+	// 2 is inert when D = 5 mod 8
+	uint64_t split = ((ABS(D) & 7) != 3) ? 1 : 0;
 
-					for (t = 0; t < Q_size; t++)
-					{
-						it = (form_t *) htab_get(Q, t);
-						s64_qform_compose(&group, &ne.form, &b, &it->form);
-						vec_init(&ne.value);
-						vec_copy(&ne.value, &it->value);
-						vec_set(&ne.value, i * q, j);
-						htab_insert(Q, &ne);
-
-#ifdef DEBUG
-printf("Adding ");
-s64_qform_print(&group, &ne.form);
-printf(" = ");
-s64_qform_print(&group, &it->form);
-printf(" * g^%d <->", i * q);
-for (int l = 0; l <= j; l++)
-{
-	printf(" %d", ne.value.v[l]);
-}
-printf(" to Q\n");
-#endif
-					}			
-				}
-			}
+	for (int i = 1; i < SPLIT_PRIMES; i++)
+	{
+		P = prime_list[i];
+		r = D % P;
 
-			j++;
-		}
-		else
+		if (r == 0 || sqrtmodp[P][r + P] > 0)
 		{
-			M[j][j] = 0;
+			split |= ((uint64_t) 1) << i;
 		}
 	}
 
-	if (h > 2 * h_star)
-	{
-		printf("BUG! h > 2 * h_star, TERMINATING: D=%ld\n", D);
-		fflush(stdout);
-		exit(1);
-	}
-
-  // fprintf(stderr, "matrix complete, h=%d\n", h);
-  // fflush(stderr);
-
-	group_pow_clear(&gp);
-	s64_qform_group_clear(&group);
-
-	if (h != 1)
-	{
-		rank = j;
+	return split;
+}
 
-#ifdef DEBUG
-printf("ANSWER:\n");
-for (int i = 0; i < rank; i++)
+// as in hlb_add, the bits of P along the progression have period P
+void split_primes_block(uint64_t * split, const long D_first, const int m, const long count)
 {
-	for (int j = 0; j <= i; j++)
+	uint64_t * period = (uint64_t *) malloc(prime_list[SPLIT_PRIMES - 1] * sizeof(uint64_t));
+	long P, len, step, rem, f, j, n;
+
+	for (f = 0; f < count; f++)
 	{
-		printf("%d ", M[i][j]);
+		split[f] = (((D_first + f * m) & 7) != 3) ? 1 : 0;
 	}
-	printf("\n");
-}
-printf("Matrix before:\n");
-mat_print(M, rank);
-#endif
 
-		smith_normal_form(M, rank);
+	for (int i = 1; i < SPLIT_PRIMES; i++)
+	{
+		const uint64_t bit = ((uint64_t) 1) << i;
 
-#ifdef DEBUG
-printf("Matrix after:\n");
-mat_print(M, rank);
-#endif
+		P = prime_list[i];
+		len = MIN(P, count);
+		step = m % P;
+		rem = D_first % P;
 
-		j = 1;
+		for (j = 0; j < len; j++)
+		{
+			// the residue of -D is P - rem
+			period[j] = (rem == 0 || sqrtmodp[P][P - rem] > 0) ? bit : 0;
+			rem += step;
+			rem -= (rem >= P) ? P : 0;
+		}
 
-		for (int i = 0; i < rank; i++)
+		for (f = 0; f < count; f += len)
 		{
-			if (M[i][i] > 1)
+			n = MIN(len, count - f);
+
+			for (j = 0; j < n; j++)
 			{
-				result[j++] = M[i][i];
+				split[f + j] |= period[j];
 			}
 		}
 	}
-	else
-	{
-		result[1] = 1;
-		j = 2;
-	}
 
-	htab_empty(R);
-	htab_empty(Q);
-	
-	result[0] = h;
+	free(period);
+}
 
-	mat_clear(M, MAX_RANK);
 
-	return (j - 1);
+// STATISTICS
+
+void bjt_stats_init(bjt_stats_t * s)
+{
+	memset(s, 0, sizeof(bjt_stats_t));
+	s->budget = BJT_BUDGET;
 }
 
+void bjt_stats_add(bjt_stats_t * s, const bjt_stats_t * t)
+{
+	s->calls += t->calls;
+	s->baby += t->baby;
+	s->giant += t->giant;
+	s->compose += t->compose;
+	s->square += t->square;
+	s->pow += t->pow;
+	s->finds += t->finds;
+	s->probes += t->probes;
+	s->max_probes = MAX(s->max_probes, t->max_probes);
+	s->doublings += t->doublings;
+	s->generators += t->generators;
+	s->occupancy = MAX(s->occupancy, t->occupancy);
+	s->aborted += t->aborted;
+}
 
+void bjt_stats_add_table(bjt_stats_t * s, oatab_t * t)
+{
+	s->finds += t->finds;
+	s->probes += t->probes;
+	s->max_probes = MAX(s->max_probes, (long) t->max_probes);
 
+	t->finds = 0;
+	t->probes = 0;
+	t->max_probes = 0;
+}
 
-void tabulate_bjt(const int index, const long D_total,
-		const char * file, const char * folder,
-		const int a, const int m,
-		const int * primes, int ** h_factors,
-		int ** D_factors, int * h_list)
+void bjt_abort_log(const char * path, const long D)
 {
-	char name[500], data[200];
-	int fd;
+	char name[600];
+	FILE * log;
 
-	struct timeval begin, end;
-	unsigned long exec_time;
+	sprintf(name, "%s.aborted", path);
+	log = fopen(name, "a");
 
-	sprintf(name, "%s/cl%dmod%d/cl%dmod%d.%d.gz", folder, a, m, a, m, index);
-	if (access(name, F_OK) != -1)
+	if (log == NULL)
 	{
-		printf("The file %s exists, thus terminating.\n", name);
-		return;
+		sprintf(name, "Unable to open the file %s.aborted\n", path);
+		perror(name);
+		fflush(stderr);
+		exit(1);
 	}
 
-	if (file)
-	{
-		sprintf(name, "%s/%s%d", folder, file, index);
-
-		if (index == 0 && (a == 4 || a == 3))
-		{
-			fd = open(name, O_RDWR);
-
-			if (fd == -1)
-			{
-				sprintf(data, "Unable to open the file %s\n", name);
-				perror(data);
-				fflush(stderr);
-				exit(1);
-			}
+	fprintf(log, "%ld\n", D);
+	fclose(log);
+}
 
-			int * h_temp = (int *) mmap(0, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+void bjt_abort_reset(const char * path, const long D_from, const long D_to)
+{
+	char name[600], temp[640];
+	FILE * in, * out;
+	long D;
+	int kept = 0;
 
-			if (h_temp == MAP_FAILED)
-			{
-				sprintf(data, "Unable to map the file %s for writing\n", name);
-				perror(data);
-				fflush(stderr);
-				exit(1);
-			}
+	sprintf(name, "%s.aborted", path);
 
-			if (a == 4)
-			{
-				h_temp[0] = 2;
-			}
-			else
-			{
-				h_temp[1] = 3;
-			}
+	if ((in = fopen(name, "r")) == NULL)
+	{
+		return;
+	}
 
-			munmap(h_temp, sizeof(int));
-			close(fd);
-		}
+	sprintf(temp, "%s.tmp", name);
 
-		fd = open(name, O_RDONLY);
+	if ((out = fopen(temp, "w")) == NULL)
+	{
+		sprintf(temp, "Unable to rewrite the file %s\n", name);
+		perror(temp);
+		fflush(stderr);
+		exit(1);
+	}
 
-		if (fd == -1)
+	while (fscanf(in, "%ld", &D) == 1)
+	{
+		if (D < D_from || D >= D_to)
 		{
-			sprintf(data, "Unable to open the file %s for reading\n", name);
-			perror(data);
-			fflush(stderr);
-			exit(1);
+			fprintf(out, "%ld\n", D);
+			kept++;
 		}
 	}
-	else
-	{
-		fd = 0;
-	}
-
-	const long D_max = (index + 1) * D_total * m;
-	long D_cur = 0, f_cur = FAC_TOTAL;
-	int * D_cur_factors;
-	long D_temp;
 
-	int result[15];
+	fclose(in);
 
-	char is_discriminant = 1;
-
-	int h, dist = 0, r, rank;
-
-	// compute an upper bound on the size of the table
-	int h_max = h_upper_bound(-D_max);
-
-	int table_size = next_prime((((int) sqrt(h_max)) << 1) - 1);
-
-	if (table_size == -1)
+	if (fclose(out) != 0 || rename(temp, name) != 0)
 	{
-		perror("Not enough primes in liboptarith/primes.h\n");
+		sprintf(temp, "Unable to rewrite the file %s\n", name);
+		perror(temp);
 		fflush(stderr);
 		exit(1);
 	}
 
-	htab_t R, Q;
-	htab_init(&R, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
-	htab_init(&Q, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
-	sprintf(name, "%s/cl%dmod%d", folder, a, m);
-	mkdir(name, 0744);
-	sprintf(name, "%s/cl%dmod%d/cl%dmod%d.%d", folder, a, m, a, m, index);
-	creat(name, 0744);
-	FILE * clfd = fopen(name, "w");
-
-	if (clfd == NULL)
+	if (kept == 0)
 	{
-		sprintf(data, "Unable to open %s\n", name);
-		perror(data);
-		fflush(stderr);
-		exit(1);
+		remove(name);
 	}
+}
 
-	const long res = (((a & 3) != 3) ? a : 1);
+void bjt_stats_print(const char * label, const bjt_stats_t * s)
+{
+	printf("%s: calls=%ld, baby=%ld, giant=%ld, compose=%ld, square=%ld, pow=%ld, finds=%ld, probes=%.2f (max %ld), doublings=%ld, generators=%ld, occupancy=%ld, aborted=%ld\n",
+		label, s->calls, s->baby, s->giant, s->compose, s->square, s->pow, s->finds, (s->finds > 0) ? (double) s->probes / s->finds : 0.0,
+		s->max_probes, s->doublings, s->generators, s->occupancy, s->aborted);
+}
 
-	int init_pow = 1, h_fac, h_temp, h_fac_total;
-	const int * h_cur_factors;
 
-	gettimeofday(&begin, NULL);
-	for (long D = index * D_total * m + a; D < D_max; D += m, D_cur++, f_cur++)
-	{
-		if (f_cur == FAC_TOTAL)
-		{
-			f_cur = 0;
-			mod_sieve(FAC_TOTAL, D - a, D_factors, primes, a, m);
-			read(fd, h_list, FAC_TOTAL * sizeof(int));
-		}
+// BJT ENGINES
+// compute_group_bjt_seeded runs on s64 forms. With -DWITH_S128_QFORMS the
+// same code, clgrp_bjt.h, is also built on s128 forms for the discriminants
+// too wide for them, and compute_group_bjt_any takes the narrowest of the two.
 
-		is_discriminant = 1;
-		D_cur_factors = D_factors[f_cur];
-		D_temp = D / res;
+#define QF(x) s64_qform_##x
+#define QF_NAME(x) x
+#define QF_SET_DISCRIMINANT(group, D) s64_qform_group_set_discriminant_s64(group, D)
+#define QF_SEEDS
+#include "clgrp_bjt.h"
+#undef QF
+#undef QF_NAME
+#undef QF_SET_DISCRIMINANT
+#undef QF_SEEDS
 
-		for (int j = 1; j <= D_cur_factors[0]; j++)
-		{
-			D_temp /= D_cur_factors[j];
-			if (D_temp % D_cur_factors[j] == 0)
+#ifdef WITH_S128_QFORMS
+static void s128_qform_group_set_discriminant_long(s128_qform_group_t * group, const long D)
+{
+	mpz_t z;
+	mpz_init_set_si(z, D);
+	s128_qform_group_set_discriminant(group, z);
+	mpz_clear(z);
+}
+
+#define QF(x) s128_qform_##x
+#define QF_NAME(x) x##_s128
+#define QF_SET_DISCRIMINANT(group, D) s128_qform_group_set_discriminant_long(group, D)
+#include "clgrp_bjt.h"
+#undef QF
+#undef QF_NAME
+#undef QF_SET_DISCRIMINANT
+#endif
+
+// the bits of the widest discriminant the s64 forms hold, as libqform has it
+static int s64_qform_bits(void)
+{
+	static __thread int bits = 0;
+
+	if (bits == 0)
+	{
+		s64_qform_group_t group;
+		s64_qform_group_init(&group);
+		bits = group.desc.discriminant_max_bits;
+		s64_qform_group_clear(&group);
+	}
+
+	return bits;
+}
+
+// Ramachandran's thesis, p. 47
+int compute_group_bjt(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q)
+{
+	return compute_group_bjt_any(result, D, init_pow, h_star, ell, R, Q, NULL, NULL, NULL);
+}
+
+int compute_group_bjt_any(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q,
+				oatab_t * R_s128, oatab_t * Q_s128, bjt_stats_t * stats)
+{
+	const int bits = 64 - __builtin_clzl(ABS(D));
+
+	if (bits <= s64_qform_bits())
+	{
+		return compute_group_bjt_seeded(result, D, init_pow, h_star, ell, R, Q, NULL, stats);
+	}
+
+#ifdef WITH_S128_QFORMS
+	// R and Q hold s64 records, the s128 ones go to the tables of the caller
+	oatab_t R_call, Q_call;
+
+	if (R_s128 == NULL)
+	{
+		R_s128 = &R_call;
+		Q_s128 = &Q_call;
+		bjt_tables_s128_init(R_s128, Q_s128, R->allocated);
+	}
+
+	const int n = compute_group_bjt_seeded_s128(result, D, init_pow, h_star, ell, R_s128, Q_s128, NULL, stats);
+
+	if (stats)
+	{
+		bjt_stats_add_table(stats, R_s128);
+		bjt_stats_add_table(stats, Q_s128);
+	}
+
+	if (R_s128 == &R_call)
+	{
+		bjt_tables_s128_clear(R_s128, Q_s128);
+	}
+
+	return n;
+#else
+	char err[100];
+	sprintf(err, "D=%ld has %d bits, more than s64 forms hold, build with -DWITH_S128_QFORMS\n", D, bits);
+	perror(err);
+	fflush(stderr);
+	exit(1);
+#endif
+}
+
+void bjt_tables_s128_init(oatab_t * R_s128, oatab_t * Q_s128, const size_t size)
+{
+#ifdef WITH_S128_QFORMS
+	form_table_init_s128(R_s128, size);
+	form_table_init_s128(Q_s128, size);
+#endif
+}
+
+void bjt_tables_s128_clear(oatab_t * R_s128, oatab_t * Q_s128)
+{
+#ifdef WITH_S128_QFORMS
+	oatab_clear(R_s128);
+	oatab_clear(Q_s128);
+#endif
+}
+
+
+
+// BATCHES
+
+void bjt_batch_init(bjt_batch_t * b, const long D_max)
+{
+	int table_size = next_prime((((int) sqrt(h_upper_bound(-ABS(D_max)))) << 1) - 1);
+
+	if (table_size == -1)
+	{
+		perror("Not enough primes in liboptarith/primes.h\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	form_table_init(&b->R, table_size);
+	form_table_init(&b->Q, table_size);
+	bjt_tables_s128_init(&b->R_s128, &b->Q_s128, table_size);
+	bjt_stats_init(&b->stats);
+}
+
+void bjt_batch_clear(bjt_batch_t * b)
+{
+	oatab_clear(&b->R);
+	oatab_clear(&b->Q);
+	bjt_tables_s128_clear(&b->R_s128, &b->Q_s128);
+}
+
+bjt_batch_t * bjt_batch_new(const long D_max)
+{
+	bjt_batch_t * b = (bjt_batch_t *) malloc(sizeof(bjt_batch_t));
+	bjt_batch_init(b, D_max);
+
+	return b;
+}
+
+void bjt_batch_free(bjt_batch_t * b)
+{
+	bjt_batch_clear(b);
+	free(b);
+}
+
+long bjt_batch_compute(bjt_batch_t * b, int * rank, int * out, const long * D, const int * init_pow, const int * h_star, const int * ell,
+				const long count)
+{
+	int result[MAX_RANK + 5];
+	long i, aborted = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		rank[i] = compute_group_bjt_any(result, D[i], init_pow[i], h_star[i], ell[i], &b->R, &b->Q, &b->R_s128, &b->Q_s128, &b->stats);
+
+		if (rank[i] < 0)
+		{
+			aborted++;
+			continue;
+		}
+
+		memcpy(out + i * BJT_BATCH_ROW, result, (rank[i] + 1) * sizeof(int));
+	}
+
+	bjt_stats_add_table(&b->stats, &b->R);
+	bjt_stats_add_table(&b->stats, &b->Q);
+
+	return aborted;
+}
+
+
+
+// ORDERS OF INDEX ELL^2
+
+int ell_list_parse(ell_list_t * list, const char * s)
+{
+	char * end;
+	long ell, d;
+
+	list->count = 0;
+	list->spf = NULL;
+
+	for (;;)
+	{
+		ell = strtol(s, &end, 10);
+
+		if (end == s || ell < 2 || list->count == MAX_ELLS)
+		{
+			return 0;
+		}
+
+		// the ells are small, trial division tells the primes
+		for (d = 2; d * d <= ell; d++)
+		{
+			if (ell % d == 0)
+			{
+				return 0;
+			}
+		}
+
+		list->ell[list->count++] = ell;
+
+		if (*end == '\0')
+		{
+			return list->count;
+		}
+
+		if (*end != ',')
+		{
+			return 0;
+		}
+
+		s = end + 1;
+	}
+}
+
+int compute_group_ell(int * row, const long D, const int h, const int * inv, const int rank, const long ell, const int * spf, oatab_t * R, oatab_t * Q,
+				oatab_t * R_s128, oatab_t * Q_s128, bjt_stats_t * stats)
+{
+	const char kron = kronecker_symbol(-D, ell);
+	long D_sub = D * ell * ell;
+	int result[15], h_sub, k, init_pow = 1, h_star, cyclic = 1, h_rem, p, q, c, n, r, i;
+
+	row[0] = kron;
+
+	if (kron == 1)
+	{
+		row[1] = 1;
+		row[2] = 0;
+		return 1;
+	}
+
+	if (kron == 0)
+	{
+		// ramified
+		h_sub = h * ell;
+	}
+	else
+	{
+		// inert
+		h_sub = h * (ell + 1) * ell;
+		D_sub *= ell * ell;
+	}
+
+	if (D == 4)
+	{
+		h_sub /= 2;
+	}
+	else if (D == 3)
+	{
+		h_sub /= 3;
+	}
+
+	// order of the kernel of Cl(O) -> Cl(O_K)
+	k = h_sub / h;
+
+	// For p not dividing k the p-part of Cl(O) is the p-part of Cl(O_K), and
+	// a p-part of order p is cyclic. Raising to their orders leaves the
+	// p-parts the kernel contributes to, the only ones to be searched for.
+	h_star = h_sub;
+	h_rem = h_sub;
+
+	while (h_rem > 1)
+	{
+		p = spf[h_rem];
+		q = 1;
+
+		do
+		{
+			h_rem /= p;
+			q *= p;
+		} while (h_rem % p == 0);
+
+		if (k % p != 0 || q == p)
+		{
+			init_pow *= q;
+			h_star /= q;
+
+			if (k % p == 0)
+			{
+				cyclic *= p;
+			}
+		}
+	}
+
+	n = compute_group_bjt_any(result, -D_sub, init_pow, h_star, ell, R, Q, R_s128, Q_s128, stats);
+
+	if (n < 0)
+	{
+		row[1] = -1;
+		return -1;
+	}
+
+	// the invariant factors of Cl(O_K) prime to k times those just computed
+	r = MAX(rank, n);
+
+	for (i = 0; i < r; i++)
+	{
+		c = (i < rank) ? inv[i] : 1;
+
+		for (h_rem = k; h_rem > 1; h_rem /= p)
+		{
+			p = spf[h_rem];
+
+			while (c % p == 0)
+			{
+				c /= p;
+			}
+		}
+
+		row[i + 2] = c * ((i < n) ? result[i + 1] : 1);
+	}
+
+	row[2] *= cyclic;
+
+	while (r > 1 && row[r + 1] == 1)
+	{
+		r--;
+	}
+
+	#ifdef WITH_PARI
+	pari_verify(row + 2, -D_sub);
+	#endif
+
+	row[1] = r;
+
+	return r;
+}
+
+
+// THREADED TABULATION
+// A sieve block is tabulated in rounds of TAB_ROUND discriminants. The threads
+// of a rank pull chunks of TAB_CHUNK discriminants of the round and store the
+// results in rows. The primes, the factorisations and the class numbers are
+// shared and read only during a round. The threads are started once per file
+// and wait at the start barrier for each round, the main thread runs worker 0
+// and meets them at the done barrier before it writes the round out, so that
+// every MPI call stays on the main thread.
+//
+// The order search of the first generator is a chain of dependent
+// compositions, so a single discriminant leaves the core waiting on the
+// partial GCD of each of them. A thread therefore runs TAB_LANES discriminants
+// in lockstep: on every tick each lane takes one baby step or one giant step,
+// so that the compositions issued back to back are independent. In this first
+// pass Q only holds the identity and R the baby steps, hence no exponent
+// vector has to be checked. Once a lane knows the order it finishes its
+// discriminant with compute_group_bjt_seeded and is refilled from the chunk.
+// A lane that takes more than budget steps abandons its discriminant.
+// In fused mode the lane also computes the orders of index ell^2 of its
+// discriminant right away, and stores them in the ell rows of the round.
+
+// a row holds the rank, h and the invariant factors, rank 0 if D is not
+// fundamental and -1 if it was abandoned
+#define TAB_ROW (MAX_RANK + 2)
+#define TAB_CHUNK 64
+
+#ifndef TAB_LANES
+#define TAB_LANES 8
+#endif
+
+typedef struct
+{
+	long D_first;						// discriminant of the first row
+	long f_first;						// index of the first row in the sieve block
+	long total;							// number of rows in the round
+	long next;							// first row of the next chunk
+
+	const char * file;
+	int a, m;
+	long res;
+	const factors_t * h_factors;
+	const factors_t * D_factors;
+	int * h_list;
+	const int * h_bound;				// h_lower_bound of the sieve block, without class numbers
+	const uint64_t * split;				// split_primes of the sieve block
+	int * rows;
+
+	const ell_list_t * ells;			// NULL unless fused
+	int * ell_rows;						// ells->count rows per row
+
+	pthread_barrier_t start, done;		// of all the threads, around each round
+	int stop;							// set before the last start, once the file is done
+} tab_round_t;
+
+typedef struct
+{
+	long f;								// row of the round, -1 if the lane is idle
+	int init_pow, h_star, prime_index;
+	int s, u, y, i;						// baby steps s..u, giant step y
+	char giant;
+	long steps;							// steps taken on this discriminant
+
+	s64_qform_group_t group;
+	group_pow_t gp;
+	s64_qform_t g, a, b, c, temp;
+	oatab_t R, Q;
+} tab_lane_t;
+
+typedef struct
+{
+	tab_round_t * round;
+	long f, f_end;						// rows of the chunk left to start
+	tab_lane_t lanes[TAB_LANES];
+	oatab_t R_s128, Q_s128;				// for the orders too wide for s64 forms
+	bjt_stats_t stats;
+	pthread_t thread;
+} tab_worker_t;
+
+// returns 0 and marks the row if D is not fundamental, otherwise the target
+// for compute_group_bjt in h and the known part of h in init_pow
+static int tab_prepare(const tab_round_t * round, const long f, int * init_pow, int * h)
+{
+	const long D = round->D_first + f * round->m;
+	const int * D_cur_factors = factors_row(round->D_factors, round->f_first + f);
+	long D_temp = D / round->res;
+	int h_fac, h_temp, h_fac_total;
+	const int * h_cur_factors;
+
+	for (int j = 1; j <= D_cur_factors[0]; j++)
+	{
+		D_temp /= D_cur_factors[j];
+		if (D_temp % D_cur_factors[j] == 0)
+		{
+			round->rows[f * TAB_ROW] = 0;
+			return 0;
+		}
+	}
+
+	*init_pow = 1;
+
+	if (round->file)
+	{
+		*h = round->h_list[round->f_first + f];
+
+		if (round->a == 4)
+		{
+			*h /= 2;
+		}
+		else if (round->a == 3)
+		{
+			*h /= 3;
+		}
+
+		h_cur_factors = factors_row(round->h_factors, *h);
+		h_fac_total = h_cur_factors[0];
+		h_temp = *h;
+
+		for (int i = 1; i <= h_fac_total; i++)
+		{
+			h_fac = h_cur_factors[i];
+			h_temp /= h_fac;
+			if (h_temp % h_fac != 0)
+			{
+				*init_pow *= h_fac;
+			}
+		}
+
+		*h /= *init_pow;
+	}
+	else
+	{
+		*h = round->h_bound[round->f_first + f];
+	}
+
+	return 1;
+}
+
+static void tab_store(const tab_round_t * round, const long f, int * result, const int rank, const int init_pow)
+{
+	int * row = round->rows + f * TAB_ROW;
+
+	row[0] = rank;
+
+	if (rank < 0)
+	{
+		return;
+	}
+
+	row[1] = result[0] * init_pow;
+	result[1] *= init_pow;
+	memcpy(row + 2, result + 1, rank * sizeof(int));
+}
+
+static void tab_ell(const tab_round_t * round, const long f, oatab_t * R, oatab_t * Q, tab_worker_t * w)
+{
+	const long D = round->D_first + f * round->m;
+	const int * row = round->rows + f * TAB_ROW;
+
+	for (int e = 0; e < round->ells->count; e++)
+	{
+		compute_group_ell(round->ell_rows + (f * round->ells->count + e) * TAB_ROW, D, row[1], row + 2, row[0], round->ells->ell[e], round->ells->spf, R, Q, &w->R_s128, &w->Q_s128, &w->stats);
+	}
+}
+
+// starts the first pass of compute_group_bjt on the next discriminant that
+// needs one, returns 0 once the round is exhausted
+static int tab_lane_start(tab_worker_t * w, tab_lane_t * l)
+{
+	tab_round_t * round = w->round;
+	int result[15], rank;
+	long f;
+	form_t ne;
+
+	for (;;)
+	{
+		if (w->f == w->f_end)
+		{
+			w->f = __sync_fetch_and_add(&round->next, TAB_CHUNK);
+
+			if (w->f >= round->total)
+			{
+				w->f_end = w->f;
+				l->f = -1;
+				return 0;
+			}
+
+			w->f_end = MIN(w->f + TAB_CHUNK, round->total);
+		}
+
+		f = w->f++;
+
+		if (!tab_prepare(round, f, &l->init_pow, &l->h_star))
+		{
+			continue;
+		}
+
+		// nothing to search for
+		if (l->h_star <= 1)
+		{
+			rank = compute_group_bjt_seeded(result, -(round->D_first + f * round->m), l->init_pow, l->h_star, 0, &l->R, &l->Q, NULL, &w->stats);
+			tab_store(round, f, result, rank, l->init_pow);
+
+			if (round->ells && rank >= 0)
+			{
+				tab_ell(round, f, &l->R, &l->Q, w);
+			}
+			continue;
+		}
+
+#ifdef WITH_GENUS_SEED
+		// the search starts from the 2-subgroup of the ramified primes
+		const int * ramified = factors_row(round->D_factors, round->f_first + f);
+
+		if ((l->init_pow & 1) && ramified[0] > 0)
+		{
+			bjt_seed_t seed;
+			seed.order = 0;
+			seed.split = round->split[round->f_first + f];
+			seed.ramified = ramified;
+
+			rank = compute_group_bjt_seeded(result, -(round->D_first + f * round->m), l->init_pow, l->h_star, 0, &l->R, &l->Q, &seed, &w->stats);
+			tab_store(round, f, result, rank, l->init_pow);
+
+			if (round->ells && rank >= 0)
+			{
+				tab_ell(round, f, &l->R, &l->Q, w);
+			}
+			continue;
+		}
+#endif
+
+		break;
+	}
+
+	l->f = f;
+
+	s64_qform_group_init(&l->group);
+	s64_qform_group_set_discriminant_s64(&l->group, -(round->D_first + f * round->m));
+	group_pow_init(&l->gp, &l->group.desc.group);
+
+	s64_qform_set_id(&l->group, &ne.form);
+	ne.value.v[0] = 0;
+	ne.value.size = 1;
+	form_table_insert(&l->R, &ne);
+	form_table_insert(&l->Q, &ne);
+
+	l->prime_index = next(&l->gp, &ne, l->init_pow, -1, 0, round->split[round->f_first + f]);
+	s64_qform_set(&l->group, &l->g, &ne.form);
+	w->stats.generators++;
+	w->stats.pow++;
+
+	l->s = 1;
+	l->y = 2;
+	l->u = 2;
+	l->i = 1;
+	l->giant = 0;
+	l->steps = 0;
+	qform_pow_u32(&l->gp, &l->b, &l->g, l->u);
+	s64_qform_set(&l->group, &l->c, &l->b);
+	w->stats.pow++;
+
+	return 1;
+}
+
+// takes one baby step or one giant step, returns the order of g once known
+static int tab_lane_step(tab_lane_t * l, bjt_stats_t * stats)
+{
+	long e_idx;
+	form_t ne;
+
+	if (!l->giant)
+	{
+		qform_pow_s32(&l->gp, &l->a, &l->g, -l->i);
+		stats->pow++;
+		stats->baby++;
+
+		if (l->a.a == 1)
+		{
+			return l->i;
+		}
+
+		s64_qform_compose(&l->group, &ne.form, form_table_form(&l->R, 0), &l->a);
+		stats->compose++;
+
+		if (l->s == 1 && l->i > 1 && oatab_find_index(&l->Q, &ne.form) >= 0)
+		{
+			return l->i;
+		}
+
+		ne.value = *form_table_value(&l->R, 0);
+		evec_set(&ne.value, l->i, 0);
+		form_table_insert(&l->R, &ne);
+
+		l->giant = (++l->i > l->u);
+		return 0;
+	}
+
+	// double step width
+	if (l->y >= l->u * l->u)
+	{
+		l->s = l->u + 1;
+		l->u *= 2;
+		s64_qform_square(&l->group, &l->c, &l->c);
+		stats->square++;
+		stats->doublings++;
+		l->i = l->s;
+		l->giant = 0;
+		return 0;
+	}
+
+	s64_qform_compose(&l->group, &l->temp, form_table_form(&l->Q, 0), &l->b);
+	e_idx = oatab_find_index(&l->R, &l->temp);
+	stats->compose++;
+	stats->giant++;
+
+	// y is positive, so is the order
+	if (e_idx >= 0)
+	{
+		return form_table_value(&l->R, e_idx)->v[0] + form_table_value(&l->Q, 0)->v[0] + l->y;
+	}
+
+	l->y += l->u;
+	s64_qform_compose(&l->group, &l->b, &l->b, &l->c);
+	stats->compose++;
+	return 0;
+}
+
+static void tab_lane_finish(tab_worker_t * w, tab_lane_t * l, const int order)
+{
+	const tab_round_t * round = w->round;
+	int result[15], rank;
+	bjt_seed_t seed;
+
+	s64_qform_set(&l->group, &seed.g, &l->g);
+	seed.prime_index = l->prime_index;
+	seed.order = order;
+	seed.split = round->split[round->f_first + l->f];
+	seed.ramified = NULL;
+
+	group_pow_clear(&l->gp);
+	s64_qform_group_clear(&l->group);
+
+	rank = compute_group_bjt_seeded(result, -(round->D_first + l->f * round->m), l->init_pow, l->h_star, 0, &l->R, &l->Q, &seed, &w->stats);
+	tab_store(round, l->f, result, rank, l->init_pow);
+
+	if (round->ells && rank >= 0)
+	{
+		tab_ell(round, l->f, &l->R, &l->Q, w);
+	}
+}
+
+// abandons the discriminant of a lane that ran out of budget
+static void tab_lane_abort(tab_worker_t * w, tab_lane_t * l)
+{
+	w->round->rows[l->f * TAB_ROW] = -1;
+
+	group_pow_clear(&l->gp);
+	s64_qform_group_clear(&l->group);
+
+	oatab_empty(&l->R);
+	oatab_empty(&l->Q);
+
+	w->stats.calls++;
+	w->stats.aborted++;
+}
+
+static void * tab_worker(void * arg)
+{
+	tab_worker_t * w = (tab_worker_t *) arg;
+	tab_lane_t * l;
+	int k, order, active = 0;
+
+	w->f = w->f_end = 0;
+
+	for (k = 0; k < TAB_LANES; k++)
+	{
+		active += tab_lane_start(w, w->lanes + k);
+	}
+
+	while (active > 0)
+	{
+		for (k = 0; k < TAB_LANES; k++)
+		{
+			l = w->lanes + k;
+
+			if (l->f < 0)
+			{
+				continue;
+			}
+
+			if ((order = tab_lane_step(l, &w->stats)) > 0)
+			{
+				tab_lane_finish(w, l, order);
+			}
+			else if (++l->steps > w->stats.budget)
+			{
+				tab_lane_abort(w, l);
+			}
+			else
+			{
+				continue;
+			}
+
+			active -= !tab_lane_start(w, l);
+		}
+	}
+
+	return NULL;
+}
+
+// the threads other than the main one, for the rounds of a file
+static void * tab_pool(void * arg)
+{
+	tab_worker_t * w = (tab_worker_t *) arg;
+
+	for (;;)
+	{
+		pthread_barrier_wait(&w->round->start);
+
+		if (w->round->stop)
+		{
+			break;
+		}
+
+		tab_worker(w);
+		pthread_barrier_wait(&w->round->done);
+	}
+
+	return NULL;
+}
+
+// SIEVE BLOCKS
+// While the rounds of sieve block k run, a producer thread prepares block
+// k + 1 in a second buffer: the factorisations of its discriminants, their
+// class numbers from the file or their h_lower_bound, and their split primes.
+// The loop only waits for it at the end of block k, so the sieve and the read
+// leave the critical path unless the producer takes longer than the block.
+// The producer shares the cores of the tabulation threads, what it saves is
+// the time they would otherwise sit idle, the blocking read in particular.
+// With -DTAB_PREFETCH=0 each block is prepared in line as before. A block
+// holds FAC_TOTAL discriminants unless tab_block_set says otherwise.
+
+#ifndef TAB_PREFETCH
+#define TAB_PREFETCH 1
+#endif
+
+typedef struct
+{
+	long D_block;						// discriminant of the first row
+	long total;							// number of rows
+	factors_t D_factors;
+	int * h_list;						// class numbers, with file
+	int * h_bound;						// h_lower_bound, without
+	uint64_t * split;
+
+	long D_max;
+	int fd, a, m;
+	const int * primes;
+	pthread_t thread;
+} tab_block_t;
+
+static long tab_block_total = FAC_TOTAL;
+
+void tab_block_set(const long total)
+{
+	tab_block_total = total;
+}
+
+long tab_block_size()
+{
+	return tab_block_total;
+}
+
+static void * tab_block_fill(void * arg)
+{
+	tab_block_t * b = (tab_block_t *) arg;
+
+	mod_sieve(tab_block_total, b->D_block - b->a, &b->D_factors, b->primes, b->a, b->m);
+
+	b->total = MIN(tab_block_total, (b->D_max - b->D_block + b->m - 1) / b->m);
+
+	if (b->h_list)
+	{
+		// the class numbers of the block, read may return fewer bytes than asked
+		char * h_bytes = (char *) b->h_list;
+		size_t done = 0;
+		ssize_t n;
+
+		while (done < b->total * sizeof(int))
+		{
+			n = read(b->fd, h_bytes + done, b->total * sizeof(int) - done);
+
+			if (n <= 0)
+			{
+				char data[100];
+				sprintf(data, "Unable to read the class numbers from D=%ld\n", b->D_block);
+				perror(data);
+				fflush(stderr);
+				exit(1);
+			}
+
+			done += n;
+		}
+	}
+	else
+	{
+		h_lower_bound_block(b->h_bound, b->D_block, b->m, b->total);
+	}
+
+	split_primes_block(b->split, b->D_block, b->m, b->total);
+
+	return NULL;
+}
+
+static void tab_block_start(tab_block_t * b)
+{
+	#if TAB_PREFETCH
+	if (pthread_create(&b->thread, NULL, &tab_block_fill, b) != 0)
+	{
+		perror("Unable to start the sieve thread\n");
+		fflush(stderr);
+		exit(1);
+	}
+	#else
+	tab_block_fill(b);
+	#endif
+}
+
+static void tab_block_wait(tab_block_t * b)
+{
+	#if TAB_PREFETCH
+	pthread_join(b->thread, NULL);
+	#endif
+}
+
+size_t tab_memory(const long D_max, const int stride, const int threads, const int ell_count)
+{
+	const int table_size = next_prime((((int) sqrt(h_upper_bound(-D_max))) << 1) - 1);
+
+	#ifdef WITH_SOA_FORMS
+	const size_t table = oatab_memory(table_size, sizeof(s64_qform_t), sizeof(evec_t));
+	#else
+	const size_t table = oatab_memory(table_size, sizeof(form_t), 0);
+	#endif
+
+	// the s128 tables of the workers
+	#if defined(WITH_S128_QFORMS) && defined(WITH_SOA_FORMS)
+	const size_t table_s128 = oatab_memory(table_size, sizeof(s128_qform_t), sizeof(evec_t));
+	#elif defined(WITH_S128_QFORMS)
+	const size_t table_s128 = oatab_memory(table_size, sizeof(form_t_s128), 0);
+	#else
+	const size_t table_s128 = 0;
+	#endif
+
+	// two blocks of factors, class numbers or their lower bounds and split primes
+	size_t total = 2 * tab_block_total * (stride * sizeof(int) + sizeof(int) + sizeof(uint64_t));
+
+	total += (size_t) TAB_ROUND * (1 + ell_count) * TAB_ROW * sizeof(int);
+	total += threads * (sizeof(tab_worker_t) + 2 * TAB_LANES * table + 2 * table_s128);
+
+	return total;
+}
+
+
+// TABULATION OF A FILE
+// File index holds the discriminants index * D_total * m + a + f * m for
+// 0 <= f < D_total. Large files may be tabulated in parts of PART_TOTAL
+// discriminants, each written to its own file, and are stitched back into
+// the file by stitch_bjt. Within a part dist starts over from its first row.
+
+#ifdef WITH_BINARY_OUTPUT
+#define TAB_EXT "clb"
+#else
+#define TAB_EXT "gz"
+#endif
+
+#ifdef WITH_CONTAINER_OUTPUT
+#ifdef WITH_BINARY_OUTPUT
+#error "The containers hold text files, WITH_CONTAINER_OUTPUT excludes WITH_BINARY_OUTPUT"
+#endif
+
+// the containers of the class and of its ells, see clc.h
+static clcout_t * tab_out = NULL;
+
+void tabulate_bjt_containers(clcout_t * out)
+{
+	tab_out = out;
+}
+#endif
+
+static tab_progress_fn tab_progress_hook = NULL;
+
+void tab_progress_set(tab_progress_fn f)
+{
+	tab_progress_hook = f;
+}
+
+void tab_progress(const long D, const long done, const long total, const bjt_stats_t * stats)
+{
+	if (tab_progress_hook)
+	{
+		tab_progress_hook(D, done, total, stats);
+	}
+}
+
+// the name of a file or of one of its parts, before the extension
+static void tab_name(char * name, const char * folder, const int a, const int m, const int index, const int part)
+{
+	if (part < 0)
+	{
+		sprintf(name, "%s/cl%dmod%d/cl%dmod%d.%d", folder, a, m, a, m, index);
+	}
+	else
+	{
+		sprintf(name, "%s/cl%dmod%d/cl%dmod%d.%d.part%d", folder, a, m, a, m, index, part);
+	}
+}
+
+// the name of cl[a]mod[m]l[ell] of a file or of one of its parts, before the extension
+static void tab_ell_name(char * name, const char * folder, const int a, const int m, const long ell, const int index, const int part)
+{
+	if (part < 0)
+	{
+		sprintf(name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d", folder, a, m, ell, a, m, ell, index);
+	}
+	else
+	{
+		sprintf(name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d.part%d", folder, a, m, ell, a, m, ell, index, part);
+	}
+}
+
+static int tab_exists(const char * folder, const int a, const int m, const int index, const int part)
+{
+	char name[500];
+
+	tab_name(name, folder, a, m, index, part);
+	strcat(name, "." TAB_EXT);
+
+	if (access(name, F_OK) != -1)
+	{
+		printf("The file %s exists, thus terminating.\n", name);
+		return 1;
+	}
+
+	return 0;
+}
+
+// tabulates the rows [first, last) of file index into part, -1 for the file itself
+static void tab_rows(const int index, const int part, const long first, const long last,
+		const long D_total, const char * file, const char * folder,
+		const int a, const int m,
+		const int * primes, const factors_t * h_factors,
+		factors_t * D_factors, int * h_list, const int threads,
+		const ell_list_t * ells)
+{
+	char name[500], data[200];
+	int fd, e;
+	const int ell_count = ells ? ells->count : 0;
+
+	struct timeval begin, end;
+	unsigned long exec_time;
+
+	#ifdef WITH_CONTAINER_OUTPUT
+	if (clcout_exists(tab_out, index, -1) || (part >= 0 && clcout_exists(tab_out, index, part)))
+	{
+		printf("The file %d, part %d, is in %s, thus terminating.\n", index, part, tab_out->path);
+		return;
+	}
+	#else
+	if (tab_exists(folder, a, m, index, -1) || (part >= 0 && tab_exists(folder, a, m, index, part)))
+	{
+		return;
+	}
+	#endif
+
+	// pick up from the last checkpoint of an interrupted run, if there is one
+	char path[500];
+	long ckpt[3 + 2 * MAX_ELLS];		// file offset, next row, dist, then the offset and dist of each ell file
+	int ell_dist[MAX_ELLS];
+
+	tab_name(path, folder, a, m, index, part);
+
+	#ifdef WITH_CONTAINER_OUTPUT
+	// a segment is appended once it is complete, an interrupted one starts over
+	int resume = 0;
+	#else
+	long run[2 + MAX_ELLS];				// D_max / (files * m) and the ells the checkpoint is of
+	run[0] = D_total;
+	run[1] = ell_count;
+
+	for (e = 0; e < ell_count; e++)
+	{
+		run[2 + e] = ells->ell[e];
+	}
+
+	int resume = ckpt_read(path, run, 2 + ell_count, ckpt, 3 + 2 * ell_count) && access(path, F_OK) != -1;
+
+	for (e = 0; e < ell_count; e++)
+	{
+		tab_ell_name(name, folder, a, m, ells->ell[e], index, part);
+		resume = resume && access(name, F_OK) != -1;
+	}
+	#endif
+
+	const long start = resume ? ckpt[1] : first;
+
+	if (resume)
+	{
+		printf("Resuming %s from row %ld\n", path, start);
+		fflush(stdout);
+	}
+
+	if (file)
+	{
+		sprintf(name, "%s/%s%d", folder, file, index);
+
+		if (index == 0 && start == 0 && (a == 4 || a == 3))
+		{
+			fd = open(name, O_RDWR);
+
+			if (fd == -1)
+			{
+				sprintf(data, "Unable to open the file %s\n", name);
+				perror(data);
+				fflush(stderr);
+				exit(1);
+			}
+
+			int * h_temp = (int *) mmap(0, sizeof(int), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+			if (h_temp == MAP_FAILED)
+			{
+				sprintf(data, "Unable to map the file %s for writing\n", name);
+				perror(data);
+				fflush(stderr);
+				exit(1);
+			}
+
+			if (a == 4)
+			{
+				h_temp[0] = 2;
+			}
+			else
 			{
-				is_discriminant = 0;
-				break;
+				h_temp[1] = 3;
 			}
+
+			munmap(h_temp, sizeof(int));
+			close(fd);
+		}
+
+		fd = open(name, O_RDONLY);
+
+		if (fd == -1 || lseek(fd, start * sizeof(int), SEEK_SET) == -1)
+		{
+			sprintf(data, "Unable to open the file %s for reading\n", name);
+			perror(data);
+			fflush(stderr);
+			exit(1);
+		}
+	}
+	else
+	{
+		fd = 0;
+	}
+
+	const long D_max = index * D_total * m + last * m;
+	const long D_file = index * D_total * m + a;
+	const long D_first = D_file + start * m;
+
+	int h, dist = resume ? ckpt[2] : 0, rank, t, k;
+	long count = 0;
+	int * row;
+	bjt_stats_t stats;
+
+	// compute an upper bound on the size of the table
+	int h_max = h_upper_bound(-D_max);
+
+	int table_size = next_prime((((int) sqrt(h_max)) << 1) - 1);
+
+	if (table_size == -1)
+	{
+		perror("Not enough primes in liboptarith/primes.h\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	tab_round_t round;
+	round.file = file;
+	round.a = a;
+	round.m = m;
+	round.res = (((a & 3) != 3) ? a : 1);
+	round.h_factors = h_factors;
+
+	// block k is in blocks[k & 1], the first one in the tables of the caller
+	tab_block_t blocks[2];
+
+	for (k = 0; k < 2; k++)
+	{
+		if (k == 0)
+		{
+			blocks[k].D_factors = *D_factors;
+			blocks[k].h_list = file ? h_list : NULL;
+		}
+		else
+		{
+			factors_init(&blocks[k].D_factors, tab_block_total, D_factors->stride);
+			blocks[k].h_list = file ? (int *) malloc(tab_block_total * sizeof(int)) : NULL;
+		}
+
+		blocks[k].h_bound = file ? NULL : (int *) malloc(tab_block_total * sizeof(int));
+		blocks[k].split = (uint64_t *) malloc(tab_block_total * sizeof(uint64_t));
+		blocks[k].D_max = D_max;
+		blocks[k].fd = fd;
+		blocks[k].a = a;
+		blocks[k].m = m;
+		blocks[k].primes = primes;
+	}
+	round.rows = (int *) malloc(TAB_ROUND * TAB_ROW * sizeof(int));
+	round.ells = ells;
+	round.ell_rows = ells ? (int *) malloc(TAB_ROUND * ell_count * TAB_ROW * sizeof(int)) : NULL;
+
+	tab_worker_t * workers = (tab_worker_t *) malloc(threads * sizeof(tab_worker_t));
+
+	for (t = 0; t < threads; t++)
+	{
+		workers[t].round = &round;
+		bjt_stats_init(&workers[t].stats);
+		bjt_tables_s128_init(&workers[t].R_s128, &workers[t].Q_s128, table_size);
+
+		for (k = 0; k < TAB_LANES; k++)
+		{
+			form_table_init(&workers[t].lanes[k].R, table_size);
+			form_table_init(&workers[t].lanes[k].Q, table_size);
+		}
+	}
+
+	round.stop = 0;
+	pthread_barrier_init(&round.start, NULL, threads);
+	pthread_barrier_init(&round.done, NULL, threads);
+
+	for (t = 1; t < threads; t++)
+	{
+		if (pthread_create(&workers[t].thread, NULL, &tab_pool, workers + t) != 0)
+		{
+			perror("Unable to start a tabulation thread\n");
+			fflush(stderr);
+			exit(1);
+		}
+	}
+
+	#ifdef WITH_CONTAINER_OUTPUT
+	gzout_t clfd;
+	gzout_open_mem(&clfd, path, GZ_THREADED);
+	#elif defined(WITH_BINARY_OUTPUT)
+	sprintf(name, "%s/cl%dmod%d", folder, a, m);
+	mkdir(name, 0744);
+	clbout_t clfd;
+	if (resume)
+	{
+		clbout_resume(&clfd, path, a, m, index, ckpt[0]);
+	}
+	else
+	{
+		clbout_open(&clfd, path, a, m, index);
+	}
+	#else
+	sprintf(name, "%s/cl%dmod%d", folder, a, m);
+	mkdir(name, 0744);
+	gzout_t clfd;
+	if (resume)
+	{
+		gzout_resume(&clfd, path, GZ_THREADED, ckpt[0]);
+	}
+	else
+	{
+		gzout_open(&clfd, path, GZ_THREADED);
+	}
+	#endif
+
+	gzout_t * ell_fd = (gzout_t *) malloc((ell_count + 1) * sizeof(gzout_t));
+
+	for (e = 0; e < ell_count; e++)
+	{
+		#ifdef WITH_CONTAINER_OUTPUT
+		tab_ell_name(name, folder, a, m, ells->ell[e], index, part);
+		gzout_open_mem(ell_fd + e, name, GZ_THREADED);
+		#else
+		sprintf(name, "%s/cl%dmod%dl%ld", folder, a, m, ells->ell[e]);
+		mkdir(name, 0744);
+		tab_ell_name(name, folder, a, m, ells->ell[e], index, part);
+
+		if (resume)
+		{
+			gzout_resume(ell_fd + e, name, GZ_THREADED, ckpt[3 + 2 * e]);
+		}
+		else
+		{
+			gzout_open(ell_fd + e, name, GZ_THREADED);
+		}
+		#endif
+
+		ell_dist[e] = resume ? ckpt[4 + 2 * e] : 0;
+	}
+
+	// ABANDONED DISCRIMINANTS
+	// The rows from D_first on are tabulated again, so are their entries in the
+	// abort logs of a rerun or of the run that wrote the checkpoint
+	#ifdef WITH_CONTAINER_OUTPUT
+	bjt_abort_reset(tab_out[0].path, D_first, D_max);
+	#else
+	bjt_abort_reset(path, D_first, D_max);
+	#endif
+
+	for (e = 0; e < ell_count; e++)
+	{
+		#ifdef WITH_CONTAINER_OUTPUT
+		bjt_abort_reset(tab_out[1 + e].path, D_first, D_max);
+		#else
+		tab_ell_name(name, folder, a, m, ells->ell[e], index, part);
+		bjt_abort_reset(name, D_first, D_max);
+		#endif
+	}
+
+	gettimeofday(&begin, NULL);
+	#ifndef WITH_CONTAINER_OUTPUT
+	time_t saved = time(NULL);
+	#endif
+	if (D_first < D_max)
+	{
+		blocks[0].D_block = D_first;
+		tab_block_fill(blocks);
+	}
+
+	for (long D_block = D_first, cur = 0; D_block < D_max; D_block += tab_block_total * m, cur ^= 1)
+	{
+		tab_block_t * block = blocks + cur, * next = blocks + (cur ^ 1);
+
+		next->D_block = D_block + tab_block_total * m;
+
+		if (next->D_block < D_max)
+		{
+			tab_block_start(next);
 		}
 
-		if (is_discriminant)
+		round.D_factors = &block->D_factors;
+		round.h_list = block->h_list;
+		round.h_bound = block->h_bound;
+		round.split = block->split;
+
+		const long block_total = block->total;
+
+		// the threads share a round of the sieve block, the output is written in order
+		for (long f_first = 0; f_first < block_total; f_first += TAB_ROUND)
 		{
-			if (file)
+			round.D_first = D_block + f_first * m;
+			round.f_first = f_first;
+			round.total = MIN(TAB_ROUND, block_total - f_first);
+			round.next = 0;
+
+			pthread_barrier_wait(&round.start);
+			tab_worker(workers);
+			pthread_barrier_wait(&round.done);
+
+			for (long f = 0; f < round.total; f++)
 			{
-				h = h_list[f_cur];
+				row = round.rows + f * TAB_ROW;
+				rank = row[0];
 
-				if (a == 4)
+				if (rank <= 0)
 				{
-					h /= 2;
+					if (rank < 0)
+					{
+						#ifdef WITH_CONTAINER_OUTPUT
+						bjt_abort_log(tab_out[0].path, round.D_first + f * m);
+						#else
+						bjt_abort_log(path, round.D_first + f * m);
+						#endif
+					}
+
+					dist++;
+
+					for (e = 0; e < ell_count; e++)
+					{
+						ell_dist[e]++;
+					}
+					continue;
 				}
-				else if (a == 3)
+
+				h = row[1];
+
+				#ifdef WITH_PARI
+				pari_verify(row + 2, -(round.D_first + f * m));
+				#endif
+
+				#ifdef WITH_BINARY_OUTPUT
+				clbout_record(&clfd, round.D_first + f * m, dist, h, row + 2, rank);
+				#else
+				char * line = name + sprintf(name, "%d\t%u\t", dist, h);
+
+				for (int r = 2; r <= rank; r++)
 				{
-					h /= 3;
+					line += sprintf(line, "%d ", row[r]);
 				}
+				line += sprintf(line, "%d\n", row[rank + 1]);
 
-				init_pow = 1;
-				h_cur_factors = h_factors[h];
-				h_fac_total = h_cur_factors[0];
-				h_temp = h;
+				gzout_write(&clfd, name, line - name);
+				#endif
 
-				for (int i = 1; i <= h_fac_total; i++)
+				for (e = 0; e < ell_count; e++)
 				{
-					h_fac = h_cur_factors[i];
-					h_temp /= h_fac;
-					if (h_temp % h_fac != 0)
+					row = round.ell_rows + (f * ell_count + e) * TAB_ROW;
+
+					if (row[1] < 0)
 					{
-						init_pow *= h_fac;
+						#ifdef WITH_CONTAINER_OUTPUT
+						bjt_abort_log(tab_out[1 + e].path, round.D_first + f * m);
+						#else
+						tab_ell_name(name, folder, a, m, ells->ell[e], index, part);
+						bjt_abort_log(name, round.D_first + f * m);
+						#endif
+						ell_dist[e]++;
+						continue;
 					}
+
+					gzout_write(ell_fd + e, name, ell_format(name, ell_dist[e], row));
+					ell_dist[e] = 1;
 				}
 
-				h /= init_pow;
+				dist = 1;
+				count++;
 			}
-			else
+
+			if (tab_progress_hook)
 			{
-				h = h_lower_bound(-D);
+				bjt_stats_init(&stats);
+
+				for (t = 0; t < threads; t++)
+				{
+					bjt_stats_add(&stats, &workers[t].stats);
+				}
+
+				tab_progress(round.D_first + round.total * m, (round.D_first - D_file) / m + round.total - first, last - first, &stats);
 			}
 
-			//printf("%ld: D=%ld, #factors=%u, h=%d, init_pow=%d\n", D_cur, D, D_cur_factors[0], h, init_pow);
-			//fflush(stdout);
+			// everything up to the end of the round is in the file
+			#ifndef WITH_CONTAINER_OUTPUT
+			if (time(NULL) - saved >= CKPT_SECONDS)
+			{
+				#ifdef WITH_BINARY_OUTPUT
+				ckpt[0] = clbout_checkpoint(&clfd);
+				#else
+				ckpt[0] = gzout_checkpoint(&clfd);
+				#endif
+				ckpt[1] = (round.D_first - D_file) / m + round.total;
+				ckpt[2] = dist;
+
+				for (e = 0; e < ell_count; e++)
+				{
+					ckpt[3 + 2 * e] = gzout_checkpoint(ell_fd + e);
+					ckpt[4 + 2 * e] = ell_dist[e];
+				}
 
-			rank = compute_group_bjt(result, -D, init_pow, h, 0, &R, &Q);
+				ckpt_write(path, run, 2 + ell_count, ckpt, 3 + 2 * ell_count);
+				saved = time(NULL);
+			}
+			#endif
+		}
 
-			h = result[0] * init_pow;
-			result[1] *= init_pow;
+		if (next->D_block < D_max)
+		{
+			tab_block_wait(next);
+		}
+	}
 
-			sprintf(name, "%d\t%u\t", dist, h);
+	round.stop = 1;
+	pthread_barrier_wait(&round.start);
 
-			for (r = 1; r < rank; r++)
-			{
-				sprintf(data, "%d ", result[r]);
-				strcat(name, data);
-			}
-			sprintf(data, "%d\n", result[rank]);
-			strcat(name, data);
+	for (t = 1; t < threads; t++)
+	{
+		pthread_join(workers[t].thread, NULL);
+	}
 
-			#ifdef WITH_PARI
-			pari_verify(result + 1, -D);
-			#endif
+	pthread_barrier_destroy(&round.start);
+	pthread_barrier_destroy(&round.done);
 
-			fputs(name, clfd);
+	#ifdef WITH_CONTAINER_OUTPUT
+	gzout_close(&clfd);
+	clcout_append(tab_out, index, part, D_file + first * m, D_file + last * m, clfd.mem, clfd.mem_len);
+	free(clfd.mem);
 
-			dist = 1;
-		}
-		else
+	for (e = 0; e < ell_count; e++)
+	{
+		gzout_close(ell_fd + e);
+		clcout_append(tab_out + 1 + e, index, part, D_file + first * m, D_file + last * m, ell_fd[e].mem, ell_fd[e].mem_len);
+		free(ell_fd[e].mem);
+	}
+	#else
+	#ifdef WITH_BINARY_OUTPUT
+	clbout_close(&clfd);
+	#else
+	gzout_close(&clfd);
+	#endif
+
+	for (e = 0; e < ell_count; e++)
+	{
+		gzout_close(ell_fd + e);
+	}
+
+	ckpt_remove(path);
+	#endif
+
+	bjt_stats_init(&stats);
+
+	for (t = 0; t < threads; t++)
+	{
+		bjt_stats_add(&stats, &workers[t].stats);
+
+		for (k = 0; k < TAB_LANES; k++)
 		{
-			dist++;
+			bjt_stats_add_table(&stats, &workers[t].lanes[k].R);
+			bjt_stats_add_table(&stats, &workers[t].lanes[k].Q);
+			oatab_clear(&workers[t].lanes[k].R);
+			oatab_clear(&workers[t].lanes[k].Q);
 		}
+
+		bjt_tables_s128_clear(&workers[t].R_s128, &workers[t].Q_s128);
 	}
 
-	fclose(clfd);
-	sprintf(name, "gzip %s/cl%dmod%d/cl%dmod%d.%d", folder, a, m, a, m, index);
-	system(name);
+	free(workers);
+	free(round.rows);
+	for (k = 0; k < 2; k++)
+	{
+		free(blocks[k].h_bound);
+		free(blocks[k].split);
+	}
 
-	htab_clear(&R);
-	htab_clear(&Q);
+	factors_clear(&blocks[1].D_factors);
+	free(blocks[1].h_list);
+	free(round.ell_rows);
+	free(ell_fd);
 	gettimeofday(&end, NULL);
 	exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
-	printf("index=%d, took %.3f\n", index, exec_time / 1e6);
+	if (part < 0)
+	{
+		printf("index=%d, took %.3f, %.0f discriminants per second per thread\n", index, exec_time / 1e6, count / (exec_time / 1e6) / threads);
+		sprintf(data, "index=%d", index);
+	}
+	else
+	{
+		printf("index=%d, part=%d, took %.3f, %.0f discriminants per second per thread\n", index, part, exec_time / 1e6, count / (exec_time / 1e6) / threads);
+		sprintf(data, "index=%d, part=%d", index, part);
+	}
+	bjt_stats_print(data, &stats);
 	fflush(stdout);
 
 	if (file)
@@ -998,8 +2062,175 @@ void tabulate_bjt(const int index, const long D_total,
 		close(fd);
 
 		#ifndef KEEP_FILES
-		sprintf(name, "%s/%s%d", folder, file, index);
+		if (part < 0)
+		{
+			sprintf(name, "%s/%s%d", folder, file, index);
+			remove(name);
+		}
+		#endif
+	}
+}
+
+void tabulate_bjt(const int index, const long D_total,
+		const char * file, const char * folder,
+		const int a, const int m,
+		const int * primes, const factors_t * h_factors,
+		factors_t * D_factors, int * h_list, const int threads,
+		const ell_list_t * ells)
+{
+	tab_rows(index, -1, 0, D_total, D_total, file, folder, a, m, primes, h_factors, D_factors, h_list, threads, ells);
+}
+
+void tabulate_bjt_part(const int index, const int part, const long D_total,
+		const char * file, const char * folder,
+		const int a, const int m,
+		const int * primes, const factors_t * h_factors,
+		factors_t * D_factors, int * h_list, const int threads,
+		const ell_list_t * ells)
+{
+	const long first = (long) part * PART_TOTAL;
+
+	tab_rows(index, part, first, MIN(first + PART_TOTAL, D_total), D_total, file, folder, a, m, primes, h_factors, D_factors, h_list, threads, ells);
+}
+
+// appends the text file name, the part starting at D, to out and rewrites
+// the dist of its first line, D_prev is the last discriminant written to out
+static void stitch_text(gzout_t * out, char * name, long D, long * D_prev, const int m)
+{
+	long v[MAX_RANK + 2];
+	int n, r;
+	char * line;
+
+	gzin_t in;
+	gzin_open(&in, name);
+
+	while ((n = gzin_line(&in, v, MAX_RANK + 2)) > 0)
+	{
+		D += v[0] * m;
+
+		line = name + sprintf(name, "%ld\t%ld\t", (D - *D_prev) / m, v[1]);
+
+		for (r = 2; r < n - 1; r++)
+		{
+			line += sprintf(line, "%ld ", v[r]);
+		}
+		line += sprintf(line, "%ld\n", v[n - 1]);
+
+		gzout_write(out, name, line - name);
+		*D_prev = D;
+	}
+
+	gzin_close(&in);
+}
+
+void stitch_bjt_ell(const int index, const long D_total, const char * folder, const int a, const int m, const long ell)
+{
+	const int parts = bjt_parts(D_total);
+	const long D_first = index * D_total * m + a;
+
+	char name[500];
+	long D_prev = D_first;
+	int part;
+
+	gzout_t ell_out;
+	tab_ell_name(name, folder, a, m, ell, index, -1);
+	gzout_open(&ell_out, name, GZ_THREADED);
+
+	for (part = 0; part < parts; part++)
+	{
+		tab_ell_name(name, folder, a, m, ell, index, part);
+		strcat(name, ".gz");
+		stitch_text(&ell_out, name, D_first + (long) part * PART_TOTAL * m, &D_prev, m);
+	}
+
+	gzout_close(&ell_out);
+
+	for (part = 0; part < parts; part++)
+	{
+		tab_ell_name(name, folder, a, m, ell, index, part);
+		strcat(name, ".gz");
 		remove(name);
+	}
+}
+
+void stitch_bjt(const int index, const long D_total, const char * file, const char * folder, const int a, const int m,
+		const ell_list_t * ells)
+{
+	const int parts = bjt_parts(D_total);
+	const long D_first = index * D_total * m + a;
+
+	char name[500];
+	long D, D_prev = D_first;
+	int part, e;
+
+	if (tab_exists(folder, a, m, index, -1))
+	{
+		return;
+	}
+
+	tab_name(name, folder, a, m, index, -1);
+
+	#ifdef WITH_BINARY_OUTPUT
+	int dist, h, rank, inv[CLB_MAX_RANK];
+
+	clbout_t out;
+	clbout_open(&out, name, a, m, index);
+	#else
+	gzout_t out;
+	gzout_open(&out, name, GZ_THREADED);
+	#endif
+
+	for (part = 0; part < parts; part++)
+	{
+		// the first record of a part counts from the first row of the part
+		D = D_first + (long) part * PART_TOTAL * m;
+
+		tab_name(name, folder, a, m, index, part);
+		strcat(name, "." TAB_EXT);
+
+		#ifdef WITH_BINARY_OUTPUT
+		clbin_t in;
+		clbin_open(&in, name);
+
+		while (clbin_record(&in, &D, &dist, &h, inv, &rank))
+		{
+			clbout_record(&out, D, (D - D_prev) / m, h, inv, rank);
+			D_prev = D;
+		}
+
+		clbin_close(&in);
+		#else
+		stitch_text(&out, name, D, &D_prev, m);
 		#endif
 	}
+
+	#ifdef WITH_BINARY_OUTPUT
+	clbout_close(&out);
+	#else
+	gzout_close(&out);
+	#endif
+
+	for (part = 0; part < parts; part++)
+	{
+		tab_name(name, folder, a, m, index, part);
+		strcat(name, "." TAB_EXT);
+		remove(name);
+	}
+
+	// the ell files are text in either case
+	for (e = 0; ells && e < ells->count; e++)
+	{
+		stitch_bjt_ell(index, D_total, folder, a, m, ells->ell[e]);
+	}
+
+	#ifndef KEEP_FILES
+	if (file)
+	{
+		sprintf(name, "%s/%s%d", folder, file, index);
+		remove(name);
+	}
+	#endif
+
+	printf("index=%d, stitched %d parts\n", index, parts);
+	fflush(stdout);
 }
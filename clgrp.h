@@ -27,41 +27,101 @@
 #define CLASS_GROUP_H_
 
 #include <libqform/s64_qform.h>
+#ifdef WITH_S128_QFORMS
+#include <libqform/s128_qform.h>
+#endif
 
 #include "functions.h"
+#include "sieve.h"
+
+#ifdef WITH_CONTAINER_OUTPUT
+#include "clc.h"
+#endif
 
 #define MAX_RANK 10
 
 
-// FORM
+// EXPONENT VECTOR
 
+// fixed rank exponent vector of a form in terms of the generators found so far
 typedef struct
 {
-	s64_qform_t form;
-	vec_t value;		// for hash table
-} form_t;
+	int32_t v[MAX_RANK];
+	uint8_t size;
+} evec_t;
 
+// same semantics as vec_set, positions between size and j are zeroed
 static __inline__
-int hash_form_t(const void * a)
+void evec_set(evec_t * v, const int val, const size_t j)
 {
-	return ((form_t *) a)->form.a;
+	while (v->size < j)
+	{
+		v->v[v->size++] = 0;
+	}
+
+	v->v[j] = val;
+
+	if (v->size == j)
+	{
+		v->size++;
+	}
 }
 
+// same semantics as vec_add
 static __inline__
-int eq_form_t(const void * a, const void * b)
+void evec_add(int * r, const evec_t * v, const evec_t * w)
 {
-	s64_qform_t * t = (s64_qform_t *) a;
-	s64_qform_t * s = &((form_t *) b)->form;
-	return ((t->a == s->a) && (t->b == s->b));
+	register size_t i;
+	const size_t n = MIN(v->size, w->size);
+
+	for (i = 0; i < n; i++)
+	{
+		r[i] = v->v[i] + w->v[i];
+	}
+
+	for (; i < v->size; i++)
+	{
+		r[i] = v->v[i];
+	}
+
+	for (; i < w->size; i++)
+	{
+		r[i] = w->v[i];
+	}
 }
 
 static __inline__
-void del_form_t(void * a)
+void evec_print(const evec_t * v)
 {
-	vec_clear(&((form_t *) a)->value);
+	register size_t i;
+
+	printf("%d", v->v[0]);
+	for (i = 1; i < v->size; i++)
+	{
+		printf(" %d", v->v[i]);
+	}
 }
 
 
+// FORMS
+// The records of R and Q, see clgrp_form.h, for s64 forms and with
+// -DWITH_S128_QFORMS also for s128 forms, as form_t_s128 and so on.
+
+#define QF(x) s64_qform_##x
+#define QF_NAME(x) x
+#include "clgrp_form.h"
+#undef QF
+#undef QF_NAME
+
+#ifdef WITH_S128_QFORMS
+#define QF(x) s128_qform_##x
+#define QF_NAME(x) x##_s128
+#include "clgrp_form.h"
+#undef QF
+#undef QF_NAME
+#endif
+
+
 // CLASS GROUP COMPUTATION / TABULATION
 
 #ifdef WITH_PARI
@@ -70,15 +130,272 @@ void del_form_t(void * a)
 void pari_verify(int * result, const long D);
 #endif
 
-int next(group_pow_t * gp, form_t * R, const int init_pow, int prime_index, const int ell);
+// the prime forms of the primes of split, see split_primes
+int next(group_pow_t * gp, form_t * R, const int init_pow, int prime_index, const int ell, const uint64_t split);
 
 long h_upper_bound(const long D);
 
 int h_lower_bound(const long D);
 
-int compute_group_bjt(int * result, const long D, const int init_pow, const int h_star, const int ell, htab_t * R, htab_t * Q);
+// h_lower_bound(D) takes the primes below this from prime_list
+long h_lower_bound_primes(const long D);
+
+// h_star[f] = h_lower_bound(-(D_first + f * m)) for 0 <= f < count, the
+// Euler products of the whole block taken a prime at a time
+void h_lower_bound_block(int * h_star, const long D_first, const int m, const long count);
+
+// Bit i of the mask of D is clear when (D/prime_list[i]) = -1, so that next()
+// only tries the primes that can give a prime form. The primes from
+// prime_list[SPLIT_PRIMES] on are always tried.
+#define SPLIT_PRIMES 64
+
+uint64_t split_primes(const long D);
+
+// split[f] = split_primes(-(D_first + f * m)) for 0 <= f < count
+void split_primes_block(uint64_t * split, const long D_first, const int m, const long count);
+
+// STATISTICS
+// Counters of the work done by compute_group_bjt and the tabulation lanes,
+// always kept since they are a handful of increments per group operation.
+// A discriminant that takes more than budget compositions, squarings and
+// powerings, or whose class number comes out above 2 h_star, is abandoned:
+// compute_group_bjt returns -1 and the tabulation logs D to a side file.
+
+#ifndef BJT_BUDGET
+#define BJT_BUDGET (1L << 28)
+#endif
+
+typedef struct
+{
+	long calls;							// discriminants
+	long baby;							// baby steps
+	long giant;							// giant steps
+	long compose;
+	long square;
+	long pow;
+	long finds;							// table lookups
+	long probes;						// occupied slots visited by the lookups
+	long max_probes;					// longest probe sequence
+	long doublings;						// step width doublings
+	long generators;					// candidate generators tried
+	long occupancy;						// most entries in R and Q at once
+	long aborted;						// discriminants abandoned
+	long budget;						// operations allowed per discriminant
+} bjt_stats_t;
+
+void bjt_stats_init(bjt_stats_t * s);
+
+// sums the counters of t into s
+void bjt_stats_add(bjt_stats_t * s, const bjt_stats_t * t);
+
+// adds the lookups counted by the table t, and resets them
+void bjt_stats_add_table(bjt_stats_t * s, oatab_t * t);
+
+void bjt_stats_print(const char * label, const bjt_stats_t * s);
+
+// appends D to path.aborted, the discriminants abandoned while writing path
+void bjt_abort_log(const char * path, const long D);
+
+// drops the discriminants in [D_from, D_to) from path.aborted, before a writer
+// tabulates them again from scratch or from a checkpoint, so that none is
+// logged twice
+void bjt_abort_reset(const char * path, const long D_from, const long D_to);
+
+static __inline__
+long bjt_stats_ops(const bjt_stats_t * s)
+{
+	return s->compose + s->square + s->pow;
+}
+
+int compute_group_bjt(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q);
+
+// The order of the first generator, found outside of compute_group_bjt with R
+// holding the identity and the baby steps g^-i in order and Q the identity.
+// With order 0 there is no such generator and R and Q are empty.
+typedef struct
+{
+	s64_qform_t g;
+	int prime_index;
+	int order;
+	uint64_t split;						// split_primes(D)
+	const int * ramified;				// with order 0, the odd primes of D, count first
+} bjt_seed_t;
+
+// GENUS SEEDING
+// The classes of the ramified primes of D generate Cl(D)[2], and they lie in
+// the subgroup searched when init_pow is odd. Given ramified, a seed with
+// order 0 starts M, R and Q with a basis of the part of Cl(D)[2] they span,
+// as if compute_group_bjt had found the forms as its first generators, each of
+// order 2, so that only the quotient is searched. At most GENUS_RANK of them,
+// leaving the rows of the quotient room in M. With WITH_GENUS_SEED the
+// tabulation seeds every discriminant with an odd prime factor from the
+// factorisation of the sieve, bypassing the lanes.
+
+#ifndef GENUS_RANK
+#define GENUS_RANK (MAX_RANK / 2)
+#endif
+
+// carries on from seed with the remaining generators, seed may be NULL,
+// counting into stats, which may be NULL for the default budget
+int compute_group_bjt_seeded(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q,
+				const bjt_seed_t * seed, bjt_stats_t * stats);
+
+#ifdef WITH_S128_QFORMS
+// the same on s128 forms, with R and Q of form_table_init_s128 and seed NULL
+int compute_group_bjt_seeded_s128(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q,
+				const bjt_seed_t * seed, bjt_stats_t * stats);
+#endif
+
+// compute_group_bjt_seeded without a seed on the narrowest forms that hold D:
+// s64 forms in R and Q if libqform allows D, otherwise s128 forms in R_s128
+// and Q_s128, which need -DWITH_S128_QFORMS. The caller keeps R_s128 and
+// Q_s128 from bjt_tables_s128_init for all its discriminants, with both NULL
+// they are allocated for the call.
+int compute_group_bjt_any(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q,
+				oatab_t * R_s128, oatab_t * Q_s128, bjt_stats_t * stats);
+
+// the s128 tables of a caller of compute_group_bjt_any, left alone without
+// -DWITH_S128_QFORMS
+void bjt_tables_s128_init(oatab_t * R_s128, oatab_t * Q_s128, const size_t size);
+
+void bjt_tables_s128_clear(oatab_t * R_s128, oatab_t * Q_s128);
+
+// BATCHES
+// compute_group_bjt over arrays, for callers outside of the tabulation, the
+// Rust analysis tools in particular. A bjt_batch_t owns R and Q and their s128
+// twins, sized for |D| up to D_max, which grow on demand past it and are kept
+// from one batch to the next. Entry i is compute_group_bjt_any(D[i],
+// init_pow[i], h_star[i], ell[i]): its rank goes to rank[i], -1 if it was
+// abandoned, and its result, h and the invariant factors, to
+// out[i * BJT_BATCH_ROW]. A batch is used by one thread at a time, parallel
+// callers hold one per thread.
+
+#define BJT_BATCH_ROW (MAX_RANK + 1)
+
+typedef struct
+{
+	oatab_t R;
+	oatab_t Q;
+	oatab_t R_s128;						// of bjt_tables_s128_init
+	oatab_t Q_s128;
+	bjt_stats_t stats;					// of all the batches so far
+} bjt_batch_t;
+
+void bjt_batch_init(bjt_batch_t * b, const long D_max);
+
+void bjt_batch_clear(bjt_batch_t * b);
+
+// the same on the heap, for callers that cannot lay out a bjt_batch_t
+bjt_batch_t * bjt_batch_new(const long D_max);
+
+void bjt_batch_free(bjt_batch_t * b);
+
+// returns the number of entries abandoned
+long bjt_batch_compute(bjt_batch_t * b, int * rank, int * out, const long * D, const int * init_pow, const int * h_star, const int * ell,
+				const long count);
+
+// ORDERS OF INDEX ELL^2
+// The order of conductor ell in the maximal order of discriminant D has
+// discriminant D * ell^2 and class number h * (ell - (D/ell)) / [O_K^* : O^*],
+// in the inert case clgrp_ell takes conductor ell^2. Cl(O) is an extension of
+// Cl(O_K) by a kernel of order k = h(O) / h, so its p-parts for p not dividing
+// k are known from the structure of Cl(O_K). compute_group_bjt only searches
+// the remaining p-parts, a subgroup of order about k times the k-part of h.
+// The split case (D/ell) = 1 is only recorded.
+
+#define MAX_ELLS 8
+
+typedef struct
+{
+	int count;
+	long ell[MAX_ELLS];
+	const int * spf;					// smallest prime factors below h_max * ell * (ell + 1)
+} ell_list_t;
+
+// parses a comma separated list of primes, returns their number or 0 if malformed
+int ell_list_parse(ell_list_t * list, const char * s);
+
+// stores (D/ell), the rank and the invariant factors of the order in row,
+// given h and the invariant factors inv[0], ..., inv[rank - 1] of the maximal
+// order, returns the rank, or -1 with row[1] = -1 if the order was abandoned,
+// with R_s128 and Q_s128 as for compute_group_bjt_any
+int compute_group_ell(int * row, const long D, const int h, const int * inv, const int rank, const long ell, const int * spf, oatab_t * R, oatab_t * Q,
+				oatab_t * R_s128, oatab_t * Q_s128, bjt_stats_t * stats);
+
+// a line of cl[a]mod[m]l[ell]: dist, (D/ell) and the invariant factors, 0 if split
+static __inline__
+int ell_format(char * line, const int dist, const int * row)
+{
+	char * out = line + sprintf(line, "%d\t%d\t", dist, row[0]);
+	int r;
+
+	for (r = 2; r <= row[1]; r++)
+	{
+		out += sprintf(out, "%d ", row[r]);
+	}
+	out += sprintf(out, "%d\n", row[row[1] + 1]);
+
+	return out - line;
+}
 
+// with ells not NULL, the orders of index ell^2 are tabulated in the same
+// sweep into cl[a]mod[m]l[ell], in the layout written by clgrp_ell
 void tabulate_bjt(const int index, const long D_total, const char * file, const char * folder, const int a, const int m,
-				const int * small_primes, int ** h_factors, int ** D_factors, int * h_list);
+				const int * small_primes, const factors_t * h_factors, factors_t * D_factors, int * h_list, const int threads,
+				const ell_list_t * ells);
+
+// discriminants per part of a file, 2^23
+#ifndef PART_TOTAL
+#define PART_TOTAL 8388608
+#endif
+
+static __inline__
+int bjt_parts(const long D_total)
+{
+	return (D_total + PART_TOTAL - 1) / PART_TOTAL;
+}
+
+// discriminants per round of the threads of a rank, see clgrp.c
+#define TAB_ROUND 65536
+
+// discriminants per sieve block of the tabulations, FAC_TOTAL by default, the
+// rows of the h_list and of the D_factors handed to them
+void tab_block_set(const long total);
+
+long tab_block_size();
+
+// the bytes a rank of the tabulations holds for |D| up to D_max with factor
+// tables of the stride, the tables of the caller and of the lanes included
+size_t tab_memory(const long D_max, const int stride, const int threads, const int ell_count);
+
+// tabulates the discriminants [part * PART_TOTAL, (part + 1) * PART_TOTAL) of
+// the file index into a part file, stitch_bjt joins the parts into the file
+void tabulate_bjt_part(const int index, const int part, const long D_total, const char * file, const char * folder, const int a, const int m,
+				const int * small_primes, const factors_t * h_factors, factors_t * D_factors, int * h_list, const int threads,
+				const ell_list_t * ells);
+
+void stitch_bjt(const int index, const long D_total, const char * file, const char * folder, const int a, const int m,
+				const ell_list_t * ells);
+
+// the same for the parts of cl[a]mod[m]l[ell] alone
+void stitch_bjt_ell(const int index, const long D_total, const char * folder, const int a, const int m, const long ell);
+
+// PROGRESS
+// The tabulations report as they go the discriminant they reached, the rows
+// of the file or part done and in all, and their counters so far, to the
+// function set by tab_progress_set, none by default. It is called from the
+// thread that called the tabulation, after every round of discriminants.
+typedef void (* tab_progress_fn)(const long D, const long done, const long total, const bjt_stats_t * stats);
+
+void tab_progress_set(tab_progress_fn f);
+
+// calls the function set by tab_progress_set, if there is one
+void tab_progress(const long D, const long done, const long total, const bjt_stats_t * stats);
+
+#ifdef WITH_CONTAINER_OUTPUT
+// tabulate_bjt and tabulate_bjt_part append each file or part to out[0] and
+// its ells to out[1 + e] in place of the folder, and the parts are not stitched
+void tabulate_bjt_containers(clcout_t * out);
+#endif
 
 #endif /* CLASS_GROUP_H_ */
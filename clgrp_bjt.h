@@ -0,0 +1,776 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+// BJT ENGINE
+// Included by clgrp.c once per form width, with
+//   QF(x)                          the libqform name x of the width
+//   QF_NAME(x)                     the clgrp name x of the width
+//   QF_SET_DISCRIMINANT(group, D)  sets the discriminant to the long D
+//   QF_SEEDS                       defined if the engine takes bjt_seed_t seeds
+// The s64 engine keeps the plain names and takes seeds, the others only run
+// with seed NULL. There is no include guard.
+
+void QF_NAME(qform_pow_s32)(group_pow_t * pow, qform_t * R, const qform_t * A, int32_t exp)
+{
+	QF(group_t) * group = (QF(group_t) *) pow->group;
+	QF(t) * C = (QF(t) *) R;
+	QF(t) B[2];
+
+	if (exp == 0)
+	{
+		QF(set_id)(group, C);
+		return;
+	}
+
+	// B[0] = A^sign(exp), B[1] its inverse
+	QF(set)(group, B, A);
+	QF(set)(group, B + 1, A);
+	QF(inverse)(group, B + ((exp < 0) ? 0 : 1));
+
+	const pow_naf_t * naf = pow_naf((exp < 0) ? -((uint32_t) exp) : (uint32_t) exp);
+
+	QF(set)(group, C, B);
+
+	for (int i = 1; i < naf->len; i++)
+	{
+		QF(square)(group, C, C);
+
+		if (naf->digit[i] != 0)
+		{
+			QF(compose)(group, C, C, B + (naf->digit[i] < 0));
+		}
+	}
+}
+
+// init_pow = class_number / order of the p-group
+int QF_NAME(next)(group_pow_t * gp, QF_NAME(form_t) * R, const int init_pow, int prime_index, const int ell, const uint64_t split)
+{
+	QF(group_t) * group = (QF(group_t) *) gp->group;
+
+		QF(set_id)(group, &R->form);
+
+		while (QF(is_id)(group, &R->form))
+		{
+			 while (QF(is_primeform)(group, &R->form, prime_list[prime_index = split_next(split, prime_index + 1)]) == 0);
+
+			QF_NAME(qform_pow_s32)(gp, &R->form, &R->form, init_pow);
+		}
+	return prime_index;
+}
+
+#ifdef QF_SEEDS
+// appends to R the classes of the primes of ramified that are outside of the
+// span of the previous ones, rows of order 2 in M, and returns their number
+static int genus_seed(QF(group_t) * group, mat_t M, oatab_t * R, const long D, const int * ramified, bjt_stats_t * stats)
+{
+	QF_NAME(form_t) ne;
+	QF(t) f;
+	size_t size, t;
+	int r = 0;
+
+	for (int i = 1; i <= ramified[0] && r < GENUS_RANK; i++)
+	{
+		// the ambiguous form (p, b, c) with p | b and b = D mod 2
+		f.a = ramified[i];
+		f.b = (D & 1) ? ramified[i] : 0;
+		f.c = ((long) f.b * f.b - D) / (4L * ramified[i]);
+		QF(reduce)(group, &f);
+
+		// R holds the span so far, in order, as the baby steps of order 2
+		if (oatab_find_index(R, &f) >= 0)
+		{
+			continue;
+		}
+
+		size = oatab_size(R);
+
+		for (t = 0; t < size; t++)
+		{
+			QF(compose)(group, &ne.form, QF_NAME(form_table_form)(R, t), &f);
+			stats->compose++;
+			ne.value = *QF_NAME(form_table_value)(R, t);
+			evec_set(&ne.value, 1, r);
+			QF_NAME(form_table_insert)(R, &ne);
+		}
+
+		M[r][r] = 2;
+		r++;
+	}
+
+	return r;
+}
+#endif
+
+// Ramachandran's thesis, p. 47
+int QF_NAME(compute_group_bjt_seeded)(int * result, const long D, const int init_pow, const int h_star, const int ell, oatab_t * R, oatab_t * Q,
+				const bjt_seed_t * seed, bjt_stats_t * stats)
+{
+#ifdef DEBUG
+printf("h_star=%d\n", h_star);
+#endif
+
+	bjt_stats_t local;
+
+	if (stats == NULL)
+	{
+		bjt_stats_init(&local);
+		stats = &local;
+	}
+
+	// the operations this discriminant may still take
+	const long ops_max = bjt_stats_ops(stats) + stats->budget;
+	const uint64_t split = seed ? seed->split : split_primes(D);
+	stats->calls++;
+
+	mat_t M = mat_init(MAX_RANK);
+
+	QF(group_t) group;
+	QF(group_init)(&group);
+	QF_SET_DISCRIMINANT(&group, D);
+	// group.conductor_ell = ell;
+
+	group_pow_t gp;
+	group_pow_init(&gp, &group.desc.group);
+
+	QF(t) * it_form;
+	evec_t * it_value, * e_value;
+	long e_idx;
+
+	QF_NAME(form_t) ne;
+	QF(set_id)(&group, &ne.form);
+	ne.value.v[0] = 0;
+	ne.value.size = 1;
+
+	if (seed == NULL || seed->order == 0)
+	{
+		QF_NAME(form_table_insert)(R, &ne);
+		QF_NAME(form_table_insert)(Q, &ne);
+	}
+
+	int omega = 2, h = 1, det = 1, s, y, u = 0, i, j = 0, k, prime_index = -1, rank = 0, q, n, t;
+	size_t R_prev_size, Q_size, cur_index;
+
+#ifdef QF_SEEDS
+	// the elementary 2-subgroup from the ramified primes comes first
+	if (seed && seed->order == 0 && (init_pow & 1))
+	{
+		j = genus_seed(&group, M, R, D, seed->ramified, stats);
+		h = 1 << j;
+		det = 1 << j;
+	}
+#endif
+
+	QF(t) g, g_inv, a, b, c, temp;
+
+	char is_break;
+
+
+  // fprintf(stderr, "starting loop h=%d < h_star=%d\n", h, h_star);
+  // fflush(stderr);
+
+	while (h < h_star)
+	{
+#ifdef DEBUG
+printf("\n\n\nNEW ITERATION: j=%d\n", j);
+printf("INITIAL b:\n");
+for (int p = 0; p <= j; p++)
+{
+	printf("b_vec[%d]=", p);
+	for (int l = 0; l <= p; l++)
+	{
+		printf(" %d", M[p][l]);
+	}
+	printf("\n");
+}
+#endif
+
+	 //  fprintf(stderr, "iteration: h=%d, j=%d\n", h, j);
+		// fprintf(stderr, "\tINITIAL b:\n");
+		// for (int p = 0; p <= j; p++)
+		// {
+		// 	fprintf(stderr, "\tb_vec[%d]=", p);
+		// 	for (int l = 0; l <= p; l++)
+		// 	{
+		// 		fprintf(stderr, "\t %d", M[p][l]);
+		// 	}
+		// 	fprintf(stderr, "\t\n");
+		// }
+	 //  fprintf(stderr, "start\n");
+	 //  fflush(stderr);
+
+		Q_size = oatab_size(Q);
+		R_prev_size = oatab_size(R);
+		cur_index = R_prev_size;
+
+#ifdef QF_SEEDS
+		// the order of the first generator is already known
+		if (seed && seed->order > 0 && j == 0)
+		{
+			prime_index = seed->prime_index;
+			QF(set)(&group, &g, &seed->g);
+			M[0][0] = seed->order;
+			goto order_found;
+		}
+#endif
+
+		// initializations
+		prime_index = QF_NAME(next)(&gp, &ne, init_pow, prime_index, ell, split);
+		QF(set)(&group, &g, &ne.form);
+		stats->generators++;
+
+		if (bjt_stats_ops(stats) > ops_max)
+		{
+			goto abort;
+		}
+
+#ifdef DEBUG
+printf("g[%d]=", j);
+QF(print)(&group, &g);
+printf(", <- prime_index=%d\n", prime_index);
+#endif
+
+	  // fprintf(stderr, "\tg[%d]=Qfb(%"PRId32", %"PRId32", %"PRId64"), <- prime_index=%d\n", j, g.a, g.b, g.c, prime_index);
+	  // fflush(stderr);
+
+		s = 1;
+		y = omega;
+		u = omega;
+		QF(set)(&group, &g_inv, &g);
+		QF(inverse)(&group, &g_inv);
+		QF(set_id)(&group, &a);
+		qform_pow_u32(&gp, &b, &g, omega);
+		stats->pow++;
+		QF(set)(&group, &c, &b);
+
+		is_break = 0;
+
+		// check if current generator is contained in current subgroup
+		if (j > 0)
+		{
+#ifdef DEBUG
+printf("\n\nContained in current subgroup?\n");
+#endif
+		  // fprintf(stderr, "\tContained in current subgroup?\n");
+		  // fflush(stderr);
+
+			for (i = 0; i < Q_size; i++)
+			{
+				is_break = 0;
+				it_form = QF_NAME(form_table_form)(Q, i);
+				it_value = QF_NAME(form_table_value)(Q, i);
+				
+				QF(compose)(&group, &temp, it_form, &g);
+				stats->compose++;
+				e_idx = oatab_find_index(R, &temp);
+
+				if (e_idx >= 0)
+				{
+					e_value = QF_NAME(form_table_value)(R, e_idx);
+					n = MIN(MIN(e_value->size, it_value->size), j);
+					for (k = 0; k < n; k++)
+					{
+						if (it_value->v[k] + e_value->v[k] >= M[k][k])
+						{
+							is_break = 1;
+							break;
+						}
+					}
+
+					if (!is_break)
+					{
+#ifdef DEBUG
+printf("Yes! ");
+QF(print)(&group, QF_NAME(form_table_form)(R, e_idx));
+printf("\n");
+#endif
+					  // fprintf(stderr, "\tYes! Qfb(%"PRId32", %"PRId32", %"PRId64")\n", e->form.a, e->form.b, e->form.c);
+					  // fflush(stderr);
+
+						M[j][j] = 1;
+						break;
+					}
+				}
+			}
+		}
+
+		while (M[j][j] == 0)
+		{
+#ifdef DEBUG
+printf("\nBaby steps, s=%d, u=%d\n", s, u);
+#endif
+		  // fprintf(stderr, "\tBaby steps, s=%d, u=%d\n", s, u);
+		  // fflush(stderr);
+			// compute new baby steps
+			for (i = s; i <= u; i++)
+			{
+				if (bjt_stats_ops(stats) > ops_max)
+				{
+					goto abort;
+				}
+
+				// Robust calculation using binary exponentiation to avoid drift
+				QF_NAME(qform_pow_s32)(&gp, &a, &g, -i);
+				stats->pow++;
+				stats->baby++;
+
+				if (a.a == 1)
+				{
+					M[j][j] = i;
+					break;
+				}
+
+				if (s == 1 && i > 1)
+				{
+					for (t = 0; t < R_prev_size; t++)
+					{
+						it_form = QF_NAME(form_table_form)(R, t);
+						it_value = QF_NAME(form_table_value)(R, t);
+				
+#ifdef DEBUG
+printf("From hash table we got form ");
+QF(print)(&group, it_form);
+printf("\n");
+#endif
+						is_break = 0;
+						QF(compose)(&group, &temp, it_form, &a);
+						stats->compose++;
+						e_idx = oatab_find_index(Q, &temp);
+
+						if (e_idx >= 0)
+						{
+							e_value = QF_NAME(form_table_value)(Q, e_idx);
+							n = MIN(MIN(e_value->size, it_value->size), j);
+							for (k = 0; k < n; k++)
+							{
+								if (it_value->v[k] + e_value->v[k] >= M[k][k])
+								{
+									is_break = 1;
+									break;
+								}
+							}
+
+							if (!is_break)
+							{
+#ifdef DEBUG
+printf("s=%d, i=%d, Found ", s, i);
+QF(print)(&group, QF_NAME(form_table_form)(Q, e_idx));
+printf(" = ");
+QF(print)(&group, it_form);
+printf(" * ");
+QF(print)(&group, &a);
+printf("\n");
+#endif
+								evec_add(M[j], it_value, e_value); 
+								M[j][j] = i;
+								
+#ifdef DEBUG
+printf("b_vec[%d]=", j);
+for (int l = 0; l <= j; l++)
+{
+printf(" %d", M[j][l]);
+}
+printf("\n");
+#endif
+								goto giant_steps;
+							}
+						}
+						else
+						{
+							is_break = 1;
+						}
+
+						if (is_break)
+						{
+							QF(set)(&group,&ne.form, &temp);
+							ne.value = *it_value;
+							evec_set(&ne.value, i, j);
+							QF_NAME(form_table_insert)(R, &ne);
+							cur_index++;
+
+#ifdef DEBUG
+printf("s=%d, i=%d, Adding ", s, i);
+QF(print)(&group, &temp);
+printf(" <->");
+for (int l = 0; l <= j; l++)
+{
+printf(" %d", ne.value.v[l]);
+}
+printf(" to R\n");
+#endif
+						}
+					}
+				}
+				else
+				{
+					for (t = 0; t < R_prev_size; t++)
+					{
+						it_form = QF_NAME(form_table_form)(R, t);
+						it_value = QF_NAME(form_table_value)(R, t);
+				
+#ifdef DEBUG
+printf("t=%d, R_prev_size=%lu, From hash table we got form ", t, R_prev_size);
+QF(print)(&group, it_form);
+printf("\n");
+#endif
+						QF(compose)(&group, &ne.form, it_form, &a);
+						stats->compose++;
+						ne.value = *it_value;
+						evec_set(&ne.value, i, j);
+
+#ifdef DEBUG
+printf("s=%d, i=%d, Adding ", s, i);
+QF(print)(&group, &ne.form);
+printf(" <->");
+for (int l = 0; l <= j; l++)
+{
+printf(" %d", ne.value.v[l]);
+}
+printf(" to R\n");
+#endif
+
+						QF_NAME(form_table_insert)(R, &ne);
+						cur_index++;
+					}
+				}
+			}
+
+			// compute giant steps
+			giant_steps:
+#ifdef DEBUG
+printf("\nGiant steps\n");
+#endif
+		  // fprintf(stderr, "\tGiant steps\n");
+		  // fflush(stderr);
+
+			while (M[j][j] == 0 && y < u * u)
+			{
+				if (bjt_stats_ops(stats) > ops_max)
+				{
+					goto abort;
+				}
+
+				stats->giant++;
+
+#ifdef DEBUG
+printf("y=%d, u=%d, b = ", y, u);
+QF(print)(&group, &b);
+printf("\n");
+#endif
+			  // fprintf(stderr, "\ty=%d, u=%d, b = Qfb(%"PRId32", %"PRId32", %"PRId64")\n", y, u, b.a, b.b, b.c);
+			  // fflush(stderr);
+
+				for (t = 0; t < Q_size; t++)
+				{
+					it_form = QF_NAME(form_table_form)(Q, t);
+					it_value = QF_NAME(form_table_value)(Q, t);
+					is_break = 0;
+					QF(compose)(&group, &temp, it_form, &b);
+					stats->compose++;
+
+#ifdef DEBUG
+printf("Looking for ");
+QF(print)(&group, &temp);
+printf(" = ");
+QF(print)(&group, it_form);
+printf(" * ");
+QF(print)(&group, &b);
+printf("\n");
+#endif					
+				  // fprintf(stderr, "\tLooking for Qfb(%"PRId32", %"PRId32", %"PRId64") = Qfb(%"PRId32", %"PRId32", %"PRId64") * Qfb(%"PRId32", %"PRId32", %"PRId64")\n", temp.a, temp.b, temp.c, it->form.a, it->form.b, it->form.c, b.a, b.b, b.c);
+				  // fflush(stderr);
+
+					e_idx = oatab_find_index(R, &temp);
+
+					if (e_idx >= 0)
+					{
+						e_value = QF_NAME(form_table_value)(R, e_idx);
+						n = MIN(MIN(it_value->size, e_value->size), j);
+						for (k = 0; k < n; k++)
+						{
+							if (it_value->v[k] + e_value->v[k] >= M[k][k])
+							{
+								is_break = 1;
+								break;
+							}
+						}
+
+						if (!is_break)
+						{
+							evec_add(M[j], it_value, e_value);
+							M[j][j] += y;
+
+							if (M[j][j] == 0)
+							{
+								printf("b_vec is zero!\n");
+								continue;
+							}
+
+#ifdef DEBUG
+printf("Found ");
+QF(print)(&group, QF_NAME(form_table_form)(R, e_idx));
+printf(" = ");
+QF(print)(&group, it_form);
+printf(" * ");
+QF(print)(&group, &b);
+printf("\nb_vec[%d]=", j);
+for (int l = 0; l <= j; l++)
+{
+	printf(" %d", M[j][l]);
+}
+printf("\n");
+#endif
+							goto double_step;
+						}
+					}
+				}
+
+				y += u;
+				QF(compose)(&group, &b, &b, &c);
+				stats->compose++;
+			}
+
+			// double step width
+			double_step:
+#ifdef DEBUG
+printf("Doubling step width...\n");
+#endif
+		  // fprintf(stderr, "\tDoubling step width...\n");
+		  // fflush(stderr);
+			s = u + 1;
+			u *= 2;
+			QF(square)(&group, &c, &c);
+			stats->square++;
+			stats->doublings++;
+		}
+
+		// only seeds jump here
+		order_found: __attribute__ ((unused));
+		stats->occupancy = MAX(stats->occupancy, (long) (oatab_size(R) + oatab_size(Q)));
+
+		if (M[j][j] > 1)
+		{
+
+#ifdef DEBUG
+printf("RESULT:\n");
+for (int p = 0; p <= j; p++)
+{
+	printf("b_vec[%d]=", p);
+	for (int l = 0; l <= p; l++)
+	{
+		printf(" %d", M[p][l]);
+	}
+	printf("\n");
+}
+#endif
+
+			// fprintf(stderr, "\tRESULT:\n");
+			// for (int p = 0; p <= j; p++)
+			// {
+			// 	fprintf(stderr, "\t\tb_vec[%d]=", p);
+			// 	for (int l = 0; l <= p; l++)
+			// 	{
+			// 		fprintf(stderr, "\t\t %d", M[p][l]);
+			// 	}
+			// 	fprintf(stderr, "\t\t\n");
+			// }
+		 //  fflush(stderr);
+
+			h *= M[j][j];
+
+			if (h < h_star)
+			{
+				// update R and Q
+				q = (int) ceil(sqrt(M[j][j]));
+				det *= q;
+
+#ifdef DEBUG
+printf("\n\nUpdating R and Q\nq=%d, det=%d, R_size=%lu\n", q, det, oatab_size(R));
+#endif
+				// fprintf(stderr, "\tUpdating R and Q: q=%d, det=%d, R_size=%lu\n", q, det, R_size);
+			 //  fflush(stderr);
+
+
+#ifdef DEBUG
+				for (t = oatab_size(R) - 1; t >= det; t--)
+				{
+printf("Removing ");
+QF(print)(&group, QF_NAME(form_table_form)(R, t));
+printf(" <-> ");
+evec_print(QF_NAME(form_table_value)(R, t));
+printf("\n");
+				}
+#endif
+				// form_t * foo = (form_t *) oatab_get(R, t);
+			 //  fprintf(stderr, "Removing Qfb(%"PRId32", %"PRId32", %"PRId64") <-> ", foo->form.a, foo->form.b, foo->form.c);
+				// fprintf(stderr, "%d", foo->value.v[0]);
+				// for (size_t i = 1; i < foo->value.size; i++)
+				// {
+				// 	fprintf(stderr, " %d", foo->value.v[i]);
+				// }
+				// fprintf(stderr, "\n");
+			 //  fflush(stderr);
+
+				// keep the first det elements of R
+				oatab_truncate(R, det);
+
+			  // fprintf(stderr, "\tRemoves done.\n");
+			  // fflush(stderr);
+
+				Q_size = oatab_size(Q);
+			  // fprintf(stderr, "\tQ_size done.\n");
+			  // fflush(stderr);
+			  // fprintf(stderr, "\tq=%d\n",q);
+			  // fflush(stderr);
+			  // fprintf(stderr, "\tg=Qfb(%"PRId32", %"PRId32", %"PRId64")\n",g.a, g.b, g.c);
+			  // fflush(stderr);
+				QF_NAME(qform_pow_s32)(&gp, &c, &g, q);
+				stats->pow++;
+			  // fprintf(stderr, "\tPow done.\n");
+			  // fflush(stderr);
+				QF(set_id)(&group, &b);
+			  // fprintf(stderr, "\tSet id done.\n");
+			  // fflush(stderr);
+
+				for (i = 1; (i < q) && (i * q < M[j][j]); i++)
+				{
+					QF(compose)(&group, &b, &b, &c);
+					stats->compose++;
+#ifdef DEBUG
+printf("g^%d = ", i * q);
+QF(print)(&group, &b);
+printf("\n");
+#endif
+				  // fprintf(stderr, "\tg^%d = Qfb(%"PRId32", %"PRId32", %"PRId64")\n", i * q, b.a, b.b, b.c);
+				  // fflush(stderr);
+
+					for (t = 0; t < Q_size; t++)
+					{
+						it_form = QF_NAME(form_table_form)(Q, t);
+						it_value = QF_NAME(form_table_value)(Q, t);
+						QF(compose)(&group, &ne.form, &b, it_form);
+						stats->compose++;
+						ne.value = *it_value;
+						evec_set(&ne.value, i * q, j);
+						QF_NAME(form_table_insert)(Q, &ne);
+
+#ifdef DEBUG
+printf("Adding ");
+QF(print)(&group, &ne.form);
+printf(" = ");
+QF(print)(&group, it_form);
+printf(" * g^%d <->", i * q);
+for (int l = 0; l <= j; l++)
+{
+	printf(" %d", ne.value.v[l]);
+}
+printf(" to Q\n");
+#endif
+					}			
+				}
+			}
+
+			j++;
+		}
+		else
+		{
+			M[j][j] = 0;
+		}
+	}
+
+	// h_star was too far off, the caller logs D
+	if (h > 2 * h_star)
+	{
+		goto abort;
+	}
+
+  // fprintf(stderr, "matrix complete, h=%d\n", h);
+  // fflush(stderr);
+
+	group_pow_clear(&gp);
+	QF(group_clear)(&group);
+
+	if (h != 1)
+	{
+		rank = j;
+
+#ifdef DEBUG
+printf("ANSWER:\n");
+for (int i = 0; i < rank; i++)
+{
+	for (int j = 0; j <= i; j++)
+	{
+		printf("%d ", M[i][j]);
+	}
+	printf("\n");
+}
+printf("Matrix before:\n");
+mat_print(M, rank);
+#endif
+
+		smith_normal_form(M, rank);
+
+#ifdef DEBUG
+printf("Matrix after:\n");
+mat_print(M, rank);
+#endif
+
+		j = 1;
+
+		for (int i = 0; i < rank; i++)
+		{
+			if (M[i][i] > 1)
+			{
+				result[j++] = M[i][i];
+			}
+		}
+	}
+	else
+	{
+		result[1] = 1;
+		j = 2;
+	}
+
+	stats->occupancy = MAX(stats->occupancy, (long) (oatab_size(R) + oatab_size(Q)));
+
+	oatab_empty(R);
+	oatab_empty(Q);
+	
+	result[0] = h;
+
+	mat_clear(M, MAX_RANK);
+
+	return (j - 1);
+
+	abort:
+#ifdef DEBUG
+printf("ABORTED: D=%ld, h=%d, h_star=%d\n", D, h, h_star);
+#endif
+	stats->aborted++;
+
+	group_pow_clear(&gp);
+	QF(group_clear)(&group);
+
+	oatab_empty(R);
+	oatab_empty(Q);
+
+	mat_clear(M, MAX_RANK);
+
+	return -1;
+}
@@ -1,17 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <math.h>
+#include <time.h>
 #include <sys/stat.h>
 #include <sys/time.h>
 
 #include "clgrp.h"
 #include "clgrp_ell.h"
 #include "functions.h"
+#include "gzio.h"
 
 #define MAX_LINE_LENGTH 1024
 #define MAX_INVARIANTS 20
+#define PROGRESS_RECORDS 4096          /* input records between progress reports */
 
 int verify_input_files_exist(const char *folder, int a, int m, long files)
 {
@@ -30,59 +34,99 @@ int verify_input_files_exist(const char *folder, int a, int m, long files)
     return 1;
 }
 
+/* The output of one ell while its input file is processed */
+typedef struct
+{
+    long ell;
+    char name[512];
+    gzout_t fd;
+    long ckpt[3];                       /* offset, input records done and carry */
+    long run[2];                        /* D_max / (files * m) and ell the checkpoint is of */
+    long lines;
+    long skip;                          /* input records already in the output */
+    int carry;                          /* dist of the abandoned records since the last line */
+} ell_out_t;
+
 void process_clgrp_file(const int index, const long D_total,
                         const char *folder, const int a, const int m,
-                        const long ell, const int * spf)
+                        const ell_list_t *ells)
 {
-    char input_cmd[512], output_name[512], output_dir[512];
-    char line[MAX_LINE_LENGTH], data[256];
-    FILE *infd, *outfd;
+    char input_name[512], output_dir[512];
+    char *out;
+    long record[MAX_INVARIANTS + 2];
+    int fields, e, r, count = 0;
+    long ell_max = 0;
+    gzin_t infd;
 
     struct timeval begin, end;
     unsigned long exec_time;
 
-    /* Check if compressed output file already exists and is valid */
-    sprintf(output_name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d.gz",
-            folder, a, m, ell, a, m, ell, index);
-    if (access(output_name, F_OK) != -1)
+    ell_out_t *outs = (ell_out_t *)malloc(ells->count * sizeof(ell_out_t));
+
+    for (e = 0; e < ells->count; e++)
     {
-        sprintf(input_cmd, "gzip -t %s", output_name);
-        if (system(input_cmd) == 0)
+        ell_out_t *o = outs + count;
+        o->ell = ells->ell[e];
+
+        /* Check if compressed output file already exists and is valid */
+        sprintf(o->name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d.gz",
+                folder, a, m, o->ell, a, m, o->ell, index);
+        if (access(o->name, F_OK) != -1)
         {
-            printf("Output file %s already exists, skipping.\n", output_name);
-            return;
+            if (gz_test(o->name))
+            {
+                printf("Output file %s already exists, skipping.\n", o->name);
+                continue;
+            }
+            /* Corrupt gz file from interrupted run, remove and reprocess */
+            fprintf(stderr, "Removing corrupt output file %s\n", o->name);
+            remove(o->name);
         }
-        /* Corrupt gz file from interrupted run, remove and reprocess */
-        fprintf(stderr, "Removing corrupt output file %s\n", output_name);
-        remove(output_name);
-    }
 
-    /* Remove any partial uncompressed output from a previous interrupted run */
-    sprintf(output_name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d",
-            folder, a, m, ell, a, m, ell, index);
-    if (access(output_name, F_OK) != -1)
-    {
-        remove(output_name);
+        /* Resume partial output from the last checkpoint of an interrupted
+         * run, the line after it counts the input records already processed */
+        sprintf(o->name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d",
+                folder, a, m, o->ell, a, m, o->ell, index);
+        o->run[0] = D_total;
+        o->run[1] = o->ell;
+        const int resume = ckpt_read(o->name, o->run, 2, o->ckpt, 3) && access(o->name, F_OK) != -1;
+        o->lines = 0;
+        o->skip = resume ? o->ckpt[1] : 0;
+        o->carry = resume ? o->ckpt[2] : 0;
+
+        sprintf(output_dir, "%s/cl%dmod%dl%ld", folder, a, m, o->ell);
+        mkdir(output_dir, 0744);
+        if (resume)
+        {
+            printf("Resuming %s from record %ld\n", o->name, o->ckpt[1]);
+            fflush(stdout);
+            gzout_resume(&o->fd, o->name, GZ_THREADED, o->ckpt[0]);
+        }
+        else
+        {
+            gzout_open(&o->fd, o->name, GZ_THREADED);
+            bjt_abort_reset(o->name, 0, LONG_MAX);
+        }
+
+        ell_max = (o->ell > ell_max) ? o->ell : ell_max;
+        count++;
     }
 
-    /* Open input file via gunzip */
-    sprintf(input_cmd, "gunzip -c %s/cl%dmod%d/cl%dmod%d.%d.gz",
-            folder, a, m, a, m, index);
-    infd = popen(input_cmd, "r");
-    if (infd == NULL)
+    if (count == 0)
     {
-        fprintf(stderr, "Unable to open input file for index %d\n", index);
+        free(outs);
         return;
     }
 
-
-
+    /* Open input file, it is inflated in-process and decoded once for all ells */
+    sprintf(input_name, "%s/cl%dmod%d/cl%dmod%d.%d.gz",
+            folder, a, m, a, m, index);
+    gzin_open(&infd, input_name);
 
     const long D_max = (index + 1) * D_total * m;
     // compute an upper bound on the size of the table
-    long h_max = h_upper_bound(-D_max * ell * ell * ell * ell);
+    long h_max = h_upper_bound(-D_max * ell_max * ell_max * ell_max * ell_max);
     int table_size = next_prime((((int) sqrt(h_max)) << 1) - 1);
-    // fprintf(stderr, "D_max: %ld, h_max: %ld, max prime: %ld\n", D_max, h_max, (((long) sqrt(h_max)) << 1) - 1);
     if (table_size == -1)
     {
         perror("Not enough primes in liboptarith/primes.h\n");
@@ -90,148 +134,116 @@ void process_clgrp_file(const int index, const long D_total,
         exit(1);
     }
 
-    htab_t R, Q;
-    htab_init(&R, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
-    htab_init(&Q, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
-    sprintf(output_dir, "%s/cl%dmod%dl%ld", folder, a, m, ell);
-    mkdir(output_dir, 0744);
-    sprintf(output_name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d",
-            folder, a, m, ell, a, m, ell, index);
-    outfd = fopen(output_name, "w");
-    if (outfd == NULL)
-    {
-        fprintf(stderr, "Unable to create output file %s\n", output_name);
-        pclose(infd);
-        return;
-    }
+    oatab_t R, Q, R_s128, Q_s128;
+    form_table_init(&R, table_size);
+    form_table_init(&Q, table_size);
+    bjt_tables_s128_init(&R_s128, &Q_s128, table_size);
+
+    bjt_stats_t stats;
+    bjt_stats_init(&stats);
 
     /* Calculate starting discriminant */
-    long D = (long)index * D_total * m + a;
+    const long D_file = (long)index * D_total * m + a;
+    long D = D_file, records = 0;
     int dist, h;
-    // int input_invariants[MAX_INVARIANTS];
-    int result[MAX_INVARIANTS];
-    int /*input_rank,*/ output_rank;
-    char kron;
+    int inv[MAX_INVARIANTS], row[MAX_INVARIANTS + 2];
     char output_line[MAX_LINE_LENGTH];
-    long D_sub;
-
-    int init_pow = 1, h_temp;
 
     gettimeofday(&begin, NULL);
+    time_t saved = time(NULL);
 
     /* Process each line */
-    while (fgets(line, MAX_LINE_LENGTH, infd) != NULL)
+    while ((fields = gzin_line(&infd, record, MAX_INVARIANTS + 2)) != 0)
     {
         /* Parse input line: dist h c1 c2 ... ct */
-        char *token = strtok(line, " \t\n");
-        if (token == NULL) continue;
-
-        dist = atoi(token);
-
-        token = strtok(NULL, " \t\n");
-        if (token == NULL) continue;
-        h = atoi(token);
-
-        // /* Parse invariant factors */
-        // input_rank = 0;
-        // while ((token = strtok(NULL, " \t\n")) != NULL && input_rank < MAX_INVARIANTS)
-        // {
-        //     input_invariants[input_rank++] = atoi(token);
-        // }
+        if (fields < 2) continue;
+        dist = (int)record[0];
+        h = (int)record[1];
+        for (r = 2; r < fields; r++)
+        {
+            inv[r - 2] = (int)record[r];
+        }
 
         /* Update discriminant */
         D += (long)dist * m;
 
-        /* Compute Kronecker symbol (D/ell) */
-        kron = kronecker_symbol(-D, ell);
-
-        D_sub = D;
-        if (kron == 0) {
-            // ramified
-            h *= ell;
-            D_sub *= ell * ell;
-        } else if (kron == -1) {
-            // inert
-            h *= (ell + 1) * ell;
-            D_sub *= ell * ell * ell * ell;
-        } else if (kron == 1) {
-            // split
-            h *= (ell - 1) * ell;
-            D_sub *= ell * ell * ell * ell;
+        for (e = 0; e < count; e++)
+        {
+            ell_out_t *o = outs + e;
+
+            /* Skip the records before the checkpoint of this ell */
+            if (o->lines < o->skip)
+            {
+                o->lines++;
+                continue;
+            }
+
+            /* The run that wrote the checkpoint may have logged the orders from here on */
+            if (o->lines == o->skip && o->skip > 0)
+            {
+                bjt_abort_reset(o->name, D, LONG_MAX);
+            }
+
+            /* Compute (D/ell) and the class structure of the order of index ell^2 */
+            o->lines++;
+            if (compute_group_ell(row, D, h, inv, fields - 2, o->ell, ells->spf, &R, &Q, &R_s128, &Q_s128, &stats) < 0)
+            {
+                /* Log the abandoned order, the next line spans its dist */
+                bjt_abort_log(o->name, D);
+                o->carry += dist;
+                continue;
+            }
+            out = output_line + ell_format(output_line, dist + o->carry, row);
+            o->carry = 0;
+
+            gzout_write(&o->fd, output_line, out - output_line);
         }
 
-        if (D == 4) {
-            h /= 2;
-        } else if (D == 3) {
-            h /= 3;
+        if (++records % PROGRESS_RECORDS == 0)
+        {
+            tab_progress(D, (D - D_file) / m + 1, D_total, &stats);
         }
-        
-        if (kron == 1) {
-            sprintf(output_line, "%d\t%d\t0\n", dist, (int)kron);
-        } else {
-        /* Compute class structure of order of index ell^2 */
-				init_pow = 1;
-				h_temp = h;
-				{
-					int h_rem = h;
-					while (h_rem > 1)
-					{
-						int p = spf[h_rem];
-						h_temp /= p;
-						do { h_rem /= p; } while (h_rem % p == 0);
-						if (h_temp % p != 0)
-						{
-							init_pow *= p;
-						}
-					}
-				}
-
-				h /= init_pow;
-        // fprintf(stderr, "DEBUG: init_pow=%d, h=%d\n", init_pow, h);
-        // fflush(stderr);
-        output_rank = compute_group_bjt(result, -D_sub, init_pow, h, ell, &R, &Q);
-        // fprintf(stderr, "output_rank: %d\n", output_rank);
-        // fflush(stderr);
-
-        h = result[0] * init_pow;
-        result[1] *= init_pow;
-
-
-
-        /* Format output line: dist kron c1 c2 ... ct */
-        sprintf(output_line, "%d\t%d\t", dist, (int)kron);
-        for (int r = 1; r < output_rank; r++)
+
+        if (time(NULL) - saved >= CKPT_SECONDS)
         {
-            // fprintf(stderr, "\t%d\n", result[r]);
-            // fflush(stderr);
-            sprintf(data, "%d ", result[r]);
-            strcat(output_line, data);
+            for (e = 0; e < count; e++)
+            {
+                /* The last checkpoint still holds until the skipped records are done */
+                if (outs[e].lines < outs[e].skip) continue;
+                outs[e].ckpt[0] = gzout_checkpoint(&outs[e].fd);
+                outs[e].ckpt[1] = outs[e].lines;
+                outs[e].ckpt[2] = outs[e].carry;
+                ckpt_write(outs[e].name, outs[e].run, 2, outs[e].ckpt, 3);
+            }
+            saved = time(NULL);
         }
-            // fprintf(stderr, "\t%d\n", result[output_rank]);
-            // fflush(stderr);
-        sprintf(data, "%d\n", result[output_rank]);
-        strcat(output_line, data);
-
-    			#ifdef WITH_PARI
-    			pari_verify(result + 1, -D_sub);
-    			#endif
-        } /* end kron != 1 */
-
-        fputs(output_line, outfd);
-        // fflush(outfd);
     }
 
-    pclose(infd);
-    fclose(outfd);
+    gzin_close(&infd);
 
-    /* Compress output file */
-    sprintf(input_cmd, "gzip %s", output_name);
-    system(input_cmd);
+    /* Finish the gzip streams and rename the outputs to .gz */
+    for (e = 0; e < count; e++)
+    {
+        gzout_close(&outs[e].fd);
+        ckpt_remove(outs[e].name);
+    }
 
-    htab_clear(&R);
-    htab_clear(&Q);
+    bjt_stats_add_table(&stats, &R);
+    bjt_stats_add_table(&stats, &Q);
+    oatab_clear(&R);
+    oatab_clear(&Q);
+    bjt_tables_s128_clear(&R_s128, &Q_s128);
     gettimeofday(&end, NULL);
     exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
-    printf("index=%d, a=%d, m=%d, ell=%ld, took %.3f\n", index, a, m, ell, exec_time / 1e6);
+    printf("index=%d, a=%d, m=%d, ell=%ld", index, a, m, outs[0].ell);
+    for (e = 1; e < count; e++)
+    {
+        printf(",%ld", outs[e].ell);
+    }
+    printf(", took %.3f\n", exec_time / 1e6);
+    sprintf(output_line, "index=%d, a=%d, m=%d", index, a, m);
+    bjt_stats_print(output_line, &stats);
     fflush(stdout);
+
+    free(outs);
 }
@@ -2,6 +2,7 @@
 #define CLGRP_ELL_H
 
 #include "functions.h"
+#include "clgrp.h"
 
 /*
  * Verify that all input files exist for the given parameters.
@@ -11,7 +12,8 @@ int verify_input_files_exist(const char *folder, int a, int m, long files);
 
 /*
  * Process a single clgrp input file and produce output with Kronecker symbols
- * and class structure of the order of index ell^2.
+ * and class structure of the order of index ell^2, for every ell in ells.
+ * The input is decoded once, ells whose output already exists are skipped.
  *
  * Parameters:
  *   index   - file index (0 to files-1)
@@ -19,10 +21,11 @@ int verify_input_files_exist(const char *folder, int a, int m, long files);
  *   folder  - base folder for input/output
  *   a       - congruence class (|D| = a mod m)
  *   m       - modulus
- *   ell     - prime for Kronecker symbol and order computation
+ *   ells    - primes for Kronecker symbol and order computation, with the
+ *             smallest prime factor table for the largest of them
  */
 void process_clgrp_file(const int index, const long D_total,
                         const char *folder, const int a, const int m,
-                        const long ell, const int * spf);
+                        const ell_list_t *ells);
 
 #endif /* CLGRP_ELL_H */
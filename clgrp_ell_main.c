@@ -10,14 +10,49 @@
 #include <pari/pari.h>
 #endif
 
+#include "clgrp.h"
 #include "clgrp_ell.h"
+#include "shared.h"
+#include "sched.h"
+#include "plan.h"
 
 static const int congruences[4][2] = {{3, 8}, {7, 8}, {4, 16}, {8, 16}};
 #define NUM_CONGRUENCES 4
 
 int main(int argc, char *argv[])
 {
-    MPI_Init(&argc, &argv);
+    /* The workers run the gzip threads, every MPI call stays on the main thread */
+    int provided;
+
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        fprintf(stderr, "The MPI library does not provide MPI_THREAD_FUNNELED\n");
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+
+    if (argc >= 2 && strcmp(argv[1], "--plan") == 0)
+    {
+        ell_list_t plan_ells;
+        int plan_rank;
+
+        if (argc != 8 || !ell_list_parse(&plan_ells, argv[4]))
+        {
+            fprintf(stderr, "Format: ./clgrp_ell --plan [D_max] [files] [ell] [nodes] [cores] [memory]\n");
+            fprintf(stderr, "\n");
+            fprintf(stderr, "  Prints the memory of a run on [nodes] nodes of [cores] cores and\n");
+            fprintf(stderr, "  [memory] GiB each, and the ranks per node to run with.\n");
+            MPI_Finalize();
+            exit(1);
+        }
+
+        MPI_Comm_rank(MPI_COMM_WORLD, &plan_rank);
+        const int ok = (plan_rank != 0) || plan_clgrp_ell(atol(argv[2]), atol(argv[3]), &plan_ells, atoi(argv[5]), atoi(argv[6]),
+                                                         atof(argv[7]) * 1024 * 1024 * 1024);
+        MPI_Finalize();
+        return !ok;
+    }
 
     if (argc != 5)
     {
@@ -25,15 +60,30 @@ int main(int argc, char *argv[])
         fprintf(stderr, "\n");
         fprintf(stderr, "  D_max  - maximum |discriminant|\n");
         fprintf(stderr, "  files  - number of input files (must divide D_max)\n");
-        fprintf(stderr, "  ell    - prime for Kronecker symbol and order computation\n");
+        fprintf(stderr, "  ell    - prime for Kronecker symbol and order computation, or a comma\n");
+        fprintf(stderr, "           separated list of them, e.g. 5,7,11, computed in one pass\n");
         fprintf(stderr, "  folder - base folder containing cl[a]mod[m]/ directories\n");
+        fprintf(stderr, "\n");
+        fprintf(stderr, "The progress of the workers is kept in [folder]/clgrp_ell.[ell].status.\n");
+        fprintf(stderr, "See ./clgrp_ell --plan for the ranks per node to run with.\n");
         MPI_Finalize();
         exit(1);
     }
 
     long D_max = atol(argv[1]);
     const long files = atol(argv[2]);
-    const long ell = atol(argv[3]);
+    ell_list_t ells;
+    if (!ell_list_parse(&ells, argv[3]))
+    {
+        fprintf(stderr, "ell should be a prime or a comma separated list of at most %d primes\n", MAX_ELLS);
+        MPI_Finalize();
+        exit(1);
+    }
+    long ell = 0;
+    for (int e = 0; e < ells.count; e++)
+    {
+        ell = (ells.ell[e] > ell) ? ells.ell[e] : ell;
+    }
     const char *folder = argv[4];
     const long total_work = NUM_CONGRUENCES * files;
 
@@ -42,12 +92,16 @@ int main(int argc, char *argv[])
 
     MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
 
+    /* The master takes no part in the node shared tables of the workers */
+    MPI_Comm workers;
+    MPI_Comm_split(MPI_COMM_WORLD, (myrank == 0) ? MPI_UNDEFINED : 0, myrank, &workers);
+
     if (myrank == 0)
     {
         /* Master process: verify input files and distribute work */
 
-        printf("clgrp_ell: D_max=%ld, files=%ld, ell=%ld, folder=%s\n",
-               D_max, files, ell, folder);
+        printf("clgrp_ell: D_max=%ld, files=%ld, ell=%s, folder=%s\n",
+               D_max, files, argv[3], folder);
         fflush(stdout);
 
         /* Verify all input files exist before starting */
@@ -75,6 +129,26 @@ int main(int argc, char *argv[])
             exit(1);
         }
 
+        const double start = sched_time();
+
+        /* Order the files by cost, the largest |D| first */
+        sched_job_t *jobs = (sched_job_t *)malloc(total_work * sizeof(sched_job_t));
+        for (long j = 0; j < total_work; j++)
+        {
+            int ci = j / files;
+            jobs[j].index = j % files;
+            jobs[j].part = -1;
+            jobs[j].a = congruences[ci][0];
+            jobs[j].m = congruences[ci][1];
+            jobs[j].cost = sqrt(h_upper_bound(-(jobs[j].index + 1) * D_max / files));
+        }
+        qsort(jobs, total_work, sizeof(sched_job_t), &sched_job_cmp);
+
+        char path[600];
+        sched_status_t status;
+        sprintf(path, "%s/clgrp_ell.%s.status", folder, argv[3]);
+        sched_status_init(&status, path, num_procs, jobs, total_work);
+
         int active_workers = 0;
 
         /* Send initial work to all workers */
@@ -82,11 +156,11 @@ int main(int argc, char *argv[])
         {
             if (j < total_work)
             {
-                int ci = j / files;
-                work_item[0] = j % files;
-                work_item[1] = congruences[ci][0];
-                work_item[2] = congruences[ci][1];
+                work_item[0] = jobs[j].index;
+                work_item[1] = jobs[j].a;
+                work_item[2] = jobs[j].m;
                 MPI_Send(work_item, 3, MPI_INT, j + 1, 0, MPI_COMM_WORLD);
+                sched_status_start(&status, j + 1, jobs + j);
                 active_workers++;
             }
             else
@@ -99,12 +173,12 @@ int main(int argc, char *argv[])
         /* Distribute remaining work as workers complete */
         for (long j = num_procs; j < total_work; j++)
         {
-            MPI_Recv(&idx, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-            int ci = j / files;
-            work_item[0] = j % files;
-            work_item[1] = congruences[ci][0];
-            work_item[2] = congruences[ci][1];
+            idx = sched_status_wait(&status, &idx, 1, MPI_INT);
+            work_item[0] = jobs[j].index;
+            work_item[1] = jobs[j].a;
+            work_item[2] = jobs[j].m;
             MPI_Send(work_item, 3, MPI_INT, idx, 0, MPI_COMM_WORLD);
+            sched_status_start(&status, idx, jobs + j);
         }
 
         /* Wait for all active workers to finish, then terminate them all
@@ -113,7 +187,7 @@ int main(int argc, char *argv[])
         int *finished = (int *)malloc(active_workers * sizeof(int));
         for (int i = 0; i < active_workers; i++)
         {
-            MPI_Recv(&finished[i], 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            finished[i] = sched_status_wait(&status, &finished[i], 1, MPI_INT);
         }
         for (int i = 0; i < active_workers; i++)
         {
@@ -121,6 +195,10 @@ int main(int argc, char *argv[])
             MPI_Send(term, 3, MPI_INT, finished[i], 0, MPI_COMM_WORLD);
         }
         free(finished);
+        free(jobs);
+
+        sched_status_clear(&status);
+        sched_report(num_procs, sched_time() - start);
 
         printf("All files processed.\n");
     }
@@ -132,24 +210,29 @@ int main(int argc, char *argv[])
 
         // Ramare's bound
         int h_max = (1/M_PI) * sqrt(D_max) * (0.5 * log(D_max) + 2.5 - log(6)) + 1;
+        // sized once for the largest ell
         h_max *= ell * (ell + 1);
 
-        // Smallest prime factor sieve
-        int *spf = (int *) malloc(h_max * sizeof(int));
-        for (int j = 0; j < h_max; j++) spf[j] = j;
-        for (int j = 2; (long)j * j < h_max; j++)
+        // Smallest prime factor sieve, built once per node
+        node_t node;
+        node_init(&node, workers);
+
+        MPI_Win spf_win;
+        int *spf = (int *) node_shared_alloc(&node, (size_t) h_max * sizeof(int), &spf_win);
+        if (node.leader)
         {
-            if (spf[j] == j)
-            {
-                for (int k = j * j; k < h_max; k += j)
-                {
-                    if (spf[k] == k) spf[k] = j;
-                }
-            }
+            spf_sieve(h_max, spf);
         }
+        node_shared_ready(&node);
+        ells.spf = spf;
 
         /* Worker process: receive work items and process them */
 
+        double busy = 0, begin;
+        int jobs = 0;
+
+        tab_progress_set(&sched_progress);
+
         MPI_Recv(work_item, 3, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
         while (work_item[0] != -1)
@@ -158,10 +241,21 @@ int main(int argc, char *argv[])
             int a = work_item[1];
             int m = work_item[2];
             long D_total = D_max / (files * m);
-            process_clgrp_file(file_idx, D_total, folder, a, m, ell, spf);
-            MPI_Send(&myrank, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+            begin = sched_time();
+            sched_progress_start(file_idx, -1, a, m);
+            process_clgrp_file(file_idx, D_total, folder, a, m, &ells);
+            busy += sched_time() - begin;
+            jobs++;
+            MPI_Send(&myrank, 1, MPI_INT, 0, SCHED_TAG_DONE, MPI_COMM_WORLD);
             MPI_Recv(work_item, 3, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
         }
+
+        sched_progress_flush();
+        sched_report_send(busy, jobs);
+
+        MPI_Win_free(&spf_win);
+        node_clear(&node);
+        MPI_Comm_free(&workers);
     }
 
     MPI_Finalize();
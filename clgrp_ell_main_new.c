@@ -1,6 +1,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -37,7 +38,8 @@ char *get_directory(const char *filepath) {
   return dir_path;
 }
 
-int process_file(long ell, int m, int a, int index, FILE *infd, FILE *outfd) {
+int process_file(long ell, int m, int a, int index, FILE *infd, FILE *outfd,
+                 const char *out_path) {
   int *primes;
   int **h_factors;
 
@@ -87,15 +89,13 @@ int process_file(long ell, int m, int a, int index, FILE *infd, FILE *outfd) {
     exit(1);
   }
 
-  htab_t R, Q;
-  htab_init(&R, table_size, sizeof(form_t), &hash_form_t, &eq_form_t,
-            &del_form_t);
-  htab_init(&Q, table_size, sizeof(form_t), &hash_form_t, &eq_form_t,
-            &del_form_t);
+  oatab_t R, Q;
+  form_table_init(&R, table_size);
+  form_table_init(&Q, table_size);
 
   /* Calculate starting discriminant */
   long D = (long)index * D_block + a;
-  int dist, h;
+  int dist, h, carry = 0;
   int input_invariants[MAX_INVARIANTS];
   int result[MAX_INVARIANTS];
   int input_rank, output_rank;
@@ -172,11 +172,19 @@ int process_file(long ell, int m, int a, int index, FILE *infd, FILE *outfd) {
     h /= init_pow;
     output_rank = compute_group_bjt(result, -D_sub, init_pow, h, ell, &R, &Q);
 
+    if (output_rank < 0) {
+      /* Log the abandoned order, the next line spans its dist */
+      bjt_abort_log(out_path, D);
+      carry += dist;
+      continue;
+    }
+
     h = result[0] * init_pow;
     result[1] *= init_pow;
 
     /* Format output line: dist kron c1 c2 ... ct */
-    sprintf(output_line, "%d\t%d\t", dist, (int)kron);
+    sprintf(output_line, "%d\t%d\t", dist + carry, (int)kron);
+    carry = 0;
     for (int r = 1; r < output_rank; r++) {
       sprintf(data, "%d ", result[r]);
       strcat(output_line, data);
@@ -189,8 +197,8 @@ int process_file(long ell, int m, int a, int index, FILE *infd, FILE *outfd) {
     break;
   }
 
-  htab_clear(&R);
-  htab_clear(&Q);
+  oatab_clear(&R);
+  oatab_clear(&Q);
 
   return 0;
 }
@@ -246,6 +254,8 @@ int main(int argc, char *argv[]) {
       pclose(infd);
       exit(1);
     }
+    /* The file starts from scratch, as do its abandoned orders */
+    bjt_abort_reset(output_path, 0, LONG_MAX);
 
     /* Print information before starting */
     printf("clgrp_ell_new: ℓ=%ld,    |d|≡%d (mod %d),    %d⋅2²⁸≤|d|<%d⋅2²⁸\n",
@@ -258,7 +268,7 @@ int main(int argc, char *argv[]) {
     gettimeofday(&begin, NULL);
     
     /* Run */
-    process_file(ell, m, a, index, infd, outfd);
+    process_file(ell, m, a, index, infd, outfd, output_path);
 
     /* Timing results */
     gettimeofday(&end, NULL);
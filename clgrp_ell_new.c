@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <unistd.h>
 #include <math.h>
 #include <sys/stat.h>
@@ -75,9 +76,9 @@ void process_clgrp_file(const int index, const long D_total,
         exit(1);
     }
 
-    htab_t R, Q;
-    htab_init(&R, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
-    htab_init(&Q, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
+    oatab_t R, Q;
+    form_table_init(&R, table_size);
+    form_table_init(&Q, table_size);
     sprintf(output_dir, "%s/cl%dmod%dl%ld", folder, a, m, ell);
     mkdir(output_dir, 0744);
     sprintf(output_name, "%s/cl%dmod%dl%ld/cl%dmod%dl%ld.%d",
@@ -89,10 +90,12 @@ void process_clgrp_file(const int index, const long D_total,
         pclose(infd);
         return;
     }
+    /* The file starts from scratch, as do its abandoned orders */
+    bjt_abort_reset(output_name, 0, LONG_MAX);
 
     /* Calculate starting discriminant */
     long D = (long)index * D_total * m + a;
-    int dist, h;
+    int dist, h, carry = 0;
     // int input_invariants[MAX_INVARIANTS];
     int result[MAX_INVARIANTS];
     int /*input_rank,*/ output_rank;
@@ -179,13 +182,22 @@ void process_clgrp_file(const int index, const long D_total,
         // fprintf(stderr, "output_rank: %d\n", output_rank);
         // fflush(stderr);
 
+        if (output_rank < 0)
+        {
+            /* Log the abandoned order, the next line spans its dist */
+            bjt_abort_log(output_name, D);
+            carry += dist;
+            continue;
+        }
+
         h = result[0] * init_pow;
         result[1] *= init_pow;
         
 
 
         /* Format output line: dist kron c1 c2 ... ct */
-        sprintf(output_line, "%d\t%d\t", dist, (int)kron);
+        sprintf(output_line, "%d\t%d\t", dist + carry, (int)kron);
+        carry = 0;
         for (int r = 1; r < output_rank; r++)
         {
             // fprintf(stderr, "\t%d\n", result[r]);
@@ -213,8 +225,8 @@ void process_clgrp_file(const int index, const long D_total,
     sprintf(input_cmd, "gzip %s", output_name);
     system(input_cmd);
 
-    htab_clear(&R);
-    htab_clear(&Q);
+    oatab_clear(&R);
+    oatab_clear(&Q);
     gettimeofday(&end, NULL);
     exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
     printf("index=%d, ell=%ld, took %.3f\n", index, ell, exec_time / 1e6);
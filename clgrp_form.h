@@ -0,0 +1,94 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+// Included by clgrp.h once per form width, with
+//   QF(x)       the libqform name x of the width
+//   QF_NAME(x)  the clgrp name x of the width
+// the s64 records being form_t, hash_form_t, ..., form_table_insert.
+// There is no include guard.
+
+// FORM
+
+typedef struct
+{
+	QF(t) form;
+	evec_t value;		// for hash table
+} QF_NAME(form_t);
+
+// form is the first member, so both also work on bare form keys
+static __inline__
+int QF_NAME(hash_form_t)(const void * a)
+{
+	return (int) ((QF_NAME(form_t) *) a)->form.a;
+}
+
+static __inline__
+int QF_NAME(eq_form_t)(const void * a, const void * b)
+{
+	QF(t) * t = (QF(t) *) a;
+	QF(t) * s = &((QF_NAME(form_t) *) b)->form;
+	return ((t->a == s->a) && (t->b == s->b));
+}
+
+
+// FORM TABLE
+// By default R and Q store form_t items. With -DWITH_SOA_FORMS the forms
+// are kept in the key arena and the exponent vectors in the payload arena,
+// so that the probes of the giant steps only touch the forms.
+
+static __inline__
+void QF_NAME(form_table_init)(oatab_t * t, const size_t size)
+{
+#ifdef WITH_SOA_FORMS
+	oatab_init_soa(t, size, sizeof(QF(t)), sizeof(evec_t), &QF_NAME(hash_form_t), &QF_NAME(eq_form_t));
+#else
+	oatab_init(t, size, sizeof(QF_NAME(form_t)), &QF_NAME(hash_form_t), &QF_NAME(eq_form_t), NULL);
+#endif
+}
+
+static __inline__
+QF(t) * QF_NAME(form_table_form)(const oatab_t * t, const long i)
+{
+#ifdef WITH_SOA_FORMS
+	return (QF(t) *) oatab_get(t, i);
+#else
+	return &((QF_NAME(form_t) *) oatab_get(t, i))->form;
+#endif
+}
+
+static __inline__
+evec_t * QF_NAME(form_table_value)(const oatab_t * t, const long i)
+{
+#ifdef WITH_SOA_FORMS
+	return (evec_t *) oatab_payload(t, i);
+#else
+	return &((QF_NAME(form_t) *) oatab_get(t, i))->value;
+#endif
+}
+
+static __inline__
+void QF_NAME(form_table_insert)(oatab_t * t, const QF_NAME(form_t) * f)
+{
+#ifdef WITH_SOA_FORMS
+	oatab_insert_soa(t, &f->form, &f->value);
+#else
+	oatab_insert(t, f);
+#endif
+}
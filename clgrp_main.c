@@ -39,14 +39,55 @@
 
 #include "clgrp.h"
 #include "sieve.h"
+#include "shared.h"
+#include "sched.h"
+#include "plan.h"
 
 int main(int argc, char * argv[])
 {
-	MPI_Init(&argc, &argv);
+	// the workers run the tabulation threads, the sieve producer and the gzip
+	// threads, every MPI call stays on the main thread
+	int provided;
 
-	if (argc != 7)
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+	if (provided < MPI_THREAD_FUNNELED)
+	{
+		perror("The MPI library does not provide MPI_THREAD_FUNNELED\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	int i, myrank;
+
+	MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+
+	if (argc >= 2 && strcmp(argv[1], "--plan") == 0)
+	{
+		if (argc != 7)
+		{
+			perror("Format: ./clgrp --plan [D_max] [ells] [nodes] [cores] [memory]\nPrints the files, block size, ranks per node and threads to run with on [nodes] nodes\nof [cores] cores and [memory] GiB each, set ells to \"null\" if there are none.\n");
+			exit(1);
+		}
+
+		ell_list_t ell_list;
+
+		if (strcmp(argv[3], "null") != 0 && !ell_list_parse(&ell_list, argv[3]))
+		{
+			perror("ells should be a comma separated list of at most 8 primes.\n");
+			exit(1);
+		}
+
+		const int ok = (myrank != 0) || plan_clgrp(atol(argv[2]), (strcmp(argv[3], "null") != 0) ? &ell_list : NULL, atoi(argv[4]), atoi(argv[5]),
+								atof(argv[6]) * 1024 * 1024 * 1024);
+
+		MPI_Finalize();
+
+		return !ok;
+	}
+
+	if (argc < 7 || argc > 10)
 	{
-		perror("Format: mpirun -np [#procs] ./clgrp [D_max] [files] [a] [m] [h_prefix] [folder] [D_total]\nSet h_prefix to \"null\" if class numbers were not precomputed.\n");
+		perror("Format: mpirun -np [#procs] ./clgrp [D_max] [files] [a] [m] [h_prefix] [folder] [threads] [ells] [block]\nSet h_prefix to \"null\" if class numbers were not precomputed.\nEach worker rank runs [threads] threads, 1 by default.\nWith a comma separated list of primes [ells], e.g. 3,5,7, the orders of index ell^2\nare tabulated in the same pass into [folder]/cl[a]mod[m]l[ell], as clgrp_ell would, \"null\" for none.\nThe sieve takes blocks of [block] discriminants, 1048576 by default.\nThe progress of the workers is kept in [folder]/cl[a]mod[m].status.\nSee ./clgrp --plan for the files, threads and block size to run with.\n");
 		exit(1);
 	}
 
@@ -57,18 +98,50 @@ int main(int argc, char * argv[])
 	const char * h_prefix = argv[5];
 	const char * folder = argv[6];
 	const long D_total = D_max / (files * m);
+	const int threads = (argc >= 8) ? atoi(argv[7]) : 1;
+
+	if (threads < 1)
+	{
+		perror("threads should be positive.\n");
+		exit(1);
+	}
+
+	ell_list_t ell_list, * ells = NULL;
+
+	if (argc >= 9 && strcmp(argv[8], "null") != 0)
+	{
+		if (!ell_list_parse(&ell_list, argv[8]))
+		{
+			perror("ells should be a comma separated list of at most 8 primes.\n");
+			exit(1);
+		}
+
+		ells = &ell_list;
+	}
+
+	const long block = (argc == 10) ? atol(argv[9]) : FAC_TOTAL;
+
+	if (block < 1)
+	{
+		perror("block should be positive.\n");
+		exit(1);
+	}
+
+	tab_block_set(block);
 
 	int * primes;
-	int ** h_factors;
+	factors_t h_factors;
 
 	if (strcmp(h_prefix, "null") == 0)
 	{
 		h_prefix = NULL;
 	}
 
-	int i, myrank, idx = 0;
+	// the master takes no part in the node shared tables of the workers
+	MPI_Comm workers;
+	MPI_Comm_split(MPI_COMM_WORLD, (myrank == 0) ? MPI_UNDEFINED : 0, myrank, &workers);
 
-	MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+	const int parts = bjt_parts(D_total);
 
 	if (myrank == 0)
 	{
@@ -76,21 +149,104 @@ int main(int argc, char * argv[])
 		MPI_Comm_size(MPI_COMM_WORLD, &num_procs);
 		num_procs--;
 
+		const double start = sched_time();
+
+		// a file in several parts is stitched by the worker that finishes its last part
+		const int total = files * parts;
+		sched_job_t * jobs = (sched_job_t *) malloc(total * sizeof(sched_job_t));
+		int * left = (int *) malloc(files * sizeof(int));
+		int * stitch = (int *) malloc(files * sizeof(int));
+		int * idle = (int *) malloc(num_procs * sizeof(int));
+		int job[2], done[3], next = 0, stitches = 0, idles = 0, busy = 0;
+
+		for (i = 0; i < total; i++)
+		{
+			const int part = i % parts;
+			const long first = (long) part * PART_TOTAL;
+			const long last = MIN(first + PART_TOTAL, D_total);
+
+			jobs[i].index = i / parts;
+			jobs[i].part = (parts == 1) ? -1 : part;
+			jobs[i].a = a;
+			jobs[i].m = m;
+			jobs[i].cost = (last - first) * sqrt(h_upper_bound(-(jobs[i].index * D_total + last) * m));
+		}
+
+		qsort(jobs, total, sizeof(sched_job_t), &sched_job_cmp);
+
+		char path[600];
+		sched_status_t status;
+		sched_job_t stitching = { 0, -2, a, m, 0 };
+
+		sprintf(path, "%s/cl%dmod%d.status", folder, a, m);
+		sched_status_init(&status, path, num_procs, jobs, total);
+
+		#ifndef WITH_CONTAINER_OUTPUT
+		status.jobs += (parts > 1) ? files : 0;
+		#endif
+
+		for (i = 0; i < files; i++)
+		{
+			left[i] = parts;
+		}
+
 		for (i = 0; i < num_procs; i++)
 		{
-			MPI_Send(&i, 1, MPI_INT, i + 1, 0, MPI_COMM_WORLD);
+			idle[idles++] = num_procs - i;
 		}
 
-		for (i = num_procs; i < files; i++)
+		while (idles > 0 || busy > 0)
 		{
-			MPI_Recv (&idx, 1, MPI_INT, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-			MPI_Send(&i, 1, MPI_INT, idx, 0, MPI_COMM_WORLD);
+			// hand out stitches first, then the most expensive parts
+			while (idles > 0 && (stitches > 0 || next < total))
+			{
+				if (stitches > 0)
+				{
+					job[0] = stitching.index = stitch[--stitches];
+					job[1] = -2;
+					sched_status_start(&status, idle[idles - 1], &stitching);
+				}
+				else
+				{
+					job[0] = jobs[next].index;
+					job[1] = jobs[next].part;
+					sched_status_start(&status, idle[idles - 1], jobs + next++);
+				}
+
+				MPI_Send(job, 2, MPI_INT, idle[--idles], 0, MPI_COMM_WORLD);
+				busy++;
+			}
+
+			if (busy == 0)
+			{
+				break;
+			}
+
+			sched_status_wait(&status, done, 3, MPI_INT);
+			busy--;
+			idle[idles++] = done[0];
+
+			// in a container the parts stay segments of their own, clc2gz stitches them
+			#ifndef WITH_CONTAINER_OUTPUT
+			if (done[2] >= 0 && --left[done[1]] == 0)
+			{
+				stitch[stitches++] = done[1];
+			}
+			#endif
 		}
 
-		for (i = 0, idx = -1; i < num_procs; i++)
+		for (i = 1, job[0] = -1; i <= num_procs; i++)
 		{
-			MPI_Send(&idx, 1, MPI_INT, i + 1, 0, MPI_COMM_WORLD);
+			MPI_Send(job, 2, MPI_INT, i, 0, MPI_COMM_WORLD);
 		}
+
+		sched_status_clear(&status);
+		sched_report(num_procs, sched_time() - start);
+
+		free(jobs);
+		free(left);
+		free(stitch);
+		free(idle);
 	}
 	else
 	{
@@ -98,6 +254,11 @@ int main(int argc, char * argv[])
 		pari_init(1000000, 0);
 		#endif
 
+		node_t node;
+		node_init(&node, workers);
+
+		MPI_Win h_win;
+
 		long D_root = sqrt(D_max);
 
 		primes = (int *) malloc(((int) (1.25506 * D_root / log(D_root))) * sizeof(int));
@@ -111,7 +272,7 @@ int main(int argc, char * argv[])
 
 		if (h_prefix)
 		{
-			h_list = (int *) malloc(FAC_TOTAL * sizeof(int));
+			h_list = (int *) malloc(block * sizeof(int));
 
 			// Ramare's bound
 			h_max = (1/M_PI) * sqrt(D_max) * (0.5 * log(D_max) + 2.5 - log(6)) + 1;
@@ -123,14 +284,17 @@ int main(int argc, char * argv[])
 			}
 
 			const int h_max_factors = i;
-			h_factors = (int **) malloc(h_max * sizeof(int *));
 
-			for (i = 0; i < h_max; i++)
+			// one copy of the sieve per node
+			int * h_table = (int *) node_shared_alloc(&node, (size_t) h_max * h_max_factors * sizeof(int), &h_win);
+			factors_wrap(&h_factors, h_table, h_max, h_max_factors);
+
+			if (node.leader)
 			{
-				h_factors[i] = (int *) malloc(h_max_factors * sizeof(int));
+				regular_sieve(h_max, h_max, &h_factors, primes, 0);
 			}
 
-			regular_sieve(h_max, h_max, h_factors, primes, 0);
+			node_shared_ready(&node);
 		}
 
 		// compute maximal number of prime factors of a discriminant
@@ -143,46 +307,120 @@ int main(int argc, char * argv[])
 
 		const int size = i - ((a & 3) != 0) + 1;
 
-		int ** factors = (int **) malloc(FAC_TOTAL * sizeof(int *));
+		factors_t factors;
+		factors_init(&factors, block, size);
 
-		for (i = 0; i < FAC_TOTAL; i++)
+		// the smallest prime factors of the class numbers of the orders of index ell^2
+		MPI_Win spf_win;
+
+		if (ells)
 		{
-			factors[i] = (int *) malloc(size * sizeof(int));
+			long ell_max = 0;
+
+			for (i = 0; i < ells->count; i++)
+			{
+				ell_max = MAX(ell_max, ells->ell[i]);
+			}
+
+			// Ramare's bound
+			const int spf_max = ((int) ((1/M_PI) * sqrt(D_max) * (0.5 * log(D_max) + 2.5 - log(6)) + 1)) * ell_max * (ell_max + 1);
+
+			int * spf = (int *) node_shared_alloc(&node, (size_t) spf_max * sizeof(int), &spf_win);
+
+			if (node.leader)
+			{
+				spf_sieve(spf_max, spf);
+			}
+
+			node_shared_ready(&node);
+			ells->spf = spf;
 		}
 
-		MPI_Recv(&idx, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+		#ifdef WITH_CONTAINER_OUTPUT
+		// one container for the class and one for each ell, shared by all of the workers
+		const int containers = 1 + (ells ? ells->count : 0);
+		clcout_t * out = (clcout_t *) malloc(containers * sizeof(clcout_t));
+
+		clcout_open(out, workers, folder, a, m, 0, D_total);
 
-		while (idx != -1)
+		for (i = 1; i < containers; i++)
 		{
-			tabulate_bjt(idx, D_total, h_prefix, folder, a, m, primes, h_factors, factors, h_list);
-			MPI_Send(&myrank, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-			MPI_Recv(&idx, 1, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			clcout_open(out + i, workers, folder, a, m, ells->ell[i - 1], D_total);
 		}
 
-		free(primes);
+		tabulate_bjt_containers(out);
+		#endif
 
-		if (h_prefix)
+		// job[1] is the part, -1 for a whole file and -2 to stitch the parts
+		int job[2], done[3], jobs = 0;
+		double busy = 0, begin;
+
+		tab_progress_set(&sched_progress);
+
+		MPI_Recv(job, 2, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+
+		while (job[0] != -1)
 		{
-			for (long i = 0; i < h_max; i++)
+			begin = sched_time();
+			sched_progress_start(job[0], job[1], a, m);
+
+			if (job[1] == -1)
 			{
-				free(h_factors[i]);
+				tabulate_bjt(job[0], D_total, h_prefix, folder, a, m, primes, &h_factors, &factors, h_list, threads, ells);
+			}
+			else if (job[1] == -2)
+			{
+				stitch_bjt(job[0], D_total, h_prefix, folder, a, m, ells);
+			}
+			else
+			{
+				tabulate_bjt_part(job[0], job[1], D_total, h_prefix, folder, a, m, primes, &h_factors, &factors, h_list, threads, ells);
 			}
 
-			free(h_factors);
-			free(h_list);
+			busy += sched_time() - begin;
+			jobs++;
+
+			done[0] = myrank;
+			done[1] = job[0];
+			done[2] = job[1];
+			MPI_Send(done, 3, MPI_INT, 0, SCHED_TAG_DONE, MPI_COMM_WORLD);
+			MPI_Recv(job, 2, MPI_INT, 0, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 		}
 
+		sched_progress_flush();
+		sched_report_send(busy, jobs);
 
-		for (int i = 0; i < FAC_TOTAL; i++)
+		#ifdef WITH_CONTAINER_OUTPUT
+		for (i = 0; i < containers; i++)
 		{
-			free(factors[i]);
+			clcout_close(out + i);
 		}
 
-		free(factors);
+		free(out);
+		#endif
+
+		free(primes);
+
+		if (h_prefix)
+		{
+			factors_clear(&h_factors);
+			free(h_list);
+			MPI_Win_free(&h_win);
+		}
+
+		factors_clear(&factors);
+
+		if (ells)
+		{
+			MPI_Win_free(&spf_win);
+		}
 
 		#ifdef WITH_PARI
 		pari_close();
 		#endif
+
+		node_clear(&node);
+		MPI_Comm_free(&workers);
 	}
 
 	MPI_Finalize();
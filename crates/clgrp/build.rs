@@ -0,0 +1,18 @@
+// Links libclgrp.a for the `ffi` feature, see src/ffi.rs.
+fn main() {
+    println!("cargo:rerun-if-changed=build.rs");
+
+    if std::env::var_os("CARGO_FEATURE_FFI").is_none() {
+        return;
+    }
+
+    println!("cargo:rerun-if-env-changed=CLGRP_LIB_DIR");
+    if let Some(dir) = std::env::var_os("CLGRP_LIB_DIR") {
+        println!("cargo:rustc-link-search=native={}", dir.to_string_lossy());
+    }
+
+    println!("cargo:rustc-link-lib=static=clgrp");
+    for lib in ["qform", "optarith", "gmp", "z", "pthread", "m"] {
+        println!("cargo:rustc-link-lib={lib}");
+    }
+}
@@ -0,0 +1,125 @@
+//! Class groups of many discriminants at once, over all cores.
+//!
+//! With the `ffi` feature the groups come from the C engine of libclgrp, see
+//! `crate::ffi`, otherwise from the port in `crate::bjt`, so that the analysis
+//! binaries run the same code either way.
+
+use crate::bjt::{BjtError, BjtResult};
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::thread;
+
+/// The arguments of one `compute_group_bjt` call.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct BjtQuery {
+    pub discriminant: i64,
+    pub init_pow: i32,
+    pub h_star: i32,
+    pub ell: i32,
+}
+
+impl BjtQuery {
+    /// The whole group of `discriminant`, given a lower bound on its class number.
+    pub fn new(discriminant: i64, h_star: i32) -> Self {
+        Self {
+            discriminant,
+            init_pow: 1,
+            h_star,
+            ell: 0,
+        }
+    }
+}
+
+// Queries a thread takes at a time. Small enough that a block of slow
+// discriminants does not leave the other threads idle at the end.
+const BATCH_BLOCK: usize = 256;
+
+/// `compute_group_bjt` of each query, in the order of `queries`, on `threads`
+/// threads, one per core if `threads` is 0. Each thread keeps its tables for
+/// all of the blocks it takes.
+///
+/// ```no_run
+/// use clgrp::batch::{compute_group_bjt_batch, BjtQuery};
+///
+/// let queries: Vec<_> = (3..100_000_i64)
+///     .filter(|d| d % 4 == 0 || d % 4 == 3)
+///     .map(|d| BjtQuery::new(-d, 1))
+///     .collect();
+/// for (query, result) in queries.iter().zip(compute_group_bjt_batch(&queries, 0)) {
+///     println!("{} {:?}", query.discriminant, result?.invariants);
+/// }
+/// # Ok::<(), clgrp::bjt::BjtError>(())
+/// ```
+pub fn compute_group_bjt_batch(
+    queries: &[BjtQuery],
+    threads: usize,
+) -> Vec<Result<BjtResult, BjtError>> {
+    let blocks = queries.len().div_ceil(BATCH_BLOCK);
+    let threads = match threads {
+        0 => thread::available_parallelism().map_or(1, |n| n.get()),
+        n => n,
+    }
+    .min(blocks)
+    .max(1);
+    let d_max = queries
+        .iter()
+        .map(|query| query.discriminant.unsigned_abs())
+        .max()
+        .unwrap_or(0)
+        .min(i64::MAX as u64) as i64;
+    let next = AtomicUsize::new(0);
+
+    let mut done: Vec<(usize, Vec<Result<BjtResult, BjtError>>)> = thread::scope(|scope| {
+        let handles: Vec<_> = (0..threads)
+            .map(|_| {
+                scope.spawn(|| {
+                    let mut engine = Engine::new(d_max);
+                    let mut done = Vec::new();
+                    loop {
+                        let block = next.fetch_add(1, Ordering::Relaxed);
+                        if block >= blocks {
+                            return done;
+                        }
+                        let start = block * BATCH_BLOCK;
+                        let end = (start + BATCH_BLOCK).min(queries.len());
+                        done.push((block, engine.compute(&queries[start..end])));
+                    }
+                })
+            })
+            .collect();
+
+        handles
+            .into_iter()
+            .flat_map(|handle| handle.join().expect("batch worker panicked"))
+            .collect()
+    });
+
+    done.sort_unstable_by_key(|(block, _)| *block);
+    done.into_iter().flat_map(|(_, results)| results).collect()
+}
+
+#[cfg(feature = "ffi")]
+type Engine = crate::ffi::ClgrpBatch;
+
+#[cfg(not(feature = "ffi"))]
+struct Engine;
+
+#[cfg(not(feature = "ffi"))]
+impl Engine {
+    fn new(_d_max: i64) -> Self {
+        Self
+    }
+
+    fn compute(&mut self, queries: &[BjtQuery]) -> Vec<Result<BjtResult, BjtError>> {
+        queries
+            .iter()
+            .map(|query| {
+                crate::bjt::compute_group_bjt(
+                    query.discriminant,
+                    query.init_pow,
+                    query.h_star,
+                    query.ell,
+                )
+            })
+            .collect()
+    }
+}
@@ -1,4 +1,4 @@
-use clgrp::bjt::compute_group_bjt;
+use clgrp::batch::{BjtQuery, compute_group_bjt_batch};
 use malachite::base::num::arithmetic::traits::KroneckerSymbol;
 use malachite::integer::Integer;
 use qform::S64Group;
@@ -209,6 +209,7 @@ fn main() {
 
     let pdivs = prime_divisors(n);
 
+    let mut pending = Vec::with_capacity(PENDING);
     let mut abs_d: i64 = 3;
     while abs_d <= bound {
         let d = -abs_d;
@@ -247,21 +248,40 @@ fn main() {
         }
 
         if exact {
-            let h_star = h_lower_bound(d, &primes);
-            match compute_group_bjt(d, 1, h_star, 0) {
-                Ok(result) => {
-                    let invariants: Vec<String> =
-                        result.invariants.iter().map(|x| x.to_string()).collect();
-                    println!("{}\t{}\t[{}]", d, result.h, invariants.join(", "));
-                }
-                Err(e) => {
-                    eprintln!("D={}: bjt failed: {}", d, e);
-                }
+            pending.push(BjtQuery::new(d, h_lower_bound(d, &primes)));
+            if pending.len() == PENDING {
+                print_groups(&pending);
+                pending.clear();
             }
         }
 
         abs_d = next_abs_d(abs_d);
     }
+
+    print_groups(&pending);
+}
+
+// Discriminants whose groups are computed together, on all cores.
+const PENDING: usize = 1 << 14;
+
+fn print_groups(queries: &[BjtQuery]) {
+    for (query, result) in queries.iter().zip(compute_group_bjt_batch(queries, 0)) {
+        match result {
+            Ok(result) => {
+                let invariants: Vec<String> =
+                    result.invariants.iter().map(|x| x.to_string()).collect();
+                println!(
+                    "{}\t{}\t[{}]",
+                    query.discriminant,
+                    result.h,
+                    invariants.join(", ")
+                );
+            }
+            Err(e) => {
+                eprintln!("D={}: bjt failed: {}", query.discriminant, e);
+            }
+        }
+    }
 }
 
 /// Advance abs_d to the next value where -abs_d ≡ 0 or 1 (mod 4).
@@ -1,5 +1,6 @@
 use std::collections::{BTreeMap, BTreeSet, HashMap, HashSet};
 
+use clgrp::batch::{BjtQuery, compute_group_bjt_batch};
 use clgrp::bjt::compute_group_bjt;
 use malachite::base::num::arithmetic::traits::KroneckerSymbol;
 use malachite::integer::Integer;
@@ -428,12 +429,43 @@ fn main() {
     let primes = sieve_primes(sieve_limit);
 
     let bound = bound(max_n);
-    let discs = Discriminants::new()
-        .take_while(|d| d.abs() <= bound)
-        .map(|d| {
-            let h_star = h_lower_bound(d, &primes);
-            let result = compute_group_bjt(d, 1, h_star, 0).unwrap();
-            (d, result.h, result.invariants)
+    let mut discs = BTreeMap::<u64, HashSet<Structure>>::new();
+    let mut pending = Vec::with_capacity(PENDING);
+    for d in Discriminants::new().take_while(|d| d.abs() <= bound) {
+        pending.push(BjtQuery::new(d, h_lower_bound(d, &primes)));
+        if pending.len() == PENDING {
+            add_orders(&mut discs, &pending, max_n);
+            pending.clear();
+        }
+    }
+    add_orders(&mut discs, &pending, max_n);
+
+    discs.iter().for_each(|entry| {
+        println!("n = {}", entry.0);
+        let mut sorted: Vec<_> = entry.1.iter().collect();
+        sorted.sort_by(|a, b| a.exp.cmp(&b.exp).then_with(|| a.d0.cmp(&b.d0)));
+        for s in sorted {
+            println!("  ({}, {})\t{:?}", s.exp, s.d0, s);
+        }
+    });
+}
+
+// Discriminants whose groups are computed together, on all cores.
+const PENDING: usize = 1 << 14;
+
+/// Computes the groups of a batch of queries and adds the structures of
+/// those with an element of order 4 and a prime above 2 of order at most
+/// `max_n` to `discs`, by order.
+fn add_orders(discs: &mut BTreeMap<u64, HashSet<Structure>>, queries: &[BjtQuery], max_n: u64) {
+    queries
+        .iter()
+        .zip(compute_group_bjt_batch(queries, 0))
+        .filter_map(|(query, result)| match result {
+            Ok(result) => Some((query.discriminant, result.h, result.invariants)),
+            Err(e) => {
+                eprintln!("D={}: bjt failed: {}", query.discriminant, e);
+                None
+            }
         })
         // filter out things that don't have an element of order 4
         .filter(|(_, _, invariants)| invariants.iter().any(|i| i % 4 == 0))
@@ -463,20 +495,10 @@ fn main() {
         // d_0 is first d where the exponent increased (i.e. exp at d_0 = 2 * exp at (d_0 - 1)).
         //
         // Group unique structures by order.
-        .fold(
-            BTreeMap::<u64, HashSet<Structure>>::new(),
-            |mut map, entry| {
-                map.entry(entry.order).or_default().insert(entry.structure);
-                map
-            },
-        );
-
-    discs.iter().for_each(|entry| {
-        println!("n = {}", entry.0);
-        let mut sorted: Vec<_> = entry.1.iter().collect();
-        sorted.sort_by(|a, b| a.exp.cmp(&b.exp).then_with(|| a.d0.cmp(&b.d0)));
-        for s in sorted {
-            println!("  ({}, {})\t{:?}", s.exp, s.d0, s);
-        }
-    });
+        .for_each(|entry| {
+            discs
+                .entry(entry.order)
+                .or_default()
+                .insert(entry.structure);
+        });
 }
@@ -19,6 +19,7 @@ pub enum BjtError {
     MaxRankExceeded { rank: usize, max_rank: usize },
     TableIndexOutOfBounds { index: usize, len: usize },
     Overflow(&'static str),
+    Abandoned { discriminant: i64 },
 }
 
 impl Display for BjtError {
@@ -38,6 +39,12 @@ impl Display for BjtError {
                 write!(f, "table index {index} out of bounds for length {len}")
             }
             Self::Overflow(msg) => write!(f, "arithmetic overflow: {msg}"),
+            Self::Abandoned { discriminant } => {
+                write!(
+                    f,
+                    "D={discriminant} abandoned, over the operation budget or h > 2 * h_star"
+                )
+            }
         }
     }
 }
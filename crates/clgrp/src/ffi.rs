@@ -0,0 +1,220 @@
+//! Bindings to the batch entry point of libclgrp, `bjt_batch_compute` in
+//! `clgrp.h`, with the `ffi` feature. The build links `libclgrp.a` from
+//! `CLGRP_LIB_DIR`, or else from the default library path, along with
+//! libqform, liboptarith, GMP and zlib.
+//!
+//! The C engine exits the process on a discriminant wider than the s64 forms
+//! of libqform hold, unless libclgrp was built with `-DWITH_S128_QFORMS`.
+
+use crate::batch::BjtQuery;
+use crate::bjt::{BjtError, BjtResult, MAX_RANK};
+use std::os::raw::{c_int, c_long};
+use std::ptr::NonNull;
+
+// the stride of the results, as in clgrp.h
+const BJT_BATCH_ROW: usize = MAX_RANK + 1;
+
+#[repr(C)]
+struct RawBatch {
+    _private: [u8; 0],
+}
+
+unsafe extern "C" {
+    fn bjt_batch_new(d_max: c_long) -> *mut RawBatch;
+    fn bjt_batch_free(b: *mut RawBatch);
+    fn bjt_batch_compute(
+        b: *mut RawBatch,
+        rank: *mut c_int,
+        out: *mut c_int,
+        d: *const c_long,
+        init_pow: *const c_int,
+        h_star: *const c_int,
+        ell: *const c_int,
+        count: c_long,
+    ) -> c_long;
+}
+
+/// A `bjt_batch_t`: the tables of the C engine, kept from one batch to the
+/// next, along with the arrays the queries are laid out in.
+#[derive(Debug)]
+pub struct ClgrpBatch {
+    raw: NonNull<RawBatch>,
+    slots: Vec<usize>,
+    d: Vec<c_long>,
+    init_pow: Vec<c_int>,
+    h_star: Vec<c_int>,
+    ell: Vec<c_int>,
+    rank: Vec<c_int>,
+    out: Vec<c_int>,
+}
+
+// The tables belong to the batch alone, which is used by one thread at a time.
+unsafe impl Send for ClgrpBatch {}
+
+impl ClgrpBatch {
+    /// Tables sized for |D| up to `d_max`, they grow past it on demand.
+    pub fn new(d_max: i64) -> Self {
+        let raw = unsafe { bjt_batch_new(d_max as c_long) };
+        Self {
+            raw: NonNull::new(raw).expect("bjt_batch_new returned NULL"),
+            slots: Vec::new(),
+            d: Vec::new(),
+            init_pow: Vec::new(),
+            h_star: Vec::new(),
+            ell: Vec::new(),
+            rank: Vec::new(),
+            out: Vec::new(),
+        }
+    }
+
+    /// `crate::bjt::compute_group_bjt` of each query, in the C engine. The
+    /// input is checked here, since the engine trusts it, and a query the
+    /// engine abandons gives `BjtError::Abandoned`.
+    pub fn compute(&mut self, queries: &[BjtQuery]) -> Vec<Result<BjtResult, BjtError>> {
+        let mut results: Vec<Result<BjtResult, BjtError>> = Vec::with_capacity(queries.len());
+
+        self.slots.clear();
+        self.d.clear();
+        self.init_pow.clear();
+        self.h_star.clear();
+        self.ell.clear();
+
+        for (i, query) in queries.iter().enumerate() {
+            let d = query.discriminant;
+            if query.h_star < 1 {
+                results.push(Err(BjtError::InvalidInput("h_star must be >= 1")));
+            } else if query.init_pow < 1 {
+                results.push(Err(BjtError::InvalidInput("init_pow must be >= 1")));
+            } else if d >= 0 || d.rem_euclid(4) > 1 {
+                results.push(Err(BjtError::InvalidInput("invalid discriminant")));
+            } else {
+                // a placeholder until the engine has run
+                results.push(Err(BjtError::Abandoned { discriminant: d }));
+                self.slots.push(i);
+                self.d.push(d as c_long);
+                self.init_pow.push(query.init_pow);
+                self.h_star.push(query.h_star);
+                self.ell.push(query.ell);
+            }
+        }
+
+        let count = self.slots.len();
+        self.rank.resize(count, 0);
+        self.out.resize(count * BJT_BATCH_ROW, 0);
+
+        unsafe {
+            bjt_batch_compute(
+                self.raw.as_ptr(),
+                self.rank.as_mut_ptr(),
+                self.out.as_mut_ptr(),
+                self.d.as_ptr(),
+                self.init_pow.as_ptr(),
+                self.h_star.as_ptr(),
+                self.ell.as_ptr(),
+                count as c_long,
+            );
+        }
+
+        for (k, &i) in self.slots.iter().enumerate() {
+            let Ok(rank) = usize::try_from(self.rank[k]) else {
+                continue;
+            };
+            let row = &self.out[k * BJT_BATCH_ROW..(k + 1) * BJT_BATCH_ROW];
+            results[i] = Ok(BjtResult {
+                h: i64::from(row[0]),
+                invariants: row[1..=rank].iter().map(|&x| i64::from(x)).collect(),
+            });
+        }
+
+        results
+    }
+}
+
+impl Drop for ClgrpBatch {
+    fn drop(&mut self) {
+        unsafe { bjt_batch_free(self.raw.as_ptr()) };
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use crate::batch::compute_group_bjt_batch;
+
+    #[test]
+    fn batch_checks_its_input() {
+        let mut batch = ClgrpBatch::new(100);
+        let queries = [
+            BjtQuery::new(-23, 3),
+            BjtQuery::new(-5, 1),
+            BjtQuery::new(-23, 0),
+            BjtQuery::new(-23, 1),
+        ];
+        let out = batch.compute(&queries);
+
+        let first = out[0].as_ref().expect("D=-23 should succeed");
+        assert_eq!(first.h, 3);
+        assert_eq!(first.invariants, vec![3]);
+        assert!(matches!(out[1], Err(BjtError::InvalidInput(_))));
+        assert!(matches!(out[2], Err(BjtError::InvalidInput(_))));
+        assert_eq!(out[3].as_ref().expect("D=-23 should succeed").h, 1);
+    }
+
+    // the product of the primes dividing h exactly once, as tabulate_bjt has it
+    fn init_pow_from_h(h: i64) -> i32 {
+        let (mut init_pow, mut n, mut p) = (1_i64, h, 2_i64);
+        while p * p <= n {
+            let mut e = 0;
+            while n % p == 0 {
+                n /= p;
+                e += 1;
+            }
+            if e == 1 {
+                init_pow *= p;
+            }
+            p += 1;
+        }
+        if n > 1 {
+            init_pow *= n;
+        }
+        i32::try_from(init_pow).expect("init_pow should fit in i32")
+    }
+
+    #[test]
+    fn batch_matches_lmfdb_fixture() {
+        let path = concat!(
+            env!("CARGO_MANIFEST_DIR"),
+            "/testdata/lmfdb_bjt_samples.tsv"
+        );
+        let text = std::fs::read_to_string(path).expect("read fixture");
+        let mut queries = Vec::new();
+        let mut expected = Vec::new();
+
+        for line in text.lines().filter(|line| !line.starts_with('#')) {
+            let cols: Vec<&str> = line.split('\t').collect();
+            let d: i64 = cols[5].parse().expect("discriminant");
+            let h: i64 = cols[6].parse().expect("class number");
+            let invariants: Vec<i64> = cols[7].split(',').map(|x| x.parse().unwrap()).collect();
+            let init_pow = init_pow_from_h(h);
+
+            queries.push(BjtQuery {
+                discriminant: d,
+                init_pow,
+                h_star: (h / i64::from(init_pow)) as i32,
+                ell: 0,
+            });
+            expected.push((h, invariants));
+        }
+
+        let out = compute_group_bjt_batch(&queries, 4);
+        assert_eq!(out.len(), queries.len());
+
+        for ((query, result), (h, invariants)) in queries.iter().zip(out).zip(expected) {
+            let d = query.discriminant;
+            let mut result = result.unwrap_or_else(|e| panic!("D={d}: {e}"));
+            result.invariants[0] *= i64::from(query.init_pow);
+            assert_eq!(result.h * i64::from(query.init_pow), h, "D={d}");
+            assert_eq!(result.invariants, invariants, "D={d}");
+        }
+    }
+}
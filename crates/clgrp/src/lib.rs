@@ -1,4 +1,7 @@
+pub mod batch;
 pub mod bjt;
+#[cfg(feature = "ffi")]
+pub mod ffi;
 pub mod lmfdb;
 
 pub use lmfdb::*;
@@ -2,8 +2,13 @@ use flate2::read::MultiGzDecoder;
 use reqwest::blocking::Client;
 use std::error::Error;
 use std::fmt::{Display, Formatter};
-use std::io::{BufRead, BufReader};
-use std::sync::mpsc::{self, Receiver, SyncSender, TryRecvError};
+use std::fs::File;
+use std::io::{self, BufRead, BufReader, Read};
+use std::path::PathBuf;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicBool, Ordering};
+use std::sync::mpsc::{self, Receiver, Sender, SyncSender, TryRecvError};
+use std::thread;
 
 /// Stream class-group rows from one LMFDB `.gz` data file.
 ///
@@ -37,6 +42,17 @@ pub const LMFDB_QICG_ENDPOINT: &str =
     "https://www.lmfdb.org/NumberField/QuadraticImaginaryClassGroups";
 const LMFDB_BUCKET_SIZE: i64 = 1_i64 << 28;
 
+// Rows buffered per stream, or per file when the files are delivered in order.
+const ROW_CHANNEL: usize = 512;
+// Compressed bytes per read of the fetch stage, and reads in flight: 4 MiB a
+// file, so a look-ahead file waits on its connection instead of downloading
+// whole into memory while the files before it are parsed.
+const FETCH_CHUNK: usize = 1 << 16;
+const FETCH_CHANNEL: usize = 64;
+// Lines per message from the inflate stage to the parse stage, and messages in flight.
+const LINE_BATCH: usize = 1024;
+const BATCH_CHANNEL: usize = 16;
+
 #[derive(Debug, Clone, Copy, PartialEq, Eq)]
 pub struct LmfdbFileSpec {
     pub k: u32,
@@ -54,6 +70,48 @@ impl LmfdbFileSpec {
     }
 }
 
+/// Where the rows of one LMFDB file come from.
+#[derive(Debug, Clone, PartialEq, Eq)]
+pub enum LmfdbSource {
+    /// The file as served by the LMFDB.
+    Remote(LmfdbFileSpec),
+    /// A downloaded copy of it, `cl<r>mod<m>.<k>.gz`.
+    Local { spec: LmfdbFileSpec, path: PathBuf },
+}
+
+impl LmfdbSource {
+    pub fn spec(&self) -> LmfdbFileSpec {
+        match self {
+            Self::Remote(spec) => *spec,
+            Self::Local { spec, .. } => *spec,
+        }
+    }
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum LmfdbDelivery {
+    /// All rows of a file before any row of the next one.
+    Ordered,
+    /// Rows of different files interleaved as soon as they are parsed.
+    Unordered,
+}
+
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct LmfdbStreamOptions {
+    /// Files fetched at once, at least 1.
+    pub concurrency: usize,
+    pub delivery: LmfdbDelivery,
+}
+
+impl Default for LmfdbStreamOptions {
+    fn default() -> Self {
+        Self {
+            concurrency: 4,
+            delivery: LmfdbDelivery::Ordered,
+        }
+    }
+}
+
 #[derive(Debug, Clone, PartialEq, Eq)]
 pub struct LmfdbClassGroupEntry {
     pub line_index: u64,
@@ -142,6 +200,98 @@ impl Iterator for LmfdbClassGroupStream {
     }
 }
 
+/// The rows of several files, see `stream_lmfdb_sources`. Dropping the stream
+/// cancels the files still being fetched.
+#[derive(Debug)]
+pub struct LmfdbMultiStream {
+    rows: MultiRows,
+    cancelled: Arc<[AtomicBool]>,
+}
+
+#[derive(Debug)]
+enum MultiRows {
+    Ordered {
+        files: Receiver<(usize, Receiver<SourceRow>)>,
+        current: Option<(usize, Receiver<SourceRow>)>,
+    },
+    Unordered(Receiver<SourceRow>),
+}
+
+impl LmfdbMultiStream {
+    pub fn try_next(&mut self) -> Option<SourceRow> {
+        match &mut self.rows {
+            MultiRows::Ordered { files, current } => loop {
+                if current.is_none() {
+                    *current = Some(files.try_recv().ok()?);
+                }
+                let (_, rx) = current.as_ref()?;
+                match rx.try_recv() {
+                    Ok(item) if !self.cancelled[item.0].load(Ordering::Relaxed) => {
+                        return Some(item);
+                    }
+                    Ok(_) => *current = None,
+                    Err(TryRecvError::Empty) => return None,
+                    Err(TryRecvError::Disconnected) => *current = None,
+                }
+            },
+            MultiRows::Unordered(rx) => loop {
+                let item = rx.try_recv().ok()?;
+                if !self.cancelled[item.0].load(Ordering::Relaxed) {
+                    return Some(item);
+                }
+            },
+        }
+    }
+
+    /// Stop reading file `source`: it is not fetched if it has not started,
+    /// and none of its rows are delivered from now on. Used to read only a
+    /// prefix of the files.
+    pub fn cancel(&mut self, source: usize) {
+        self.cancelled[source].store(true, Ordering::Relaxed);
+
+        if let MultiRows::Ordered { current, .. } = &mut self.rows
+            && current.as_ref().is_some_and(|(index, _)| *index == source)
+        {
+            *current = None;
+        }
+    }
+}
+
+impl Iterator for LmfdbMultiStream {
+    type Item = SourceRow;
+
+    fn next(&mut self) -> Option<Self::Item> {
+        match &mut self.rows {
+            MultiRows::Ordered { files, current } => loop {
+                if current.is_none() {
+                    *current = Some(files.recv().ok()?);
+                }
+                let (_, rx) = current.as_ref()?;
+                match rx.recv() {
+                    Ok(item) if !self.cancelled[item.0].load(Ordering::Relaxed) => {
+                        return Some(item);
+                    }
+                    _ => *current = None,
+                }
+            },
+            MultiRows::Unordered(rx) => loop {
+                let item = rx.recv().ok()?;
+                if !self.cancelled[item.0].load(Ordering::Relaxed) {
+                    return Some(item);
+                }
+            },
+        }
+    }
+}
+
+impl Drop for LmfdbMultiStream {
+    fn drop(&mut self) {
+        for flag in self.cancelled.iter() {
+            flag.store(true, Ordering::Relaxed);
+        }
+    }
+}
+
 pub fn lmfdb_download_url(spec: LmfdbFileSpec) -> String {
     format!(
         "{LMFDB_QICG_ENDPOINT}?filenamebase={}&k={}&Fetch=fetch",
@@ -157,93 +307,355 @@ pub fn stream_lmfdb_class_groups(
         return Err(LmfdbStreamError::InvalidSpec("m must be non-zero"));
     }
 
-    let client = Client::builder()
-        .user_agent("clgrp-lmfdb-stream/0.1.0")
-        .http1_only()
-        .build()?;
-    let (tx, rx) = mpsc::sync_channel(512);
+    let client = lmfdb_client()?;
+    let (tx, rx) = mpsc::sync_channel(ROW_CHANNEL);
 
-    std::thread::spawn(move || {
-        worker(spec, client, tx);
+    thread::spawn(move || {
+        run_source(&LmfdbSource::Remote(spec), &client, |row| {
+            tx.send(row).is_ok()
+        });
     });
 
     Ok(LmfdbClassGroupStream { rx })
 }
 
-fn worker(
-    spec: LmfdbFileSpec,
+/// Stream the rows of many LMFDB files, fetching up to `options.concurrency`
+/// of them at once.
+///
+/// Each file runs through its own pipeline of three threads: the fetch reads
+/// the compressed bytes from the connection or the local file, the inflate
+/// splits the decoded text into batches of lines, and the parse turns them
+/// into rows. The compressed bytes are buffered without bound, so a fetch
+/// never stalls its connection behind the decoder; at most `concurrency`
+/// files are in flight at any time.
+///
+/// Items are `(source, row)`, `source` being the index of the file in
+/// `sources`. An error ends the rows of its file only. With
+/// `LmfdbDelivery::Ordered` the rows of file `i` all come before those of file
+/// `i + 1`, the files after the current one being fetched ahead. With
+/// `LmfdbDelivery::Unordered` the rows of the files interleave as they are
+/// parsed, though those of one file stay in order.
+///
+/// ```no_run
+/// use clgrp::{stream_lmfdb_sources, LmfdbDelivery, LmfdbFileSpec, LmfdbSource, LmfdbStreamOptions};
+///
+/// let sources = (0..64)
+///     .map(|k| LmfdbSource::Remote(LmfdbFileSpec { k, r: 3, m: 8 }))
+///     .collect();
+/// let options = LmfdbStreamOptions { concurrency: 8, delivery: LmfdbDelivery::Unordered };
+///
+/// for (source, row) in stream_lmfdb_sources(sources, options)? {
+///     let row = row?;
+///     println!("file {source}: d={} h={}", row.discriminant, row.class_number);
+/// }
+/// # Ok::<(), Box<dyn std::error::Error>>(())
+/// ```
+pub fn stream_lmfdb_sources(
+    sources: Vec<LmfdbSource>,
+    options: LmfdbStreamOptions,
+) -> Result<LmfdbMultiStream, LmfdbStreamError> {
+    if sources.iter().any(|source| source.spec().m == 0) {
+        return Err(LmfdbStreamError::InvalidSpec("m must be non-zero"));
+    }
+
+    let client = lmfdb_client()?;
+    let cancelled: Arc<[AtomicBool]> = sources.iter().map(|_| AtomicBool::new(false)).collect();
+    let concurrency = options.concurrency.max(1);
+
+    let (deliver, rows) = match options.delivery {
+        LmfdbDelivery::Ordered => {
+            let (files_tx, files_rx) = mpsc::channel();
+            (
+                Delivery::Ordered(files_tx),
+                MultiRows::Ordered {
+                    files: files_rx,
+                    current: None,
+                },
+            )
+        }
+        LmfdbDelivery::Unordered => {
+            let (tx, rx) = mpsc::sync_channel(ROW_CHANNEL);
+            (Delivery::Unordered(tx), MultiRows::Unordered(rx))
+        }
+    };
+
+    let flags = Arc::clone(&cancelled);
+    thread::spawn(move || {
+        dispatch(sources, client, concurrency, deliver, flags);
+    });
+
+    Ok(LmfdbMultiStream { rows, cancelled })
+}
+
+fn lmfdb_client() -> Result<Client, LmfdbStreamError> {
+    Ok(Client::builder()
+        .user_agent("clgrp-lmfdb-stream/0.1.0")
+        .http1_only()
+        .build()?)
+}
+
+type SourceRow = (usize, Result<LmfdbClassGroupEntry, LmfdbStreamError>);
+
+enum Delivery {
+    Ordered(Sender<(usize, Receiver<SourceRow>)>),
+    Unordered(SyncSender<SourceRow>),
+}
+
+// Starts the files in order, each once a slot of the pool is free. In ordered
+// mode a file only finishes once the consumer has nearly caught up with it, so
+// the current file always holds one of the slots and the others fetch ahead.
+fn dispatch(
+    sources: Vec<LmfdbSource>,
     client: Client,
-    tx: SyncSender<Result<LmfdbClassGroupEntry, LmfdbStreamError>>,
+    concurrency: usize,
+    deliver: Delivery,
+    cancelled: Arc<[AtomicBool]>,
 ) {
-    let url = lmfdb_download_url(spec);
-    let response = match client.get(url).send() {
-        Ok(response) => match response.error_for_status() {
-            Ok(response) => response,
-            Err(err) => {
-                let _ = tx.send(Err(LmfdbStreamError::Http(err)));
-                return;
+    let (slot_tx, slot_rx) = mpsc::channel();
+    for _ in 0..concurrency {
+        let _ = slot_tx.send(());
+    }
+
+    for (index, source) in sources.into_iter().enumerate() {
+        if slot_rx.recv().is_err() {
+            return;
+        }
+
+        if cancelled[index].load(Ordering::Relaxed) {
+            let _ = slot_tx.send(());
+            continue;
+        }
+
+        let tx = match &deliver {
+            Delivery::Ordered(files) => {
+                let (tx, rx) = mpsc::sync_channel(ROW_CHANNEL);
+                if files.send((index, rx)).is_err() {
+                    return;
+                }
+                tx
             }
-        },
+            Delivery::Unordered(tx) => tx.clone(),
+        };
+
+        let client = client.clone();
+        let slot = slot_tx.clone();
+        let cancelled = Arc::clone(&cancelled);
+
+        thread::spawn(move || {
+            run_source(&source, &client, |row| {
+                !cancelled[index].load(Ordering::Relaxed) && tx.send((index, row)).is_ok()
+            });
+            let _ = slot.send(());
+        });
+    }
+}
+
+// The pipeline of one file, the parse running on the calling thread. `emit`
+// returns false once nobody wants the rows anymore, which winds the fetch and
+// inflate threads down as their channels disconnect.
+fn run_source<F>(source: &LmfdbSource, client: &Client, mut emit: F)
+where
+    F: FnMut(Result<LmfdbClassGroupEntry, LmfdbStreamError>) -> bool,
+{
+    let reader = match open_source(source, client) {
+        Ok(reader) => reader,
         Err(err) => {
-            let _ = tx.send(Err(LmfdbStreamError::Http(err)));
+            emit(Err(err));
             return;
         }
     };
 
-    let reader = BufReader::new(MultiGzDecoder::new(response));
-    let mut discriminant = spec.initial_discriminant();
+    let (chunk_tx, chunk_rx) = mpsc::sync_channel(FETCH_CHANNEL);
+    thread::spawn(move || fetch_chunks(reader, chunk_tx));
 
-    for (idx, line_result) in reader.lines().enumerate() {
-        let line_index = idx as u64 + 1;
-        let raw_line = match line_result {
-            Ok(line) => line,
+    let (batch_tx, batch_rx) = mpsc::sync_channel(BATCH_CHANNEL);
+    thread::spawn(move || inflate_lines(ChunkReader::new(chunk_rx), batch_tx));
+
+    let mut parser = RowParser::new(source.spec());
+
+    for batch in batch_rx {
+        let lines = match batch {
+            Ok(lines) => lines,
             Err(err) => {
-                let _ = tx.send(Err(LmfdbStreamError::Io(err)));
+                emit(Err(LmfdbStreamError::Io(err)));
                 return;
             }
         };
 
-        let parsed = match parse_line(&raw_line, line_index) {
-            Ok(parsed) => parsed,
+        for raw_line in &lines {
+            match parser.next_row(raw_line) {
+                Some(Ok(entry)) => {
+                    if !emit(Ok(entry)) {
+                        return;
+                    }
+                }
+                Some(Err(err)) => {
+                    emit(Err(err));
+                    return;
+                }
+                None => {}
+            }
+        }
+    }
+}
+
+fn open_source(
+    source: &LmfdbSource,
+    client: &Client,
+) -> Result<Box<dyn Read + Send>, LmfdbStreamError> {
+    match source {
+        LmfdbSource::Remote(spec) => {
+            let response = client
+                .get(lmfdb_download_url(*spec))
+                .send()?
+                .error_for_status()?;
+            Ok(Box::new(response))
+        }
+        LmfdbSource::Local { path, .. } => Ok(Box::new(File::open(path)?)),
+    }
+}
+
+fn fetch_chunks(mut reader: Box<dyn Read + Send>, tx: SyncSender<io::Result<Vec<u8>>>) {
+    loop {
+        let mut chunk = vec![0_u8; FETCH_CHUNK];
+        match reader.read(&mut chunk) {
+            Ok(0) => return,
+            Ok(len) => {
+                chunk.truncate(len);
+                if tx.send(Ok(chunk)).is_err() {
+                    return;
+                }
+            }
+            Err(err) if err.kind() == io::ErrorKind::Interrupted => {}
             Err(err) => {
                 let _ = tx.send(Err(err));
                 return;
             }
-        };
+        }
+    }
+}
 
-        let step = match i64::from(spec.m).checked_mul(parsed.delta) {
-            Some(value) => value,
-            None => {
-                let _ = tx.send(Err(LmfdbStreamError::Arithmetic {
-                    line_index,
-                    message: "m * a overflow",
-                }));
+fn inflate_lines(reader: ChunkReader, tx: SyncSender<io::Result<Vec<String>>>) {
+    let mut lines = Vec::with_capacity(LINE_BATCH);
+
+    for line in BufReader::new(MultiGzDecoder::new(reader)).lines() {
+        match line {
+            Ok(line) => {
+                lines.push(line);
+                if lines.len() == LINE_BATCH {
+                    let full = std::mem::replace(&mut lines, Vec::with_capacity(LINE_BATCH));
+                    if tx.send(Ok(full)).is_err() {
+                        return;
+                    }
+                }
+            }
+            Err(err) => {
+                if !lines.is_empty() && tx.send(Ok(lines)).is_err() {
+                    return;
+                }
+                let _ = tx.send(Err(err));
                 return;
             }
-        };
+        }
+    }
 
-        discriminant = match discriminant.checked_sub(step) {
-            Some(value) => value,
-            None => {
-                let _ = tx.send(Err(LmfdbStreamError::Arithmetic {
-                    line_index,
-                    message: "d_(i-1) - m*a overflow",
-                }));
-                return;
+    if !lines.is_empty() {
+        let _ = tx.send(Ok(lines));
+    }
+}
+
+// The compressed bytes from the fetch thread, as a `Read` for the decoder.
+struct ChunkReader {
+    rx: Receiver<io::Result<Vec<u8>>>,
+    chunk: Vec<u8>,
+    pos: usize,
+}
+
+impl ChunkReader {
+    fn new(rx: Receiver<io::Result<Vec<u8>>>) -> Self {
+        Self {
+            rx,
+            chunk: Vec::new(),
+            pos: 0,
+        }
+    }
+}
+
+impl Read for ChunkReader {
+    fn read(&mut self, buf: &mut [u8]) -> io::Result<usize> {
+        while self.pos == self.chunk.len() {
+            match self.rx.recv() {
+                Ok(Ok(chunk)) => {
+                    self.chunk = chunk;
+                    self.pos = 0;
+                }
+                Ok(Err(err)) => return Err(err),
+                Err(_) => return Ok(0),
             }
+        }
+
+        let len = buf.len().min(self.chunk.len() - self.pos);
+        buf[..len].copy_from_slice(&self.chunk[self.pos..self.pos + len]);
+        self.pos += len;
+        Ok(len)
+    }
+}
+
+// Numbers the lines and carries the discriminant from row to row.
+struct RowParser {
+    m: i64,
+    line_index: u64,
+    discriminant: i64,
+}
+
+impl RowParser {
+    fn new(spec: LmfdbFileSpec) -> Self {
+        Self {
+            m: i64::from(spec.m),
+            line_index: 0,
+            discriminant: spec.initial_discriminant(),
+        }
+    }
+
+    // None for a blank line, which still counts towards the line numbers.
+    fn next_row(
+        &mut self,
+        raw_line: &str,
+    ) -> Option<Result<LmfdbClassGroupEntry, LmfdbStreamError>> {
+        self.line_index += 1;
+        let line_index = self.line_index;
+
+        if raw_line.trim().is_empty() {
+            return None;
+        }
+
+        let parsed = match parse_line(raw_line, line_index) {
+            Ok(parsed) => parsed,
+            Err(err) => return Some(Err(err)),
+        };
+
+        let Some(step) = self.m.checked_mul(parsed.delta) else {
+            return Some(Err(LmfdbStreamError::Arithmetic {
+                line_index,
+                message: "m * a overflow",
+            }));
+        };
+
+        let Some(discriminant) = self.discriminant.checked_sub(step) else {
+            return Some(Err(LmfdbStreamError::Arithmetic {
+                line_index,
+                message: "d_(i-1) - m*a overflow",
+            }));
         };
+        self.discriminant = discriminant;
 
-        let entry = LmfdbClassGroupEntry {
+        Some(Ok(LmfdbClassGroupEntry {
             line_index,
             delta: parsed.delta,
             discriminant,
             class_number: parsed.class_number,
             invariant_factors: parsed.invariant_factors,
-        };
-
-        if tx.send(Ok(entry)).is_err() {
-            return;
-        }
+        }))
     }
 }
 
@@ -367,4 +779,132 @@ mod tests {
         d -= i64::from(spec.m) * second.delta;
         assert_eq!(d, -268_435_492);
     }
+
+    // A gzipped file of `rows` lines of cl3mod8.k, a blank line in the middle.
+    fn local_source(k: u32, rows: u64) -> LmfdbSource {
+        use flate2::Compression;
+        use flate2::write::GzEncoder;
+        use std::io::Write;
+
+        let spec = LmfdbFileSpec { k, r: 3, m: 8 };
+        let path = std::env::temp_dir().join(format!(
+            "clgrp-lmfdb-{}-{}.{k}.gz",
+            std::process::id(),
+            spec.filename_base()
+        ));
+        let mut text = String::new();
+        for i in 0..rows {
+            if i == rows / 2 {
+                text.push('\n');
+            }
+            text.push_str(&format!("{} {} {}\n", u64::from(i > 0), i + 1, i + 1));
+        }
+        let mut out = GzEncoder::new(File::create(&path).unwrap(), Compression::fast());
+        out.write_all(text.as_bytes()).unwrap();
+        out.finish().unwrap();
+        LmfdbSource::Local { spec, path }
+    }
+
+    fn collect(sources: &[LmfdbSource], delivery: LmfdbDelivery) -> Vec<SourceRow> {
+        let options = LmfdbStreamOptions {
+            concurrency: 2,
+            delivery,
+        };
+        stream_lmfdb_sources(sources.to_vec(), options)
+            .expect("stream should start")
+            .collect()
+    }
+
+    fn remove(sources: &[LmfdbSource]) {
+        for source in sources {
+            if let LmfdbSource::Local { path, .. } = source {
+                let _ = std::fs::remove_file(path);
+            }
+        }
+    }
+
+    #[test]
+    fn ordered_delivery_matches_single_file_parse() {
+        let sources: Vec<_> = (10..15)
+            .map(|k| local_source(k, 3000 + u64::from(k)))
+            .collect();
+        let rows = collect(&sources, LmfdbDelivery::Ordered);
+        remove(&sources);
+
+        let mut expected = Vec::new();
+        for (index, source) in sources.iter().enumerate() {
+            let mut parser = RowParser::new(source.spec());
+            let total = 3000 + u64::from(source.spec().k);
+            for i in 0..total {
+                if i == total / 2 {
+                    assert!(parser.next_row("").is_none());
+                }
+                let line = format!("{} {} {}", u64::from(i > 0), i + 1, i + 1);
+                expected.push((index, parser.next_row(&line).unwrap().unwrap()));
+            }
+        }
+
+        let rows: Vec<_> = rows.into_iter().map(|(i, row)| (i, row.unwrap())).collect();
+        assert_eq!(rows, expected);
+        assert_eq!(
+            rows[0].1.discriminant,
+            sources[0].spec().initial_discriminant()
+        );
+    }
+
+    #[test]
+    fn unordered_delivery_keeps_each_file_in_order() {
+        let sources: Vec<_> = (20..26).map(|k| local_source(k, 5000)).collect();
+        let rows = collect(&sources, LmfdbDelivery::Unordered);
+        remove(&sources);
+
+        let mut last = vec![0_u64; sources.len()];
+        let mut seen = vec![0_u64; sources.len()];
+        for (index, row) in rows {
+            let row = row.unwrap();
+            assert!(row.line_index > last[index]);
+            last[index] = row.line_index;
+            seen[index] += 1;
+        }
+        assert!(seen.iter().all(|&n| n == 5000));
+    }
+
+    #[test]
+    fn missing_file_fails_alone() {
+        let mut sources: Vec<_> = (30..33).map(|k| local_source(k, 100)).collect();
+        sources[1] = LmfdbSource::Local {
+            spec: sources[1].spec(),
+            path: std::env::temp_dir().join("clgrp-lmfdb-missing.gz"),
+        };
+        let rows = collect(&sources, LmfdbDelivery::Ordered);
+        remove(&sources);
+
+        assert_eq!(rows.iter().filter(|(i, _)| *i == 0).count(), 100);
+        assert_eq!(rows.iter().filter(|(i, _)| *i == 2).count(), 100);
+        let failed: Vec<_> = rows.iter().filter(|(i, _)| *i == 1).collect();
+        assert_eq!(failed.len(), 1);
+        assert!(matches!(failed[0].1, Err(LmfdbStreamError::Io(_))));
+    }
+
+    #[test]
+    fn cancel_skips_the_rest_of_a_file() {
+        let sources: Vec<_> = (40..43).map(|k| local_source(k, 20_000)).collect();
+        let options = LmfdbStreamOptions {
+            concurrency: 3,
+            delivery: LmfdbDelivery::Ordered,
+        };
+        let mut stream = stream_lmfdb_sources(sources.clone(), options).unwrap();
+        let mut seen = vec![0_u64; sources.len()];
+
+        while let Some((index, row)) = stream.next() {
+            row.unwrap();
+            seen[index] += 1;
+            if index == 1 && seen[index] == 10 {
+                stream.cancel(index);
+            }
+        }
+        remove(&sources);
+
+        assert_eq!(seen, vec![20_000, 10, 20_000]);
+    }
 }
@@ -1,11 +1,13 @@
-use clgrp::{LmfdbClassGroupEntry, LmfdbFileSpec, stream_lmfdb_class_groups};
+use clgrp::{
+    LmfdbClassGroupEntry, LmfdbDelivery, LmfdbFileSpec, LmfdbSource, LmfdbStreamOptions,
+    stream_lmfdb_class_groups, stream_lmfdb_sources,
+};
 use flate2::Compression;
-use flate2::read::MultiGzDecoder;
 use flate2::write::GzEncoder;
 use std::env;
 use std::fs;
 use std::fs::File;
-use std::io::{BufRead, BufReader, Write};
+use std::io::Write;
 use std::path::PathBuf;
 use std::process::ExitCode;
 use std::thread;
@@ -234,6 +236,88 @@ fn reservoir_sample_file(
     Ok(sampled)
 }
 
+// Reservoir-samples the given number of rows out of the first `scan_limit` of
+// each of `sources`, streaming `jobs` files at once, and hands the samples to
+// `done` in the order of `sources`, sorted by line, along with `rng`. The
+// files are consumed in that order too, so the draws from `rng` are those of
+// sampling them one by one.
+fn reservoir_sample_sources<F>(
+    sources: &[(LmfdbSource, usize)],
+    jobs: usize,
+    scan_limit: usize,
+    rng: &mut XorShift64,
+    mut done: F,
+) -> Result<(), String>
+where
+    F: FnMut(
+        usize,
+        Result<Vec<LmfdbClassGroupEntry>, String>,
+        &mut XorShift64,
+    ) -> Result<(), String>,
+{
+    let options = LmfdbStreamOptions {
+        concurrency: jobs,
+        delivery: LmfdbDelivery::Ordered,
+    };
+    let mut stream = stream_lmfdb_sources(
+        sources.iter().map(|(source, _)| source.clone()).collect(),
+        options,
+    )
+    .map_err(|e| format!("failed to start stream: {e}"))?;
+    let mut current = 0_usize;
+    let mut sampled = Vec::new();
+    let mut seen = 0_u64;
+    let mut failed = None;
+
+    loop {
+        let next = stream.next();
+        let index = next.as_ref().map_or(sources.len(), |(index, _)| *index);
+
+        // the files before `index` are complete, some of them possibly empty
+        while current < index {
+            let sample_size = sources[current].1;
+            let result = match failed.take() {
+                Some(err) => Err(err),
+                None if seen < sample_size as u64 => {
+                    Err(format!("only saw {seen} rows but need {sample_size}"))
+                }
+                None => {
+                    sampled.sort_by_key(|row: &LmfdbClassGroupEntry| row.line_index);
+                    Ok(std::mem::take(&mut sampled))
+                }
+            };
+            done(current, result, rng)?;
+            current += 1;
+            sampled.clear();
+            seen = 0;
+        }
+
+        let Some((index, next)) = next else {
+            return Ok(());
+        };
+
+        let sample_size = sources[index].1;
+        match next {
+            Ok(row) => {
+                seen += 1;
+                if sampled.len() < sample_size {
+                    sampled.push(row);
+                } else {
+                    let j = rng.gen_bounded(seen);
+                    if j < sample_size as u64 {
+                        sampled[j as usize] = row;
+                    }
+                }
+
+                if seen >= scan_limit as u64 {
+                    stream.cancel(index);
+                }
+            }
+            Err(err) => failed = Some(format!("stream failed: {err}")),
+        }
+    }
+}
+
 fn write_fixture_file(
     path: &PathBuf,
     seed: u64,
@@ -300,6 +384,7 @@ fn run_build_bjt_fixture(args: &[String]) -> Result<(), String> {
     let mut k_min = 0_u32;
     let mut k_max = 4_095_u32;
     let mut k_files_per_class = 8_usize;
+    let mut jobs = 4_usize;
     let mut seed = SystemTime::now()
         .duration_since(UNIX_EPOCH)
         .map_err(|e| format!("failed to derive seed from system time: {e}"))?
@@ -351,6 +436,13 @@ fn run_build_bjt_fixture(args: &[String]) -> Result<(), String> {
                     .ok_or_else(|| "missing value for --seed".to_string())?;
                 seed = parse_u64(value, "seed")?;
             }
+            "--jobs" => {
+                i += 1;
+                let value = args
+                    .get(i)
+                    .ok_or_else(|| "missing value for --jobs".to_string())?;
+                jobs = parse_usize(value, "jobs")?;
+            }
             "--out" => {
                 i += 1;
                 let value = args
@@ -382,6 +474,8 @@ fn run_build_bjt_fixture(args: &[String]) -> Result<(), String> {
     let mut rng = XorShift64::new(seed);
     let mut fixture_rows = Vec::with_capacity(samples_per_file * base_specs.len());
 
+    // the k of every file first, so that the files can be fetched together
+    let mut plan = Vec::with_capacity(k_files_per_class * base_specs.len());
     for (r, m) in base_specs {
         let class_k_files = k_files_per_class;
         eprintln!(
@@ -399,23 +493,44 @@ fn run_build_bjt_fixture(args: &[String]) -> Result<(), String> {
             let bucket_start = u64::from(k_min) + start_off;
             let rows_for_k = base_rows + usize::from(bucket < extra_rows);
             let k = (bucket_start + rng.gen_bounded(span)) as u32;
-            let spec = LmfdbFileSpec { k, r, m };
-            eprintln!("  sampling {rows_for_k} rows from cl{r}mod{m}.{k}");
+            plan.push((LmfdbFileSpec { k, r, m }, rows_for_k));
+        }
+    }
+
+    let sources: Vec<(LmfdbSource, usize)> = plan
+        .iter()
+        .map(|&(spec, rows)| (LmfdbSource::Remote(spec), rows))
+        .collect();
+    eprintln!("  streaming {} files, {jobs} at a time", sources.len());
 
+    reservoir_sample_sources(
+        &sources,
+        jobs,
+        scan_limit,
+        &mut rng,
+        |index, result, rng| {
+            let (spec, rows_for_k) = plan[index];
+            let (r, m, k) = (spec.r, spec.m, spec.k);
             let attempts = 4_u8;
             let mut sampled = None;
-            for attempt in 1..=attempts {
-                match reservoir_sample_file(spec, rows_for_k, scan_limit, &mut rng) {
-                    Ok(rows) => {
-                        sampled = Some(rows);
-                        break;
-                    }
-                    Err(err) => {
-                        eprintln!(
-                            "    attempt {attempt}/{attempts} failed for cl{r}mod{m}.{k}: {err}"
-                        );
-                        thread::sleep(Duration::from_millis(120));
-                    }
+
+            match result {
+                Ok(rows) => sampled = Some(rows),
+                Err(err) => {
+                    eprintln!("    attempt 1/{attempts} failed for cl{r}mod{m}.{k}: {err}")
+                }
+            }
+
+            for attempt in 2..=attempts {
+                if sampled.is_some() {
+                    break;
+                }
+                thread::sleep(Duration::from_millis(120));
+                match reservoir_sample_file(spec, rows_for_k, scan_limit, rng) {
+                    Ok(rows) => sampled = Some(rows),
+                    Err(err) => eprintln!(
+                        "    attempt {attempt}/{attempts} failed for cl{r}mod{m}.{k}: {err}"
+                    ),
                 }
             }
 
@@ -425,10 +540,9 @@ fn run_build_bjt_fixture(args: &[String]) -> Result<(), String> {
             for row in rows {
                 fixture_rows.push(FixtureRow::from_entry(spec, row));
             }
-            thread::sleep(Duration::from_millis(120));
-        }
-        eprintln!("  completed cl{r}mod{m}");
-    }
+            Ok(())
+        },
+    )?;
 
     if fixture_rows.len() != samples_per_file * base_specs.len() {
         return Err(format!(
@@ -481,98 +595,12 @@ fn parse_filename_spec(name: &str) -> Result<LmfdbFileSpec, String> {
     Ok(LmfdbFileSpec { k, r, m })
 }
 
-fn parse_local_line(raw_line: &str) -> Result<(i64, u64, Vec<u64>), String> {
-    let cols: Vec<&str> = raw_line.split_whitespace().collect();
-    if cols.len() < 3 {
-        return Err(format!("expected at least 3 columns, got: {raw_line}"));
-    }
-
-    let delta = cols[0]
-        .parse::<i64>()
-        .map_err(|_| format!("invalid delta: {raw_line}"))?;
-    let class_number = cols[1]
-        .parse::<u64>()
-        .map_err(|_| format!("invalid class number: {raw_line}"))?;
-    let mut invariants = Vec::with_capacity(cols.len() - 2);
-    for col in cols.iter().skip(2) {
-        invariants.push(
-            col.parse::<u64>()
-                .map_err(|_| format!("invalid invariant in line: {raw_line}"))?,
-        );
-    }
-
-    Ok((delta, class_number, invariants))
-}
-
-fn reservoir_sample_local_file(
-    path: &PathBuf,
-    spec: LmfdbFileSpec,
-    sample_size: usize,
-    rng: &mut XorShift64,
-) -> Result<Vec<FixtureRow>, String> {
-    let file = File::open(path).map_err(|e| format!("open {}: {e}", path.display()))?;
-    let reader = BufReader::new(MultiGzDecoder::new(file));
-    let mut discriminant = spec.initial_discriminant();
-    let mut sampled = Vec::with_capacity(sample_size);
-    let mut seen = 0_u64;
-    let source_name = path
-        .file_name()
-        .and_then(|x| x.to_str())
-        .ok_or_else(|| format!("non-utf8 file name: {}", path.display()))?
-        .to_string();
-
-    for (idx, line_result) in reader.lines().enumerate() {
-        let raw_line = line_result.map_err(|e| format!("read {}: {e}", path.display()))?;
-        if raw_line.trim().is_empty() {
-            continue;
-        }
-
-        let line_index = idx as u64 + 1;
-        let (delta, class_number, invariant_factors) = parse_local_line(&raw_line)?;
-        let step = i64::from(spec.m)
-            .checked_mul(delta)
-            .ok_or_else(|| format!("overflow computing step in {}", path.display()))?;
-        discriminant = discriminant
-            .checked_sub(step)
-            .ok_or_else(|| format!("overflow updating discriminant in {}", path.display()))?;
-
-        let row = FixtureRow {
-            spec,
-            source_file: Some(source_name.clone()),
-            line_index,
-            delta,
-            discriminant,
-            class_number,
-            invariant_factors,
-        };
-
-        seen += 1;
-        if sampled.len() < sample_size {
-            sampled.push(row);
-        } else {
-            let j = rng.gen_bounded(seen);
-            if j < sample_size as u64 {
-                sampled[j as usize] = row;
-            }
-        }
-    }
-
-    if seen < sample_size as u64 {
-        return Err(format!(
-            "{} has only {seen} rows; need {sample_size}",
-            path.display()
-        ));
-    }
-
-    sampled.sort_by_key(|row| row.line_index);
-    Ok(sampled)
-}
-
 fn run_build_bjt_fixture_from_files(args: &[String]) -> Result<(), String> {
     let mut input_dir = PathBuf::from("files");
     let mut output_path = PathBuf::from("crates/clgrp/testdata/lmfdb_bjt_local_samples.tsv.gz");
     let mut sample_size = 50_000_usize;
     let mut seed = 20260217_u64;
+    let mut jobs = 4_usize;
 
     let mut i = 0;
     while i < args.len() {
@@ -605,6 +633,13 @@ fn run_build_bjt_fixture_from_files(args: &[String]) -> Result<(), String> {
                     .ok_or_else(|| "missing value for --seed".to_string())?;
                 seed = parse_u64(value, "seed")?;
             }
+            "--jobs" => {
+                i += 1;
+                let value = args
+                    .get(i)
+                    .ok_or_else(|| "missing value for --jobs".to_string())?;
+                jobs = parse_usize(value, "jobs")?;
+            }
             other => return Err(format!("unknown argument: {other}")),
         }
         i += 1;
@@ -652,16 +687,31 @@ fn run_build_bjt_fixture_from_files(args: &[String]) -> Result<(), String> {
     )
     .map_err(|e| format!("write fixture header: {e}"))?;
 
-    let mut rng = XorShift64::new(seed);
+    let mut names = Vec::with_capacity(files.len());
+    let mut sources = Vec::with_capacity(files.len());
     for path in &files {
         let file_name = path
             .file_name()
             .and_then(|x| x.to_str())
             .ok_or_else(|| format!("non-utf8 file name: {}", path.display()))?;
         let spec = parse_filename_spec(file_name)?;
-        eprintln!("sampling {} rows from {}", sample_size, file_name);
+        names.push(file_name.to_string());
+        sources.push((
+            LmfdbSource::Local {
+                spec,
+                path: path.clone(),
+            },
+            sample_size,
+        ));
+    }
+
+    let mut rng = XorShift64::new(seed);
+    reservoir_sample_sources(&sources, jobs, usize::MAX, &mut rng, |index, result, _| {
+        let spec = sources[index].0.spec();
+        let file_name = &names[index];
+        let sampled = result.map_err(|e| format!("{}: {e}", files[index].display()))?;
+        eprintln!("sampled {} rows from {}", sample_size, file_name);
 
-        let sampled = reservoir_sample_local_file(path, spec, sample_size, &mut rng)?;
         for row in sampled {
             let invariant_csv = row
                 .invariant_factors
@@ -672,10 +722,10 @@ fn run_build_bjt_fixture_from_files(args: &[String]) -> Result<(), String> {
             writeln!(
                 out,
                 "{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}\t{}",
-                row.source_file.unwrap_or_default(),
-                row.spec.r,
-                row.spec.m,
-                row.spec.k,
+                file_name,
+                spec.r,
+                spec.m,
+                spec.k,
                 row.line_index,
                 row.delta,
                 row.discriminant,
@@ -684,7 +734,8 @@ fn run_build_bjt_fixture_from_files(args: &[String]) -> Result<(), String> {
             )
             .map_err(|e| format!("write fixture row: {e}"))?;
         }
-    }
+        Ok(())
+    })?;
 
     out.finish()
         .map_err(|e| format!("finalize {}: {e}", output_path.display()))?;
@@ -701,10 +752,10 @@ fn print_usage(bin: &str) {
     eprintln!("Usage:");
     eprintln!("  {bin} fetch-test <k> <r> <m> [--max N] [--poll-ms MS]");
     eprintln!(
-        "  {bin} build-bjt-fixture [--samples-per-file N] [--scan-limit L] [--k-min A] [--k-max B] [--k-files-per-class C] [--seed S] [--out PATH]"
+        "  {bin} build-bjt-fixture [--samples-per-file N] [--scan-limit L] [--k-min A] [--k-max B] [--k-files-per-class C] [--seed S] [--jobs J] [--out PATH]"
     );
     eprintln!(
-        "  {bin} build-bjt-fixture-from-files [--input-dir DIR] [--samples-per-file N] [--seed S] [--out PATH]"
+        "  {bin} build-bjt-fixture-from-files [--input-dir DIR] [--samples-per-file N] [--seed S] [--jobs J] [--out PATH]"
     );
     eprintln!();
     eprintln!("Example:");
@@ -41,6 +41,7 @@
         buildInputs = with pkgs; [
           openmpi
           gmp
+          zlib
           # pari
           liboptarith.packages.${system}.optarith
           libqform.packages.${system}.qform
@@ -229,6 +229,283 @@ size_t htab_size(const htab_t * t)
 
 
 
+// OPEN ADDRESSING HASH TABLE IMPLEMENTATION
+
+// Fibonacci hashing, spreads clustered hash values over all slots
+static __inline__
+size_t oatab_slot(const oatab_t * t, const int hash)
+{
+	return (size_t) (((uint64_t) (uint32_t) hash * 0x9E3779B97F4A7C15ULL) >> (64 - t->bits));
+}
+
+static __inline__
+int oatab_occupied(const oatab_t * t, const size_t k)
+{
+	return t->slots[k].epoch == t->epoch;
+}
+
+static __inline__
+int oatab_live(const oatab_t * t, const size_t k)
+{
+	return (t->slots[k].idx < t->cur_size) && (t->where[t->slots[k].idx] == k);
+}
+
+// invalidates all slots in O(1), except once every 2^32 epochs
+static void oatab_next_epoch(oatab_t * t)
+{
+	if (++t->epoch == 0)
+	{
+		memset(t->slots, 0, (t->mask + 1) * sizeof(oaslot_t));
+		t->epoch = 1;
+	}
+
+	t->used = 0;
+}
+
+static __inline__
+void oatab_place(oatab_t * t, const size_t i, const int hash)
+{
+	register size_t k;
+
+	for (k = oatab_slot(t, hash); oatab_occupied(t, k); k = (k + 1) & t->mask);
+
+	t->slots[k].idx = i;
+	t->slots[k].epoch = t->epoch;
+	t->slots[k].hash = hash;
+	t->where[i] = k;
+	t->used++;
+}
+
+// drops the dead slots and reinserts in insertion order, so that find still
+// returns the oldest match
+static void oatab_rehash(oatab_t * t, const int bits)
+{
+	register size_t i;
+
+	if (bits == t->bits)
+	{
+		oatab_next_epoch(t);
+	}
+	else
+	{
+		free(t->slots);
+		t->bits = bits;
+		t->mask = (((size_t) 1) << bits) - 1;
+		t->slots = (oaslot_t *) calloc(t->mask + 1, sizeof(oaslot_t));
+		t->epoch = 1;
+		t->used = 0;
+	}
+
+	for (i = 0; i < t->cur_size; i++)
+	{
+		oatab_place(t, i, t->hash(t->items + i * t->item_size));
+	}
+}
+
+// size is the expected number of elements, both arrays grow on demand
+void oatab_init(oatab_t * t, const size_t size, const size_t item_size, int (*hash) (const void *), int (*eq) (const void *, const void *), void (*del) (void *))
+{
+	int bits = 4;
+
+	while ((((size_t) 1) << bits) < (size << 1))
+	{
+		bits++;
+	}
+
+	t->item_size = item_size;
+	t->cur_size = 0;
+	t->allocated = (size > 0) ? size : 1;
+	t->items = (char *) malloc(t->allocated * item_size);
+	t->where = (uint32_t *) malloc(t->allocated * sizeof(uint32_t));
+
+	t->bits = bits;
+	t->mask = (((size_t) 1) << bits) - 1;
+	t->used = 0;
+	t->epoch = 1;
+	t->slots = (oaslot_t *) calloc(t->mask + 1, sizeof(oaslot_t));
+
+	t->payload_size = 0;
+	t->payload = NULL;
+
+	t->finds = 0;
+	t->probes = 0;
+	t->max_probes = 0;
+
+	t->hash = hash;
+	t->eq = eq;
+	t->del = del;
+}
+
+// keys and payloads in two parallel arenas, so that probing only touches keys
+void oatab_init_soa(oatab_t * t, const size_t size, const size_t key_size, const size_t payload_size, int (*hash) (const void *), int (*eq) (const void *, const void *))
+{
+	oatab_init(t, size, key_size, hash, eq, NULL);
+
+	t->payload_size = payload_size;
+	t->payload = (char *) malloc(t->allocated * payload_size);
+}
+
+size_t oatab_memory(const size_t size, const size_t key_size, const size_t payload_size)
+{
+	const size_t allocated = (size > 0) ? size : 1;
+	int bits = 4;
+
+	while ((((size_t) 1) << bits) < (size << 1))
+	{
+		bits++;
+	}
+
+	return allocated * (key_size + payload_size + sizeof(uint32_t)) + (((size_t) 1) << bits) * sizeof(oaslot_t);
+}
+
+// keeps the arenas and the slot array for the next discriminant
+void oatab_empty(oatab_t * t)
+{
+	oatab_truncate(t, 0);
+	oatab_next_epoch(t);
+}
+
+void oatab_clear(oatab_t * t)
+{
+	oatab_empty(t);
+	free(t->items);
+	free(t->where);
+	free(t->payload);
+	free(t->slots);
+}
+
+void oatab_insert(oatab_t * t, const void * G)
+{
+	oatab_insert_soa(t, G, NULL);
+}
+
+void oatab_insert_soa(oatab_t * t, const void * G, const void * P)
+{
+	const int hash = t->hash(G);
+
+	// keep at most half of the slots occupied, dead slots included
+	if (((t->used + 1) << 1) > t->mask + 1)
+	{
+		// only grow if the live items alone fill a quarter of the slots
+		oatab_rehash(t, (((t->cur_size + 1) << 2) > t->mask + 1) ? t->bits + 1 : t->bits);
+	}
+
+	if (t->cur_size == t->allocated)
+	{
+		t->allocated <<= 1;
+		t->items = (char *) realloc(t->items, t->allocated * t->item_size);
+		t->where = (uint32_t *) realloc(t->where, t->allocated * sizeof(uint32_t));
+
+		if (t->payload)
+		{
+			t->payload = (char *) realloc(t->payload, t->allocated * t->payload_size);
+		}
+	}
+
+	memcpy(t->items + t->cur_size * t->item_size, G, t->item_size);
+
+	if (P)
+	{
+		memcpy(t->payload + t->cur_size * t->payload_size, P, t->payload_size);
+	}
+
+	oatab_place(t, t->cur_size++, hash);
+}
+
+void * oatab_find(oatab_t * t, const void * G)
+{
+	const long i = oatab_find_index(t, G);
+
+	return (i >= 0) ? oatab_get(t, i) : NULL;
+}
+
+static __inline__
+void oatab_count(oatab_t * t, const size_t n)
+{
+	t->finds++;
+	t->probes += n;
+
+	if (n > t->max_probes)
+	{
+		t->max_probes = n;
+	}
+}
+
+// returns the insertion index of the oldest match, -1 if there is none
+long oatab_find_index(oatab_t * t, const void * G)
+{
+	register size_t k, n = 0;
+	const int hash = t->hash(G);
+
+	for (k = oatab_slot(t, hash); oatab_occupied(t, k); k = (k + 1) & t->mask)
+	{
+		n++;
+
+		if ((t->slots[k].hash == hash) && oatab_live(t, k))
+		{
+			if (t->eq(G, t->items + t->slots[k].idx * t->item_size))
+			{
+				oatab_count(t, n);
+				return (long) t->slots[k].idx;
+			}
+		}
+	}
+
+	oatab_count(t, n);
+	return -1;
+}
+
+// removes the elements inserted after the first n, the slots are left dead
+void oatab_truncate(oatab_t * t, const size_t n)
+{
+	register size_t i;
+
+	if (n >= t->cur_size)
+	{
+		return;
+	}
+
+	if (t->del)
+	{
+		for (i = n; i < t->cur_size; i++)
+		{
+			t->del(t->items + i * t->item_size);
+		}
+	}
+
+	t->cur_size = n;
+}
+
+void oatab_delete_from(oatab_t * t, const long i)
+{
+	void * item = oatab_get(t, i);
+
+	if (i == t->cur_size - 1)
+	{
+		oatab_truncate(t, i);
+		return;
+	}
+
+	if (t->del)
+	{
+		t->del(item);
+	}
+
+	// element i was not the last one - close the gap in the arenas and
+	// rebuild the slots, the indices of all later elements change
+	memmove(item, (char *) item + t->item_size, (t->cur_size - 1 - i) * t->item_size);
+
+	if (t->payload)
+	{
+		memmove(t->payload + i * t->payload_size, t->payload + (i + 1) * t->payload_size, (t->cur_size - 1 - i) * t->payload_size);
+	}
+
+	t->cur_size--;
+	oatab_rehash(t, t->bits);
+}
+
+
+
 
 // VECTOR IMPLEMENTATION
 
@@ -368,6 +645,25 @@ void mat_clear(mat_t M, const size_t size)
 }
 
 
+// x modulo the determinant d of the lattice, in (-d, d) off the diagonal and
+// in [1, d] on it, so that no pivot becomes 0
+static __inline__
+int snf_reduce(const int64_t x, const int64_t d, const int diagonal)
+{
+	int64_t r = x % d;
+
+	if (diagonal && r <= 0)
+	{
+		r += d;
+	}
+
+	return (int) r;
+}
+
+// The rows of M span a lattice of determinant d = prod M[k][k], which holds
+// d Z^n, and the unimodular transformations keep it so. Entries are reduced
+// modulo d, since they outgrow int otherwise, and the diagonal is restored
+// at the end as gcd(M[k][k], d).
 void smith_normal_form(mat_t M, const size_t size)
 {
 	int i, c;
@@ -384,8 +680,14 @@ void smith_normal_form(mat_t M, const size_t size)
 
 	long n = size;
 	long temp;			// a temporary vector to hold columns and rows
+	int64_t d = 1;			// the determinant
 	i = n - 1;
 
+	for (k = 0; k < n; k++)
+	{
+		d *= M[k][k];
+	}
+
 	//while (done == 0)
 	for (i = n - 1; i > 0; i = (done == 1) ? i - 1 : i)
 	{
@@ -420,8 +722,8 @@ void smith_normal_form(mat_t M, const size_t size)
 				for (k = 0; k < n; k++)
 				{
 					temp = u * M[k][i] + v * M[k][j];
-					M[k][j] = r * M[k][j] - b * M[k][i];
-					M[k][i] = temp;
+					M[k][j] = snf_reduce(r * (int64_t) M[k][j] - b * (int64_t) M[k][i], d, k == j);
+					M[k][i] = snf_reduce(temp, d, k == i);
 				}
 			}
 #ifdef DEBUG
@@ -455,8 +757,8 @@ mat_print(M, size);
 				for (k = 0; k < n; k++)
 				{
 					temp = u * M[i][k] + v * M[j][k];
-					M[j][k] = r * M[j][k] - b * M[i][k];
-					M[i][k] = temp;
+					M[j][k] = snf_reduce(r * (int64_t) M[j][k] - b * (int64_t) M[i][k], d, k == j);
+					M[i][k] = snf_reduce(temp, d, k == i);
 				}
 
 #ifdef DEBUG
@@ -481,7 +783,7 @@ mat_print(M, size);
 				{
 					for (long t = 0; t < n; t++)
 					{
-						M[i][t] += M[k][t];
+						M[i][t] = snf_reduce((int64_t) M[i][t] + M[k][t], d, t == i);
 					}
 					done = 0;
 				}
@@ -493,6 +795,11 @@ printf("Done Step 9\nM=\n");
 mat_print(M, size);
 #endif
 	}
+
+	for (k = 0; k < n; k++)
+	{
+		M[k][k] = (int) xgcd_binary_l2r_s64(&u, &v, M[k][k], d);
+	}
 }
 
 
@@ -8,6 +8,9 @@
 #ifndef FUNCTIONS_H_
 #define FUNCTIONS_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 #define WITH_INDICES 1
 
 #ifndef ABS
@@ -18,6 +21,10 @@
 #define MIN(X,Y) (((X) < (Y)) ? (X) : (Y))
 #endif
 
+#ifndef MAX
+#define MAX(X,Y) (((X) > (Y)) ? (X) : (Y))
+#endif
+
 
 // HASH TABLE DECLARATIONS
 
@@ -65,6 +72,87 @@ void * htab_get(const htab_t * t, const long i);
 size_t htab_size(const htab_t * t);
 
 
+// OPEN ADDRESSING HASH TABLE DECLARATIONS
+// A slot is occupied if its epoch is the epoch of the table, so emptying the
+// table only bumps the epoch. An occupied slot is live if it is still the slot
+// of its item, so truncating the table only lowers cur_size. Dead slots stay in
+// the probe sequences until the next rehash.
+
+typedef struct
+{
+	uint32_t idx;						// insertion index of the item
+	uint32_t epoch;						// epoch in which the slot was filled
+	int hash;							// cached hash of the item
+} oaslot_t;
+
+typedef struct
+{
+	size_t item_size;					// size of an item in the arena
+	size_t cur_size;					// current number of elements
+	size_t allocated;					// number of items the arena can hold
+	char * items;						// arena of items in insertion order
+	uint32_t * where;					// slot of each item
+
+	size_t payload_size;				// size of a payload, 0 without a payload arena
+	char * payload;						// arena of payloads parallel to items
+
+	int bits;							// log2 of the number of slots
+	size_t mask;						// number of slots minus one
+	size_t used;						// number of occupied slots, live or dead
+	uint32_t epoch;						// current epoch
+	oaslot_t * slots;					// linear probing slot array
+
+	size_t finds;						// number of lookups
+	size_t probes;						// occupied slots visited by the lookups
+	size_t max_probes;					// longest probe sequence of a lookup
+
+	int (*hash) (const void *);				// hash function to use
+	int (*eq) (const void *, const void *);	// function for element comparison
+	void (*del) (void *);					// called when item gets deleted
+} oatab_t;
+
+void oatab_init(oatab_t * t, const size_t size, const size_t item_size, int (*hash)(const void *), int (*eq) (const void *, const void *), void (*del) (void *));
+
+void oatab_init_soa(oatab_t * t, const size_t size, const size_t key_size, const size_t payload_size, int (*hash)(const void *), int (*eq) (const void *, const void *));
+
+// the bytes oatab_init_soa allocates for size items, before the table grows
+size_t oatab_memory(const size_t size, const size_t key_size, const size_t payload_size);
+
+void oatab_empty(oatab_t * t);
+
+void oatab_clear(oatab_t * t);
+
+void oatab_insert(oatab_t * t, const void * G);
+
+void oatab_insert_soa(oatab_t * t, const void * G, const void * P);
+
+void * oatab_find(oatab_t * t, const void * G);
+
+long oatab_find_index(oatab_t * t, const void * G);
+
+void oatab_delete_from(oatab_t * t, const long i);
+
+void oatab_truncate(oatab_t * t, const size_t n);
+
+static __inline__
+void * oatab_get(const oatab_t * t, const long i)
+{
+	return t->items + i * t->item_size;
+}
+
+static __inline__
+void * oatab_payload(const oatab_t * t, const long i)
+{
+	return t->payload + i * t->payload_size;
+}
+
+static __inline__
+size_t oatab_size(const oatab_t * t)
+{
+	return t->cur_size;
+}
+
+
 // VECTOR DECLARATIONS
 
 typedef struct
@@ -0,0 +1,614 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gzio.h"
+
+#define GZ_OUT_SIZE (1 << 18)
+
+
+// GZIP WRITER IMPLEMENTATION
+
+static void gzout_fail(const gzout_t * s, const char * what)
+{
+	char data[600];
+
+	sprintf(data, "Unable to %s %s", what, s->path);
+	perror(data);
+	fflush(stderr);
+	exit(1);
+}
+
+// runs deflate over len bytes of data and writes out everything it produces
+static void gzout_deflate(gzout_t * s, const char * data, const size_t len, const int flush)
+{
+	size_t have;
+
+	s->strm.next_in = (Bytef *) data;
+	s->strm.avail_in = len;
+
+	do
+	{
+		s->strm.next_out = s->out;
+		s->strm.avail_out = GZ_OUT_SIZE;
+
+		if (deflate(&s->strm, flush) == Z_STREAM_ERROR)
+		{
+			gzout_fail(s, "compress");
+		}
+
+		have = GZ_OUT_SIZE - s->strm.avail_out;
+
+		if (have && fwrite(s->out, 1, have, s->fd) != have)
+		{
+			gzout_fail(s, "write");
+		}
+	} while (s->strm.avail_out == 0);
+}
+
+static void * gzout_worker(void * arg)
+{
+	gzout_t * s = (gzout_t *) arg;
+	int last;
+
+	do
+	{
+		pthread_mutex_lock(&s->lock);
+		while (s->job == -1)
+		{
+			pthread_cond_wait(&s->cond, &s->lock);
+		}
+		last = s->job_last;
+		pthread_mutex_unlock(&s->lock);
+
+		gzout_deflate(s, s->buf[s->job], s->job_len, s->job_flush);
+
+		pthread_mutex_lock(&s->lock);
+		s->job = -1;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+	} while (!last);
+
+	return NULL;
+}
+
+// compresses the current buffer, in the background if the writer is threaded
+static void gzout_flush(gzout_t * s, const int flush)
+{
+	if (!s->threaded)
+	{
+		gzout_deflate(s, s->buf[0], s->len, flush);
+		s->len = 0;
+		return;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	while (s->job != -1)
+	{
+		pthread_cond_wait(&s->cond, &s->lock);
+	}
+
+	s->job = s->cur;
+	s->job_len = s->len;
+	s->job_flush = flush;
+	s->job_last = s->closing;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+
+	s->cur ^= 1;
+	s->len = 0;
+}
+
+// waits until the thread is done with the buffer it was handed
+static void gzout_wait(gzout_t * s)
+{
+	if (!s->threaded)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	while (s->job != -1)
+	{
+		pthread_cond_wait(&s->cond, &s->lock);
+	}
+	pthread_mutex_unlock(&s->lock);
+}
+
+// record the original name and time, just like gzip does
+static void gzout_header(gzout_t * s)
+{
+	memset(&s->header, 0, sizeof(gz_header));
+	s->header.time = (uLong) time(NULL);
+	s->header.os = 3;
+	s->header.name = (Bytef *) s->name;
+	deflateSetHeader(&s->strm, &s->header);
+}
+
+// sets up the stream and the buffers once fd is open
+static void gzout_start(gzout_t * s, const int threaded)
+{
+	s->strm.zalloc = Z_NULL;
+	s->strm.zfree = Z_NULL;
+	s->strm.opaque = Z_NULL;
+
+	// windowBits 15 + 16 selects the gzip wrapper, level 6 is the gzip default
+	if (deflateInit2(&s->strm, 6, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		gzout_fail(s, "initialise zlib for");
+	}
+
+	gzout_header(s);
+
+	s->threaded = threaded;
+	s->closing = 0;
+	s->cur = 0;
+	s->len = 0;
+	s->job = -1;
+	s->buf[0] = (char *) malloc(GZ_BUF_SIZE);
+	s->buf[1] = threaded ? (char *) malloc(GZ_BUF_SIZE) : NULL;
+	s->out = (unsigned char *) malloc(GZ_OUT_SIZE);
+
+	if (threaded)
+	{
+		pthread_mutex_init(&s->lock, NULL);
+		pthread_cond_init(&s->cond, NULL);
+
+		if (pthread_create(&s->thread, NULL, &gzout_worker, s) != 0)
+		{
+			gzout_fail(s, "start the compression thread for");
+		}
+	}
+}
+
+void gzout_open(gzout_t * s, const char * path, const int threaded)
+{
+	const char * base = strrchr(path, '/');
+
+	s->path = strdup(path);
+	s->name = strdup((base != NULL) ? base + 1 : path);
+	s->in_memory = 0;
+	s->fd = fopen(path, "wb");
+
+	if (s->fd == NULL)
+	{
+		gzout_fail(s, "open");
+	}
+
+	gzout_start(s, threaded);
+}
+
+void gzout_open_mem(gzout_t * s, const char * path, const int threaded)
+{
+	const char * base = strrchr(path, '/');
+
+	s->path = strdup(path);
+	s->name = strdup((base != NULL) ? base + 1 : path);
+	s->in_memory = 1;
+	s->mem = NULL;
+	s->mem_len = 0;
+	s->fd = open_memstream(&s->mem, &s->mem_len);
+
+	if (s->fd == NULL)
+	{
+		gzout_fail(s, "open a memory stream for");
+	}
+
+	gzout_start(s, threaded);
+}
+
+void gzout_resume(gzout_t * s, const char * path, const int threaded, const long offset)
+{
+	const char * base = strrchr(path, '/');
+
+	s->path = strdup(path);
+	s->name = strdup((base != NULL) ? base + 1 : path);
+	s->in_memory = 0;
+	s->fd = fopen(path, "r+b");
+
+	if (s->fd == NULL || ftruncate(fileno(s->fd), offset) != 0 || fseek(s->fd, offset, SEEK_SET) != 0)
+	{
+		gzout_fail(s, "resume");
+	}
+
+	gzout_start(s, threaded);
+}
+
+long gzout_checkpoint(gzout_t * s)
+{
+	long offset;
+
+	gzout_flush(s, Z_FINISH);
+	gzout_wait(s);
+
+	if (fflush(s->fd) != 0 || (offset = ftell(s->fd)) < 0)
+	{
+		gzout_fail(s, "write");
+	}
+
+	// the next member starts with a header of its own
+	if (deflateReset(&s->strm) != Z_OK)
+	{
+		gzout_fail(s, "compress");
+	}
+
+	gzout_header(s);
+
+	return offset;
+}
+
+void gzout_write(gzout_t * s, const char * data, size_t len)
+{
+	size_t n;
+
+	while (len > 0)
+	{
+		n = GZ_BUF_SIZE - s->len;
+		n = (len < n) ? len : n;
+
+		memcpy(s->buf[s->cur] + s->len, data, n);
+		s->len += n;
+		data += n;
+		len -= n;
+
+		if (s->len == GZ_BUF_SIZE)
+		{
+			gzout_flush(s, Z_NO_FLUSH);
+		}
+	}
+}
+
+void gzout_close(gzout_t * s)
+{
+	char name[600];
+
+	s->closing = 1;
+	gzout_flush(s, Z_FINISH);
+
+	if (s->threaded)
+	{
+		pthread_join(s->thread, NULL);
+		pthread_mutex_destroy(&s->lock);
+		pthread_cond_destroy(&s->cond);
+	}
+
+	deflateEnd(&s->strm);
+
+	if (fclose(s->fd) != 0)
+	{
+		gzout_fail(s, "close");
+	}
+
+	sprintf(name, "%s.gz", s->path);
+
+	if (!s->in_memory && rename(s->path, name) != 0)
+	{
+		gzout_fail(s, "rename");
+	}
+
+	free(s->buf[0]);
+	free(s->buf[1]);
+	free(s->out);
+	free(s->name);
+	free(s->path);
+}
+
+
+
+// GZIP TEST
+
+int gz_test(const char * name)
+{
+	char buf[1 << 16];
+	int n, err;
+	gzFile fd = gzopen(name, "rb");
+
+	if (fd == NULL)
+	{
+		return 0;
+	}
+
+	while ((n = gzread(fd, buf, sizeof(buf))) > 0);
+
+	// zlib reads files without a gzip header transparently, gzip -t does not
+	gzerror(fd, &err);
+	if (n < 0 || err != Z_OK || gzdirect(fd))
+	{
+		gzclose(fd);
+		return 0;
+	}
+
+	return gzclose(fd) == Z_OK;
+}
+
+
+
+// CHECKPOINT IMPLEMENTATION
+
+void ckpt_write(const char * path, const long * run, const int run_n, const long * v, const int n)
+{
+	char name[600], temp[610];
+	FILE * fd;
+	int i;
+
+	sprintf(name, "%s.ckpt", path);
+	sprintf(temp, "%s.tmp", name);
+
+	if ((fd = fopen(temp, "w")) == NULL)
+	{
+		perror("Unable to write a checkpoint\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	for (i = 0; i < run_n; i++)
+	{
+		fprintf(fd, "%ld ", run[i]);
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		fprintf(fd, (i < n - 1) ? "%ld " : "%ld\n", v[i]);
+	}
+
+	// the rename must not reach the disk before the line does
+	if (fflush(fd) != 0 || fsync(fileno(fd)) != 0 || fclose(fd) != 0 || rename(temp, name) != 0)
+	{
+		perror("Unable to write a checkpoint\n");
+		fflush(stderr);
+		exit(1);
+	}
+}
+
+int ckpt_read(const char * path, const long * run, const int run_n, long * v, const int n)
+{
+	char name[600];
+	FILE * fd;
+	long x;
+	int i;
+
+	sprintf(name, "%s.ckpt", path);
+
+	if ((fd = fopen(name, "r")) == NULL)
+	{
+		return 0;
+	}
+
+	for (i = 0; i < run_n && fscanf(fd, "%ld", &x) == 1 && x == run[i]; i++);
+
+	const int same = (i == run_n);
+
+	for (i = 0; same && i < n && fscanf(fd, "%ld", v + i) == 1; i++);
+
+	// a longer line is of another run too
+	if (!same || (i == n && fscanf(fd, "%ld", &x) == 1))
+	{
+		fclose(fd);
+		fprintf(stderr, "The checkpoint %s was written by a run with other parameters, remove it to start over\n", name);
+		fflush(stderr);
+		exit(1);
+	}
+
+	fclose(fd);
+
+	return (i == n);
+}
+
+void ckpt_remove(const char * path)
+{
+	char name[600];
+
+	sprintf(name, "%s.ckpt", path);
+	remove(name);
+}
+
+
+
+// GZIP READER IMPLEMENTATION
+
+static void gzin_fail(const gzin_t * s, const char * what)
+{
+	char data[600];
+
+	sprintf(data, "Unable to %s %s", what, s->path);
+	perror(data);
+	fflush(stderr);
+	exit(1);
+}
+
+// moves the unparsed tail to the front and inflates until the buffer is full
+// or the file ends, concatenated gzip members are read one after another
+static void gzin_fill(gzin_t * s)
+{
+	int ret;
+
+	memmove(s->buf, s->buf + s->head, s->tail - s->head);
+	s->tail -= s->head;
+	s->head = 0;
+
+	s->strm.next_out = (Bytef *) s->buf + s->tail;
+	s->strm.avail_out = GZ_BUF_SIZE - s->tail;
+
+	while (s->strm.avail_out > 0 && !s->eof)
+	{
+		if (s->strm.avail_in == 0)
+		{
+			s->strm.avail_in = fread(s->in, 1, GZ_OUT_SIZE, s->fd);
+			s->strm.next_in = s->in;
+
+			if (s->strm.avail_in == 0)
+			{
+				if (ferror(s->fd))
+				{
+					gzin_fail(s, "read");
+				}
+
+				// the file ended inside a member
+				fprintf(stderr, "Unexpected end of file %s\n", s->path);
+				fflush(stderr);
+				exit(1);
+			}
+		}
+
+		ret = inflate(&s->strm, Z_NO_FLUSH);
+
+		if (ret == Z_STREAM_END)
+		{
+			if (s->strm.avail_in == 0)
+			{
+				s->strm.avail_in = fread(s->in, 1, GZ_OUT_SIZE, s->fd);
+				s->strm.next_in = s->in;
+			}
+
+			if (s->strm.avail_in == 0)
+			{
+				s->eof = 1;
+			}
+			else
+			{
+				inflateReset(&s->strm);
+			}
+		}
+		else if (ret != Z_OK && ret != Z_BUF_ERROR)
+		{
+			fprintf(stderr, "Corrupt gzip data in %s\n", s->path);
+			fflush(stderr);
+			exit(1);
+		}
+	}
+
+	s->tail = GZ_BUF_SIZE - s->strm.avail_out;
+}
+
+void gzin_open(gzin_t * s, const char * path)
+{
+	s->path = strdup(path);
+	s->fd = fopen(path, "rb");
+
+	if (s->fd == NULL)
+	{
+		gzin_fail(s, "open");
+	}
+
+	s->strm.zalloc = Z_NULL;
+	s->strm.zfree = Z_NULL;
+	s->strm.opaque = Z_NULL;
+	s->strm.next_in = Z_NULL;
+	s->strm.avail_in = 0;
+
+	if (inflateInit2(&s->strm, 15 + 16) != Z_OK)
+	{
+		gzin_fail(s, "initialise zlib for");
+	}
+
+	s->in = (unsigned char *) malloc(GZ_OUT_SIZE);
+	s->buf = (char *) malloc(GZ_BUF_SIZE);
+	s->head = 0;
+	s->tail = 0;
+	s->eof = 0;
+}
+
+// parses the integers of the next non-empty line into v, at most max of them,
+// returns how many were stored or 0 at the end of the file
+int gzin_line(gzin_t * s, long * v, const int max)
+{
+	char * p, * end;
+	long x;
+	int n, neg;
+
+	for (;;)
+	{
+		end = (char *) memchr(s->buf + s->head, '\n', s->tail - s->head);
+
+		if (end == NULL)
+		{
+			if (!s->eof)
+			{
+				if (s->head == 0 && s->tail == GZ_BUF_SIZE)
+				{
+					fprintf(stderr, "Line too long in %s\n", s->path);
+					fflush(stderr);
+					exit(1);
+				}
+
+				gzin_fill(s);
+				continue;
+			}
+
+			if (s->head == s->tail)
+			{
+				return 0;
+			}
+
+			// last line without a newline
+			end = s->buf + s->tail;
+		}
+
+		p = s->buf + s->head;
+		s->head = end - s->buf + (end < s->buf + s->tail);
+
+		for (n = 0; n < max; n++)
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			{
+				p++;
+			}
+
+			if (p == end)
+			{
+				break;
+			}
+
+			neg = (*p == '-');
+			p += neg;
+
+			for (x = 0; p < end && (unsigned) (*p - '0') < 10; p++)
+			{
+				x = 10 * x + (*p - '0');
+			}
+
+			v[n] = neg ? -x : x;
+
+			while (p < end && *p != ' ' && *p != '\t')
+			{
+				p++;
+			}
+		}
+
+		if (n > 0)
+		{
+			return n;
+		}
+	}
+}
+
+void gzin_close(gzin_t * s)
+{
+	inflateEnd(&s->strm);
+	fclose(s->fd);
+	free(s->in);
+	free(s->buf);
+	free(s->path);
+}
@@ -0,0 +1,150 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#ifndef GZIO_H_
+#define GZIO_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+
+// size of each input buffer of the writer
+#ifndef GZ_BUF_SIZE
+#define GZ_BUF_SIZE (1 << 20)
+#endif
+
+// compress in a background thread, off by default since every core already
+// runs an MPI rank
+#ifdef WITH_GZ_THREAD
+#define GZ_THREADED 1
+#else
+#define GZ_THREADED 0
+#endif
+
+
+// GZIP WRITER
+// Writes a single gzip member, the same container "gzip name" produces, or one
+// member per checkpoint. While the file is being written it lives under the
+// uncompressed name, and it is renamed to name.gz on gzout_close, so a
+// finished .gz is always complete. gzout_open_mem writes the same bytes to
+// memory instead.
+
+typedef struct
+{
+	FILE * fd;
+	z_stream strm;
+	char * path;						// partial file, the uncompressed name
+	char * name;						// original name stored in the header
+	gz_header header;
+
+	char * buf[2];						// input buffers
+	int cur;							// buffer being filled
+	size_t len;							// bytes in the current buffer
+	unsigned char * out;				// deflate output chunk
+
+	int threaded;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int job;							// buffer handed to the thread, -1 if idle
+	size_t job_len;
+	int job_flush;
+	int job_last;						// the thread exits after this buffer
+	int closing;
+
+	int in_memory;						// opened with gzout_open_mem
+	char * mem;
+	size_t mem_len;
+} gzout_t;
+
+void gzout_open(gzout_t * s, const char * path, const int threaded);
+
+// path only names the file in the header, after gzout_close the .gz file is
+// in mem and mem_len, and the caller frees mem
+void gzout_open_mem(gzout_t * s, const char * path, const int threaded);
+
+// reopens the partial file path, dropping everything after offset
+void gzout_resume(gzout_t * s, const char * path, const int threaded, const long offset);
+
+// ends the current gzip member, so that the file up to the returned offset
+// is a complete gzip file of its own; writing carries on in a new member
+long gzout_checkpoint(gzout_t * s);
+
+void gzout_write(gzout_t * s, const char * data, size_t len);
+
+void gzout_close(gzout_t * s);
+
+static __inline__
+void gzout_puts(gzout_t * s, const char * str)
+{
+	gzout_write(s, str, strlen(str));
+}
+
+// returns 1 if name is a complete, uncorrupted gzip file
+int gz_test(const char * name);
+
+
+// CHECKPOINTS
+// A long running writer saves a checkpoint every CKPT_SECONDS: the offset
+// returned by gzout_checkpoint (or clbout_checkpoint) followed by whatever
+// else it needs to resume, as one line of integers in path.ckpt. The line is
+// written to a temporary file that is synced and then renamed, so a checkpoint
+// is either complete or absent, and it always refers to data already in the
+// file. The line starts with the run_n integers of run, the parameters of the
+// run that wrote it, and a run with other ones refuses to resume from it.
+
+#ifndef CKPT_SECONDS
+#define CKPT_SECONDS 600
+#endif
+
+void ckpt_write(const char * path, const long * run, const int run_n, const long * v, const int n);
+
+// returns 1 if path.ckpt exists and holds run and n integers, exits if it
+// holds the parameters of another run
+int ckpt_read(const char * path, const long * run, const int run_n, long * v, const int n);
+
+void ckpt_remove(const char * path);
+
+
+// GZIP READER
+// Inflates a gzip file in-process into a buffer and parses whitespace
+// separated integer records straight out of it. Only the unparsed tail of the
+// buffer, a partial line, is moved to the front before each refill.
+
+typedef struct
+{
+	FILE * fd;
+	z_stream strm;
+	char * path;
+	unsigned char * in;					// compressed input chunk
+	char * buf;							// inflated text
+	size_t head;						// start of the next line in buf
+	size_t tail;						// end of the inflated text in buf
+	int eof;							// all of the file has been inflated
+} gzin_t;
+
+void gzin_open(gzin_t * s, const char * path);
+
+int gzin_line(gzin_t * s, long * v, const int max);
+
+void gzin_close(gzin_t * s);
+
+#endif /* GZIO_H_ */
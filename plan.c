@@ -0,0 +1,426 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include <sys/time.h>
+
+#include <liboptarith/primes.h>
+
+#include "clgrp.h"
+#include "sieve.h"
+#include "gzio.h"
+#include "plan.h"
+
+#define MB (1024.0 * 1024.0)
+
+// the buffers of a gzip stream of gzio.c and the state of zlib for it
+#define PLAN_GZ (2.0 * GZ_BUF_SIZE + (1 << 19))
+
+static const int plan_classes[4][2] = {{3, 8}, {7, 8}, {4, 16}, {8, 16}};
+
+// the stride of the factor tables of clgrp for |D| < D_max in the class of a,
+// one more than the most distinct prime factors
+static int plan_stride(const long D_max, const int a)
+{
+	long temp = ((a & 3) == 0) ? 4 : 1;
+	int i;
+
+	for (i = 2; temp < D_max; i++)
+	{
+		temp *= prime_list[i - 1];
+	}
+
+	return i - ((a & 3) != 0) + 1;
+}
+
+// Ramare's bound, the h_max of the mains
+static long plan_h_max(const long D_max)
+{
+	return (1/M_PI) * sqrt(D_max) * (0.5 * log(D_max) + 2.5 - log(6)) + 1;
+}
+
+// the most distinct prime factors of a class number below h_max
+static int plan_h_factors(const long h_max)
+{
+	long temp = 1;
+	int i;
+
+	for (i = 1; temp < h_max; i++)
+	{
+		temp *= prime_list[i - 1];
+	}
+
+	return i;
+}
+
+// the rows of a block or job rounded up to a power of 2
+static long plan_pow2(const long n)
+{
+	long p = 1;
+
+	while (p < n)
+	{
+		p <<= 1;
+	}
+
+	return p;
+}
+
+// returns 0 unless prime_list holds the primes of R and Q for |D| below
+// D_table and those of h_lower_bound below D_max
+static int plan_primes(const long D_max, const long D_table)
+{
+	const int largest = prime_list[prime_list_count - 1];
+	const long table = (((long) sqrt(h_upper_bound(-D_table))) << 1) - 1;
+	const long lower = h_lower_bound_primes(D_max);
+
+	printf("prime table: liboptarith holds the primes up to %d, R and Q take one above %ld, h_lower_bound one from %ld\n", largest, table, lower);
+
+	if (table >= largest || lower > largest)
+	{
+		printf("  not enough primes in liboptarith/primes.h, rebuild liboptarith with more of them, see README.md\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+// returns 0 unless the smallest prime factor table of the ells stays within int
+static int plan_spf(const long D_max, const ell_list_t * ells, double * bytes)
+{
+	long ell_max = 0, spf_max;
+	int e;
+
+	*bytes = 0;
+
+	if (ells == NULL)
+	{
+		return 1;
+	}
+
+	for (e = 0; e < ells->count; e++)
+	{
+		ell_max = MAX(ell_max, ells->ell[e]);
+	}
+
+	spf_max = plan_h_max(D_max) * ell_max * (ell_max + 1);
+	*bytes = (double) spf_max * sizeof(int);
+
+	if (spf_max > INT_MAX)
+	{
+		printf("the smallest prime factors up to %ld for ell=%ld do not fit in an int, lower D_max or the ells\n", spf_max, ell_max);
+		return 0;
+	}
+
+	return 1;
+}
+
+static int plan_fundamental(long n, const int * primes)
+{
+	for (int i = 1; (long) primes[i] * primes[i] <= n; i++)
+	{
+		if (n % primes[i] == 0)
+		{
+			n /= primes[i];
+
+			if (n % primes[i] == 0)
+			{
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+// seconds of compute_group_bjt for a fundamental discriminant just below
+// D_max in the class a mod m, as clgrp runs it without class numbers, and the
+// share of the discriminants there that are fundamental
+static double plan_sample(const long D_max, const int a, const int m, const int * primes, double * density)
+{
+	long D[PLAN_SAMPLES], d, tried = 0;
+	int init_pow[PLAN_SAMPLES], h_star[PLAN_SAMPLES], ell[PLAN_SAMPLES], rank[PLAN_SAMPLES];
+	int * out = (int *) malloc(PLAN_SAMPLES * BJT_BATCH_ROW * sizeof(int));
+	const long res = ((a & 3) != 3) ? a : 1;
+	struct timeval begin, end;
+	bjt_batch_t b;
+	int count = 0;
+
+	for (d = a + (D_max - 1 - a) / m * m; count < PLAN_SAMPLES && d > m; d -= m, tried++)
+	{
+		if (plan_fundamental(d / res, primes))
+		{
+			D[count] = -d;
+			init_pow[count] = 1;
+			h_star[count] = h_lower_bound(-d);
+			ell[count] = 0;
+			count++;
+		}
+	}
+
+	*density = (tried > 0) ? (double) count / tried : 0;
+
+	bjt_batch_init(&b, D_max);
+	gettimeofday(&begin, NULL);
+	bjt_batch_compute(&b, rank, out, D, init_pow, h_star, ell, count);
+	gettimeofday(&end, NULL);
+	bjt_batch_clear(&b);
+	free(out);
+
+	return (count > 0) ? ((end.tv_sec - begin.tv_sec) + (end.tv_usec - begin.tv_usec) / 1e6) / count : 0;
+}
+
+// the cost of the scheduler of the part of the file index, see sched.h
+static double plan_job_cost(const int index, const int part, const long D_total, const int m)
+{
+	const long first = (long) part * PART_TOTAL;
+	const long last = MIN(first + PART_TOTAL, D_total);
+
+	return (last - first) * sqrt(h_upper_bound(-(index * D_total + last) * m));
+}
+
+// the most ranks of the fewest threads a node holds in budget bytes with the
+// current block size, 0 if not even a rank of all of the cores
+static int plan_ranks(const long D_max, const int stride, const int ell_count, const int cores, const double budget, const double prime_bytes,
+				int * threads, double * rank_bytes)
+{
+	for (*threads = 1; *threads <= cores; (*threads)++)
+	{
+		*rank_bytes = tab_memory(D_max, stride, *threads, ell_count) + prime_bytes + (1 + ell_count) * PLAN_GZ;
+
+		if ((cores / *threads) * *rank_bytes <= budget)
+		{
+			return cores / *threads;
+		}
+	}
+
+	return 0;
+}
+
+int plan_clgrp(const long D_max, const ell_list_t * ells, const int nodes, const int cores, const double memory)
+{
+	const int ell_count = ells ? ells->count : 0;
+	const long D_root = sqrt(D_max);
+	const long h_max = plan_h_max(D_max);
+	const double prime_bytes = (int) (1.25506 * D_root / log(D_root)) * sizeof(int);
+	double spf_bytes, rank_bytes = 0, h_bytes;
+	long block, target, files;
+	int c, i, threads = 0, ranks = 0, stride = 0;
+
+	printf("clgrp plan: D_max=%ld, %d nodes of %d cores and %.1f GiB\n", D_max, nodes, cores, memory / (1024 * MB));
+
+	if (!plan_primes(D_max, D_max) || !plan_spf(D_max, ells, &spf_bytes))
+	{
+		return 0;
+	}
+
+	if (h_max > INT_MAX)
+	{
+		printf("Ramare's bound %ld on the class numbers does not fit in an int, lower D_max\n", h_max);
+		return 0;
+	}
+
+	for (c = 0; c < 4; c++)
+	{
+		stride = MAX(stride, plan_stride(D_max, plan_classes[c][0]));
+	}
+
+	h_bytes = (double) h_max * plan_h_factors(h_max) * sizeof(int);
+
+	// the largest block that keeps the sieve cheap per prime, if need be a
+	// smaller one, and the fewest threads per rank that fit the node
+	target = plan_pow2(MAX(TAB_ROUND, MIN(PLAN_SIEVE * (long) (1.25506 * D_root / log(D_root)), PART_TOTAL)));
+	target = MIN(target, MAX(TAB_ROUND, plan_pow2(D_max / 8)));
+
+	for (block = target; block >= TAB_ROUND; block >>= 1)
+	{
+		tab_block_set(block);
+
+		if ((ranks = plan_ranks(D_max, stride, ell_count, cores, PLAN_HEADROOM * memory - spf_bytes, prime_bytes, &threads, &rank_bytes)) > 0)
+		{
+			break;
+		}
+	}
+
+	printf("memory per node: %.1f MB of smallest prime factors for the ells, %.1f MB of class number factors with h_prefix\n", spf_bytes / MB, h_bytes / MB);
+
+	if (ranks == 0)
+	{
+		tab_block_set(TAB_ROUND);
+		printf("memory per rank: %.1f MB at least, a node does not hold a rank\n", (tab_memory(D_max, stride, 1, ell_count) + prime_bytes + (1 + ell_count) * PLAN_GZ) / MB);
+		tab_block_set(FAC_TOTAL);
+		return 0;
+	}
+
+	printf("memory per rank: %.1f MB with blocks of %ld discriminants, factor tables of stride %d and %d threads\n", rank_bytes / MB, block, stride, threads);
+
+	if (spf_bytes + h_bytes + ranks * rank_bytes > PLAN_HEADROOM * memory)
+	{
+		printf("  with h_prefix the class number factors do not fit beside %d ranks, run fewer\n", ranks);
+	}
+
+	// the fewest files that split into at most PLAN_PARTS parts and give every
+	// rank PLAN_JOBS jobs, unless the files get smaller than a round
+	const long total_ranks = (long) nodes * ranks;
+
+	for (files = 1; D_max / (files * 32) >= TAB_ROUND; files <<= 1)
+	{
+		if (bjt_parts(D_max / (files * 8)) <= PLAN_PARTS && files * bjt_parts(D_max / (files * 16)) >= PLAN_JOBS * total_ranks)
+		{
+			break;
+		}
+	}
+
+	printf("recommended: %ld files, blocks of %ld, %d ranks per node of %d threads\n", files, block, ranks, threads);
+
+	if (files * bjt_parts(D_max / (files * 16)) < PLAN_JOBS * total_ranks)
+	{
+		printf("  only %ld jobs per class for %ld ranks, some will idle\n", files * bjt_parts(D_max / (files * 16)), total_ranks);
+	}
+
+	for (c = 0; c < 4; c++)
+	{
+		const int a = plan_classes[c][0], m = plan_classes[c][1];
+		const long D_total = D_max / (files * m);
+		const int parts = bjt_parts(D_total);
+		double density, cost, largest = 0, total = 0;
+		int * primes = (int *) malloc(((int) (1.25506 * (D_root + 1) / log(D_root + 1)) + 2) * sizeof(int));
+
+		prime_sieve(D_root + 1, primes);
+
+		// seconds per unit of cost of the scheduler
+		const double unit = plan_sample(D_max, a, m, primes, &density) * density / sqrt(h_upper_bound(-D_max));
+
+		free(primes);
+
+		if (D_max != files * m * D_total)
+		{
+			printf("  D_max is not a multiple of files * %d, the %ld discriminants from %ld on are left out\n", m, (D_max - files * m * D_total) / m, files * m * D_total);
+		}
+
+		printf("class %d mod %d: %.0f%% fundamental, file index costs", a, m, 100 * density);
+
+		for (i = 0; i < files; i++)
+		{
+			cost = 0;
+
+			for (int part = 0; part < parts; part++)
+			{
+				cost += plan_job_cost(i, part, D_total, m) * unit;
+				largest = MAX(largest, plan_job_cost(i, part, D_total, m) * unit);
+			}
+
+			total += cost;
+
+			if (i == 0 || i == files - 1 || (files >= 4 && (i % (files / 4)) == 0))
+			{
+				printf(" %d: %.1f s,", i, cost);
+			}
+		}
+
+		printf(" in all %.2f core hours\n", total / 3600);
+		printf("  about %.2f hours on %ld ranks of %d threads\n", MAX(total / (total_ranks * threads), largest / threads) / 3600, total_ranks, threads);
+		printf("  mpirun -np %ld ./clgrp %ld %ld %d %d null [folder] %d %s %ld\n", total_ranks + 1, D_max, files, a, m, threads, ells ? "[ells]" : "null", block);
+	}
+
+	tab_block_set(FAC_TOTAL);
+	fflush(stdout);
+
+	return 1;
+}
+
+int plan_clgrp_ell(const long D_max, const long files, const ell_list_t * ells, const int nodes, const int cores, const double memory)
+{
+	long ell_max = 0;
+	double spf_bytes, rank_bytes, total = 0;
+	int e, i, ranks;
+
+	for (e = 0; e < ells->count; e++)
+	{
+		ell_max = MAX(ell_max, ells->ell[e]);
+	}
+
+	printf("clgrp_ell plan: D_max=%ld, %ld files, %d nodes of %d cores and %.1f GiB\n", D_max, files, nodes, cores, memory / (1024 * MB));
+
+	if (!plan_primes(D_max, D_max * ell_max * ell_max * ell_max * ell_max) || !plan_spf(D_max, ells, &spf_bytes))
+	{
+		return 0;
+	}
+
+	// R and Q sized for the largest ell, the gzip streams of the input and outputs
+	const int table_size = next_prime((((int) sqrt(h_upper_bound(-D_max * ell_max * ell_max * ell_max * ell_max))) << 1) - 1);
+	rank_bytes = 2 * oatab_memory(table_size, sizeof(form_t), 0) + (1 + ells->count) * PLAN_GZ;
+
+	#ifdef WITH_S128_QFORMS
+	rank_bytes += 2 * oatab_memory(table_size, sizeof(form_t_s128), 0);
+	#endif
+
+	ranks = MIN(cores, (PLAN_HEADROOM * memory - spf_bytes) / rank_bytes);
+
+	printf("memory per node: %.1f MB of smallest prime factors\n", spf_bytes / MB);
+	printf("memory per rank: %.1f MB\n", rank_bytes / MB);
+
+	if (ranks <= 0)
+	{
+		printf("  a node does not hold the smallest prime factors and a rank\n");
+		return 0;
+	}
+
+	for (i = 0; i < files; i++)
+	{
+		total += sqrt(h_upper_bound(-(i + 1) * D_max / files));
+	}
+
+	printf("recommended: %d ranks per node\n", ranks);
+	printf("file index costs, as shares of a class:");
+
+	for (i = 0; i < files; i++)
+	{
+		if (i == 0 || i == files - 1 || (files >= 4 && (i % (files / 4)) == 0))
+		{
+			printf(" %d: %.3f%%,", i, 100 * sqrt(h_upper_bound(-(i + 1) * D_max / files)) / total);
+		}
+	}
+
+	printf("\n");
+
+	if (4 * files < PLAN_JOBS * nodes * ranks)
+	{
+		printf("  only %ld jobs for %ld ranks, some will idle\n", 4 * files, (long) nodes * ranks);
+	}
+
+	for (i = 0; i < 4; i++)
+	{
+		if (D_max % (files * plan_classes[i][1]) != 0)
+		{
+			printf("  D_max is not a multiple of files * %d\n", plan_classes[i][1]);
+			break;
+		}
+	}
+
+	printf("  mpirun -np %ld ./clgrp_ell %ld %ld [ells] [folder]\n", (long) nodes * ranks + 1, D_max, files);
+	fflush(stdout);
+
+	return 1;
+}
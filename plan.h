@@ -0,0 +1,51 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include "clgrp.h"
+
+// RESOURCE PLANNER
+// clgrp --plan and clgrp_ell --plan size a run up front rather than by trial
+// and error. Given D_max, the ells and nodes of the given cores and memory,
+// they check that the prime table of liboptarith holds the primes the run
+// takes and that the shared tables stay within int, then print the memory of
+// the tables shared per node and of a worker rank, the cost of the files and
+// the files, sieve block size, ranks per node and threads per rank to run
+// with. The cost of clgrp is measured on PLAN_SAMPLES discriminants just
+// below D_max in each class, and scaled to the files by the cost model of the
+// scheduler, see sched.h. Both return 0 if the run cannot go ahead.
+
+#ifndef PLAN_SAMPLES
+#define PLAN_SAMPLES 64
+#endif
+
+#define PLAN_HEADROOM 0.9				// share of the memory of a node the ranks may take
+#define PLAN_JOBS 4						// jobs per rank for the scheduler to balance
+#define PLAN_PARTS 8					// most parts of a file
+#define PLAN_SIEVE 8					// least rows of a block per prime of the sieve
+
+// memory is in bytes and ells may be NULL
+int plan_clgrp(const long D_max, const ell_list_t * ells, const int nodes, const int cores, const double memory);
+
+int plan_clgrp_ell(const long D_max, const long files, const ell_list_t * ells, const int nodes, const int cores, const double memory);
+
+#endif /* PLAN_H_ */
@@ -26,9 +26,9 @@ int main() {
     int table_size = next_prime((((int) sqrt(h_max)) << 1) - 1);
     printf("Table size: %d\n", table_size);
 
-    htab_t R, Q;
-    htab_init(&R, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
-    htab_init(&Q, table_size, sizeof(form_t), &hash_form_t, &eq_form_t, &del_form_t);
+    oatab_t R, Q;
+    form_table_init(&R, table_size);
+    form_table_init(&Q, table_size);
 
     int result[MAX_RANK];
     
@@ -36,10 +36,16 @@ int main() {
     int rank = compute_group_bjt(result, D, init_pow, h_star, ell, &R, &Q);
     
     printf("Computation finished. Rank: %d\n", rank);
-    printf("Result: %d\n", result[0]);
 
-    htab_clear(&R);
-    htab_clear(&Q);
+    if (rank < 0) {
+        // abandoned, over BJT_BUDGET or h > 2 * h_star, result holds nothing
+        printf("Abandoned, no result\n");
+    } else {
+        printf("Result: %d\n", result[0]);
+    }
+
+    oatab_clear(&R);
+    oatab_clear(&Q);
 
     return 0;
 }
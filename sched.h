@@ -0,0 +1,516 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#ifndef SCHED_H_
+#define SCHED_H_
+
+#include <mpi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "clgrp.h"
+
+// WORK SCHEDULING
+// The masters sort their jobs by estimated cost and hand them out largest
+// first, one at a time to whichever worker reports back, so that the slow
+// jobs of large |D| do not end up in the tail of a run. The cost of a job is
+// its number of discriminants times sqrt(h) at its largest |D|, the work of
+// the baby steps and giant steps, with h_upper_bound standing in for h.
+
+#define SCHED_TAG_DONE 0
+#define SCHED_TAG_REPORT 1
+#define SCHED_TAG_PROGRESS 2
+
+typedef struct
+{
+	int index;							// file index
+	int part;							// part of the file, -1 for the whole file
+	int a, m;
+	double cost;
+} sched_job_t;
+
+// largest cost first, ties in file order
+static __inline__
+int sched_job_cmp(const void * x, const void * y)
+{
+	const sched_job_t * s = (const sched_job_t *) x;
+	const sched_job_t * t = (const sched_job_t *) y;
+
+	if (s->cost != t->cost)
+	{
+		return (s->cost < t->cost) ? 1 : -1;
+	}
+
+	if (s->index != t->index)
+	{
+		return s->index - t->index;
+	}
+
+	return s->part - t->part;
+}
+
+static __inline__
+double sched_time()
+{
+	struct timeval t;
+
+	gettimeofday(&t, NULL);
+
+	return t.tv_sec + t.tv_usec / 1e6;
+}
+
+
+// TELEMETRY
+// While a job runs its worker posts the progress of it to the master every
+// SCHED_PROGRESS_SECONDS, through the tab_progress hook of the tabulations.
+// The send does not block, and is skipped if the last one has not gone yet,
+// so that a busy master never holds up a worker. A message holds
+//
+//   D        the discriminant reached
+//   done     the rows of the job done
+//   total    the rows of the job in all
+//   ops      the compositions, squarings and powerings so far
+//   aborted  the discriminants abandoned so far
+//   rss      the resident memory of the worker in bytes
+//   job      the index, part, a and m of the job
+//
+// The master polls for them while it waits for the workers, and rewrites
+// the status file every SCHED_STATUS_SECONDS with the rates of the ranks,
+// smoothed over their messages, and the projected end of the run, from the
+// share of the cost of the jobs done, those under way by their rows done. A
+// rank is flagged slow below SCHED_SLOW times the median rate of the busy
+// ranks, and stalled after SCHED_STALL_SECONDS without a message. A message
+// still on its way when the job is done is dropped by its job, which keeps
+// it off the next job of the rank.
+
+#define SCHED_PROGRESS_LEN 10
+
+#ifndef SCHED_PROGRESS_SECONDS
+#define SCHED_PROGRESS_SECONDS 10
+#endif
+
+#ifndef SCHED_STATUS_SECONDS
+#define SCHED_STATUS_SECONDS 10
+#endif
+
+#ifndef SCHED_STALL_SECONDS
+#define SCHED_STALL_SECONDS 600
+#endif
+
+#define SCHED_SLOW 0.5
+#define SCHED_SMOOTH 0.25				// weight of the latest rate
+#define SCHED_POLL_USEC 5000
+
+static double sched_progress_msg[SCHED_PROGRESS_LEN];
+static MPI_Request sched_progress_req = MPI_REQUEST_NULL;
+static double sched_progress_sent = 0;
+static int sched_progress_job[4] = { -1, -1, 0, 0 };
+
+// the resident memory in bytes, the peak if /proc is not there
+static __inline__
+double sched_rss()
+{
+	FILE * f = fopen("/proc/self/statm", "r");
+	long pages;
+
+	if (f != NULL)
+	{
+		if (fscanf(f, "%*s %ld", &pages) != 1)
+		{
+			pages = 0;
+		}
+
+		fclose(f);
+
+		return (double) pages * sysconf(_SC_PAGESIZE);
+	}
+
+	struct rusage u;
+
+	getrusage(RUSAGE_SELF, &u);
+
+	return u.ru_maxrss * 1024.0;
+}
+
+// the job the next messages of the worker are about
+static __inline__
+void sched_progress_start(const int index, const int part, const int a, const int m)
+{
+	sched_progress_job[0] = index;
+	sched_progress_job[1] = part;
+	sched_progress_job[2] = a;
+	sched_progress_job[3] = m;
+}
+
+// for tab_progress_set in the workers
+static __inline__
+void sched_progress(const long D, const long done, const long total, const bjt_stats_t * stats)
+{
+	const double now = sched_time();
+	int flag;
+
+	if (now - sched_progress_sent < SCHED_PROGRESS_SECONDS)
+	{
+		return;
+	}
+
+	MPI_Test(&sched_progress_req, &flag, MPI_STATUS_IGNORE);
+
+	if (!flag)
+	{
+		return;
+	}
+
+	sched_progress_msg[0] = D;
+	sched_progress_msg[1] = done;
+	sched_progress_msg[2] = total;
+	sched_progress_msg[3] = bjt_stats_ops(stats);
+	sched_progress_msg[4] = stats->aborted;
+	sched_progress_msg[5] = sched_rss();
+	sched_progress_msg[6] = sched_progress_job[0];
+	sched_progress_msg[7] = sched_progress_job[1];
+	sched_progress_msg[8] = sched_progress_job[2];
+	sched_progress_msg[9] = sched_progress_job[3];
+
+	MPI_Isend(sched_progress_msg, SCHED_PROGRESS_LEN, MPI_DOUBLE, 0, SCHED_TAG_PROGRESS, MPI_COMM_WORLD, &sched_progress_req);
+	sched_progress_sent = now;
+}
+
+// completes the last message, before the worker sends its report
+static __inline__
+void sched_progress_flush()
+{
+	MPI_Wait(&sched_progress_req, MPI_STATUS_IGNORE);
+}
+
+typedef struct
+{
+	int index, part, a, m;				// the job, index -1 if the rank is idle
+	double cost;
+	double since;						// when the job was handed out
+	double seen;						// when the last message came
+	double msg[SCHED_PROGRESS_LEN];		// the last message of the job, total 0 if none
+	double rate;						// rows per second
+	double ops_rate;					// operations per second
+	int jobs;
+} sched_rank_t;
+
+typedef struct
+{
+	char path[600];
+	int num_procs;
+	int jobs, done;
+	double start, written;
+	double cost, cost_done;
+	sched_rank_t * rank;				// rank[i] for the worker i, 1 <= i <= num_procs
+} sched_status_t;
+
+static __inline__
+void sched_status_init(sched_status_t * s, const char * path, const int num_procs, const sched_job_t * jobs, const int total)
+{
+	int i;
+
+	snprintf(s->path, sizeof(s->path), "%s", path);
+	s->num_procs = num_procs;
+	s->jobs = total;
+	s->done = 0;
+	s->start = sched_time();
+	s->written = s->start;
+	s->cost = 0;
+	s->cost_done = 0;
+	s->rank = (sched_rank_t *) calloc(num_procs + 1, sizeof(sched_rank_t));
+
+	for (i = 0; i < total; i++)
+	{
+		s->cost += jobs[i].cost;
+	}
+
+	for (i = 0; i <= num_procs; i++)
+	{
+		s->rank[i].index = -1;
+	}
+}
+
+// the job was handed out to rank
+static __inline__
+void sched_status_start(sched_status_t * s, const int rank, const sched_job_t * job)
+{
+	sched_rank_t * r = s->rank + rank;
+
+	r->index = job->index;
+	r->part = job->part;
+	r->a = job->a;
+	r->m = job->m;
+	r->cost = job->cost;
+	r->since = sched_time();
+	r->seen = r->since;
+	memset(r->msg, 0, sizeof(r->msg));
+}
+
+static __inline__
+void sched_status_done(sched_status_t * s, const int rank)
+{
+	sched_rank_t * r = s->rank + rank;
+
+	s->cost_done += r->cost;
+	s->done++;
+	r->index = -1;
+	r->jobs++;
+}
+
+static __inline__
+void sched_status_progress(sched_status_t * s, const int rank, const double * msg)
+{
+	sched_rank_t * r = s->rank + rank;
+	const double now = sched_time();
+
+	// a late message of the last job of the rank
+	if (r->index < 0 || msg[6] != r->index || msg[7] != r->part || msg[8] != r->a || msg[9] != r->m || msg[1] < r->msg[1])
+	{
+		return;
+	}
+
+	if (r->msg[2] > 0 && now > r->seen)
+	{
+		const double rate = (msg[1] - r->msg[1]) / (now - r->seen);
+		const double ops_rate = (msg[3] - r->msg[3]) / (now - r->seen);
+
+		r->rate = (r->rate > 0) ? (1 - SCHED_SMOOTH) * r->rate + SCHED_SMOOTH * rate : rate;
+		r->ops_rate = (r->ops_rate > 0) ? (1 - SCHED_SMOOTH) * r->ops_rate + SCHED_SMOOTH * ops_rate : ops_rate;
+	}
+
+	memcpy(r->msg, msg, sizeof(r->msg));
+	r->seen = now;
+}
+
+static __inline__
+int sched_double_cmp(const void * x, const void * y)
+{
+	const double s = *(const double *) x, t = *(const double *) y;
+
+	return (s > t) - (s < t);
+}
+
+// writes the status to path.tmp, then moves it over path
+static __inline__
+void sched_status_write(sched_status_t * s)
+{
+	const double now = sched_time();
+	const double elapsed = now - s->start;
+	double * rates = (double *) malloc((s->num_procs + 1) * sizeof(double));
+	double cost = s->cost_done, rate = 0, ops_rate = 0, median = 0;
+	char tmp[610], stamp[64];
+	int i, busy = 0, rated = 0;
+
+	for (i = 1; i <= s->num_procs; i++)
+	{
+		sched_rank_t * r = s->rank + i;
+
+		if (r->index < 0)
+		{
+			continue;
+		}
+
+		busy++;
+
+		if (r->msg[2] > 0)
+		{
+			cost += r->cost * MIN(1.0, r->msg[1] / r->msg[2]);
+		}
+
+		if (r->rate > 0)
+		{
+			rates[rated++] = r->rate;
+			rate += r->rate;
+			ops_rate += r->ops_rate;
+		}
+	}
+
+	if (rated > 0)
+	{
+		qsort(rates, rated, sizeof(double), &sched_double_cmp);
+		median = (rated & 1) ? rates[rated / 2] : 0.5 * (rates[rated / 2 - 1] + rates[rated / 2]);
+	}
+
+	free(rates);
+
+	sprintf(tmp, "%s.tmp", s->path);
+	FILE * f = fopen(tmp, "w");
+
+	if (f == NULL)
+	{
+		perror("Unable to write the status file\n");
+		s->written = now;
+		return;
+	}
+
+	fprintf(f, "elapsed %.0f seconds, %d of %d jobs done, %d running, %.1f%% of the cost\n", elapsed, s->done, s->jobs, busy,
+			(s->cost > 0) ? 100 * MIN(1.0, cost / s->cost) : 100.0);
+
+	if (cost > 0 && cost < s->cost)
+	{
+		const time_t end = time(NULL) + elapsed * (s->cost - cost) / cost;
+
+		strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime(&end));
+		fprintf(f, "projected completion in %.0f seconds, at %s\n", elapsed * (s->cost - cost) / cost, stamp);
+	}
+	else
+	{
+		fprintf(f, "projected completion unknown\n");
+	}
+
+	fprintf(f, "%.0f discriminants per second, %.0f operations per second, median rank %.0f discriminants per second\n", rate, ops_rate, median);
+	fprintf(f, "rank\ta\tm\tindex\tpart\tD\tdone\ttotal\trate\tops/s\taborted\trss MB\tage\teta\tjobs\tflag\n");
+
+	for (i = 1; i <= s->num_procs; i++)
+	{
+		const sched_rank_t * r = s->rank + i;
+		const char * flag = "ok";
+
+		if (r->index < 0)
+		{
+			fprintf(f, "%d\t-\t-\t-\t-\t-\t-\t-\t%.0f\t%.0f\t-\t-\t-\t-\t%d\tidle\n", i, r->rate, r->ops_rate, r->jobs);
+			continue;
+		}
+
+		if (now - r->seen >= SCHED_STALL_SECONDS)
+		{
+			flag = "stalled";
+		}
+		else if (r->rate > 0 && r->rate < SCHED_SLOW * median)
+		{
+			flag = "slow";
+		}
+
+		fprintf(f, "%d\t%d\t%d\t%d\t%d\t%.0f\t%.0f\t%.0f\t%.0f\t%.0f\t%.0f\t%.1f\t%.0f\t", i, r->a, r->m, r->index, r->part,
+				r->msg[0], r->msg[1], r->msg[2], r->rate, r->ops_rate, r->msg[4], r->msg[5] / 1048576, now - r->seen);
+
+		if (r->rate > 0 && r->msg[2] > 0)
+		{
+			fprintf(f, "%.0f", MAX(0.0, r->msg[2] - r->msg[1]) / r->rate);
+		}
+		else
+		{
+			fprintf(f, "-");
+		}
+
+		fprintf(f, "\t%d\t%s\n", r->jobs, flag);
+	}
+
+	fclose(f);
+	rename(tmp, s->path);
+	s->written = now;
+}
+
+// receives the next message of tag SCHED_TAG_DONE into buf, taking in the
+// progress messages until it comes, and returns the rank that sent it
+static __inline__
+int sched_status_wait(sched_status_t * s, void * buf, const int count, MPI_Datatype type)
+{
+	double msg[SCHED_PROGRESS_LEN];
+	MPI_Status status;
+	int flag;
+
+	while (1)
+	{
+		MPI_Iprobe(MPI_ANY_SOURCE, SCHED_TAG_PROGRESS, MPI_COMM_WORLD, &flag, &status);
+
+		if (flag)
+		{
+			MPI_Recv(msg, SCHED_PROGRESS_LEN, MPI_DOUBLE, status.MPI_SOURCE, SCHED_TAG_PROGRESS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			sched_status_progress(s, status.MPI_SOURCE, msg);
+			continue;
+		}
+
+		MPI_Iprobe(MPI_ANY_SOURCE, SCHED_TAG_DONE, MPI_COMM_WORLD, &flag, &status);
+
+		if (flag)
+		{
+			MPI_Recv(buf, count, type, status.MPI_SOURCE, SCHED_TAG_DONE, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+			sched_status_done(s, status.MPI_SOURCE);
+
+			return status.MPI_SOURCE;
+		}
+
+		if (sched_time() - s->written >= SCHED_STATUS_SECONDS)
+		{
+			sched_status_write(s);
+		}
+
+		usleep(SCHED_POLL_USEC);
+	}
+}
+
+// writes the final status
+static __inline__
+void sched_status_clear(sched_status_t * s)
+{
+	sched_status_write(s);
+	free(s->rank);
+}
+
+
+// UTILISATION REPORT
+// After its last job every worker sends the time it spent on jobs to the
+// master, which prints one line per rank against the length of the run.
+
+static __inline__
+void sched_report_send(const double busy, const int jobs)
+{
+	double stats[2] = { busy, jobs };
+
+	MPI_Send(stats, 2, MPI_DOUBLE, 0, SCHED_TAG_REPORT, MPI_COMM_WORLD);
+}
+
+// the progress messages still on their way from rank i come before its report
+static __inline__
+void sched_report(const int num_procs, const double elapsed)
+{
+	double stats[SCHED_PROGRESS_LEN], total = 0;
+	MPI_Status status;
+	int i;
+
+	printf("Utilisation over %.3f seconds:\n", elapsed);
+
+	for (i = 1; i <= num_procs; i++)
+	{
+		do
+		{
+			MPI_Recv(stats, SCHED_PROGRESS_LEN, MPI_DOUBLE, i, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+		}
+		while (status.MPI_TAG == SCHED_TAG_PROGRESS);
+
+		total += stats[0];
+
+		printf("rank %d: %d jobs, busy %.3f seconds, %.1f%%\n", i, (int) stats[1], stats[0], (elapsed > 0) ? 100 * stats[0] / elapsed : 0.0);
+	}
+
+	printf("average: %.1f%%\n", (elapsed > 0 && num_procs > 0) ? 100 * total / (elapsed * num_procs) : 0.0);
+	fflush(stdout);
+}
+
+#endif /* SCHED_H_ */
@@ -0,0 +1,86 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#ifndef SHARED_H_
+#define SHARED_H_
+
+#include <mpi.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// NODE SHARED TABLES
+// Read-only tables that are identical on every worker rank are built once per
+// node in an MPI-3 shared memory window. The ranks of a node split off into
+// their own communicator, the first of them allocates and fills the table,
+// and the others attach to it after a barrier.
+
+typedef struct
+{
+	MPI_Comm node;						// worker ranks on this node
+	int leader;							// 1 on the rank that builds the tables
+} node_t;
+
+// collective over comm, which usually holds the worker ranks only
+static __inline__
+void node_init(node_t * n, MPI_Comm comm)
+{
+	int rank;
+
+	MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &n->node);
+	MPI_Comm_rank(n->node, &rank);
+	n->leader = (rank == 0);
+}
+
+static __inline__
+void node_clear(node_t * n)
+{
+	MPI_Comm_free(&n->node);
+}
+
+// collective over the node, returns size bytes shared by all ranks of the node;
+// only the leader may write to them, and only before node_shared_ready
+static __inline__
+void * node_shared_alloc(const node_t * n, const size_t size, MPI_Win * win)
+{
+	MPI_Aint seg_size;
+	int disp_unit;
+	void * base;
+
+	if (MPI_Win_allocate_shared(n->leader ? size : 0, 1, MPI_INFO_NULL, n->node, &base, win) != MPI_SUCCESS)
+	{
+		perror("Unable to allocate a node shared window\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	MPI_Win_shared_query(*win, 0, &seg_size, &disp_unit, &base);
+
+	return base;
+}
+
+// collective over the node, the table is complete once this returns
+static __inline__
+void node_shared_ready(const node_t * n)
+{
+	MPI_Barrier(n->node);
+}
+
+#endif /* SHARED_H_ */
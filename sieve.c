@@ -62,89 +62,219 @@ void prime_sieve(const int max_prime, int * primes)
 }
 
 
-void regular_sieve(int max_prime, long blocksize, int ** factors, const int * primes, const int flags)
+// spf[n] is the smallest prime factor of n for 1 < n < max, spf[n] = n otherwise
+void spf_sieve(const int max, int * spf)
 {
 	long i, j;
 
-	int * f;
-
-	factors[0][0] = 1;
-	factors[0][1] = 0;
-	factors[1][0] = 1;
-	factors[1][1] = 1;
-
-	for (i = 0; i < blocksize; i++)
+	for (i = 0; i < max; i++)
 	{
-		factors[i][0] = 0;
+		spf[i] = i;
 	}
 
-	for (int i = 1, p = primes[i]; p < max_prime; p = primes[++i])
+	for (i = 2; i * i < max; i++)
 	{
-		for (j = p; j < blocksize; j += p)
+		if (spf[i] == i)
 		{
-			f = factors[j];
-			f[++f[0]] = (flags & WITH_INDICES) ? i : p;
+			for (j = i * i; j < max; j += i)
+			{
+				if (spf[j] == j)
+				{
+					spf[j] = i;
+				}
+			}
 		}
 	}
 }
 
 
-void segmented_sieve(int max_prime, long blocksize, long l, int ** factors, const int * primes, const int flags)
+// FLAT FACTOR TABLES
+
+void factors_init(factors_t * F, const long rows, const int stride)
 {
-	if (l == 0)
+	F->data = (int *) malloc((size_t) rows * stride * sizeof(int));
+
+	if (F->data == NULL)
 	{
-		regular_sieve(max_prime, blocksize, factors, primes, flags);
-		return;
+		perror("Unable to allocate a factor table\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	F->rows = rows;
+	F->stride = stride;
+	F->owner = 1;
+}
+
+void factors_wrap(factors_t * F, int * data, const long rows, const int stride)
+{
+	F->data = data;
+	F->rows = rows;
+	F->stride = stride;
+	F->owner = 0;
+}
+
+void factors_clear(factors_t * F)
+{
+	if (F->owner)
+	{
+		free(F->data);
+	}
+
+	F->data = NULL;
+}
+
+
+// SEGMENTED BUCKET SIEVE
+// Marks the multiples of primes[first], ..., primes[last - 1] in rows
+// [0, blocksize), next[i] being the row of the first multiple of primes[i].
+// The rows are filled one segment at a time so that the writes stay in cache.
+// A prime below the segment length is walked through every segment, while a
+// larger one hits a segment at most once and waits in the bucket of the
+// segment holding its next multiple. The buckets are linked lists threaded
+// through link, so a prime is always queued in exactly one of them.
+
+static void bucket_sieve(factors_t * factors, const long blocksize, const int * primes, const int first, const int last, long * next, const int flags)
+{
+	const long segments = (blocksize + SIEVE_SEGMENT - 1) / SIEVE_SEGMENT;
+
+	int * head = (int *) malloc(segments * sizeof(int));
+	int * link = (int *) malloc((last + 1) * sizeof(int));
+	int i, k, p, v, split, * f;
+	long s, t, j, end;
+
+	for (s = 0; s < segments; s++)
+	{
+		head[s] = -1;
 	}
 
-	int j, k, offset, * f;
+	for (split = first; split < last && primes[split] < SIEVE_SEGMENT; split++);
 
-	for (k = 0; k < blocksize; k++)
+	// queue the large primes in increasing order
+	for (i = last - 1; i >= split; i--)
 	{
-		factors[k][0] = 0;
+		if (next[i] < blocksize)
+		{
+			s = next[i] / SIEVE_SEGMENT;
+			link[i] = head[s];
+			head[s] = i;
+		}
 	}
 
-	for (int i = 1, p = primes[i]; p < max_prime; p = primes[++i])
+	for (s = 0; s < segments; s++)
 	{
-		offset = (p - (l % p)) % p;
+		end = MIN((s + 1) * SIEVE_SEGMENT, blocksize);
+
+		for (j = s * SIEVE_SEGMENT; j < end; j++)
+		{
+			factors_row(factors, j)[0] = 0;
+		}
+
+		for (i = first; i < split; i++)
+		{
+			p = primes[i];
+			v = (flags & WITH_INDICES) ? i : p;
+
+			for (j = next[i]; j < end; j += p)
+			{
+				f = factors_row(factors, j);
+				f[++f[0]] = v;
+			}
+
+			next[i] = j;
+		}
 
-		for (j = offset; j < blocksize; j += p)
+		for (i = head[s]; i != -1; i = k)
 		{
-			f = factors[j];
+			k = link[i];
+			p = primes[i];
+
+			f = factors_row(factors, next[i]);
 			f[++f[0]] = (flags & WITH_INDICES) ? i : p;
+
+			next[i] += p;
+
+			if (next[i] < blocksize)
+			{
+				t = next[i] / SIEVE_SEGMENT;
+				link[i] = head[t];
+				head[t] = i;
+			}
 		}
 	}
+
+	free(head);
+	free(link);
 }
 
 
-void mod_sieve(const long blocksize, const long l, int ** factors, const int * primes, const int a, const int m)
+void regular_sieve(int max_prime, long blocksize, factors_t * factors, const int * primes, const int flags)
 {
-	int i = 2, j, * f;
+	int i;
 
-	long offset;
-	long init_offset = ceil(((double) (l - a)) / m);
+	for (i = 1; primes[i] < max_prime; i++);
 
-	//long total = floor(((double) (l + blocksize - a)) / m) - init_offset + 1;
+	const int last = i;
+	long * next = (long *) malloc((last + 1) * sizeof(long));
 
-	for (long k = 0; k < blocksize; k++)
+	for (i = 1; i < last; i++)
 	{
-		factors[k][0] = 0;
+		next[i] = primes[i];
 	}
 
-	const long max_prime = (long) sqrt(l + blocksize * m);
-	long p = primes[i++];
+	bucket_sieve(factors, blocksize, primes, 1, last, next, flags);
 
-	while (p < max_prime)
+	free(next);
+}
+
+
+void segmented_sieve(int max_prime, long blocksize, long l, factors_t * factors, const int * primes, const int flags)
+{
+	if (l == 0)
 	{
-		offset = (crt(0, p, a, m, l) - a) / m - init_offset;
+		regular_sieve(max_prime, blocksize, factors, primes, flags);
+		return;
+	}
 
-		for (j = offset; j < blocksize; j += p)
-		{
-			f = factors[j];
-			f[++f[0]] = p;
-		}
+	int i, p;
 
-		p = primes[i++];
+	for (i = 1; primes[i] < max_prime; i++);
+
+	const int last = i;
+	long * next = (long *) malloc((last + 1) * sizeof(long));
+
+	for (i = 1; i < last; i++)
+	{
+		p = primes[i];
+		next[i] = (p - (l % p)) % p;
 	}
+
+	bucket_sieve(factors, blocksize, primes, 1, last, next, flags);
+
+	free(next);
 }
 
+
+void mod_sieve(const long blocksize, const long l, factors_t * factors, const int * primes, const int a, const int m)
+{
+	int i;
+	long init_offset = ceil(((double) (l - a)) / m);
+
+	//long total = floor(((double) (l + blocksize - a)) / m) - init_offset + 1;
+
+	const long max_prime = (long) sqrt(l + blocksize * m);
+
+	for (i = 2; primes[i] < max_prime; i++);
+
+	const int last = i;
+	long * next = (long *) malloc((last + 1) * sizeof(long));
+
+	for (i = 2; i < last; i++)
+	{
+		next[i] = (crt(0, primes[i], a, m, l) - a) / m - init_offset;
+	}
+
+	bucket_sieve(factors, blocksize, primes, 2, last, next, 0);
+
+	free(next);
+}
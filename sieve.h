@@ -33,12 +33,46 @@
 // 2^20=1048576
 #define FAC_TOTAL 1048576
 
+// rows filled per pass of the sieve, sized to keep a segment of the table in L2
+#ifndef SIEVE_SEGMENT
+#define SIEVE_SEGMENT 8192
+#endif
+
+// FLAT FACTOR TABLES
+// The prime factors of a block of integers live in one contiguous array with
+// a fixed stride. Row i starts at data + i * stride, its first entry is the
+// number of distinct prime factors and the factors follow in no particular
+// order, so stride must exceed the largest number of factors in the block.
+
+typedef struct
+{
+	int * data;
+	long rows;
+	int stride;
+	int owner;							// 1 if data was allocated by factors_init
+} factors_t;
+
+void factors_init(factors_t * F, const long rows, const int stride);
+
+// wraps a table allocated elsewhere, e.g. in a node shared window
+void factors_wrap(factors_t * F, int * data, const long rows, const int stride);
+
+void factors_clear(factors_t * F);
+
+static __inline__
+int * factors_row(const factors_t * F, const long i)
+{
+	return F->data + i * F->stride;
+}
+
 void prime_sieve(const int max_prime, int * primes);
 
-void regular_sieve(const int max_prime, const long blocksize, int ** factors, const int * primes, const int flags);
+void spf_sieve(const int max, int * spf);
+
+void regular_sieve(const int max_prime, const long blocksize, factors_t * factors, const int * primes, const int flags);
 
-void segmented_sieve(const int max_prime, const long blocksize, const long l, int ** factors, const int * primes, const int flags);
+void segmented_sieve(const int max_prime, const long blocksize, const long l, factors_t * factors, const int * primes, const int flags);
 
-void mod_sieve(const long blocksize, const long l, int ** factors, const int * primes, const int a, const int m);
+void mod_sieve(const long blocksize, const long l, factors_t * factors, const int * primes, const int a, const int m);
 
 #endif /* SIEVE_H_ */
@@ -0,0 +1,157 @@
+/*=============================================================================
+
+    This file is part of CLGRP.
+
+    CLGRP is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    CLGRP is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with CLGRP; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301 USA
+
+=============================================================================*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef WITH_PARI
+#include <pari/pari.h>
+#endif
+
+#include "clgrp.h"
+#include "sieve.h"
+
+// REGRESSION TESTS
+// Class groups that went wrong once, run by make check. The Smith normal form
+// of the relations of 15983079 and of the order of index 3^2 of 10276435 used
+// to overflow and give 348 6 2 and 324 2 2 2 2.
+
+static int cmp_desc(const void * a, const void * b)
+{
+	return *(const int *) b - *(const int *) a;
+}
+
+// sorts the count invariant factors in inv and checks them against expected
+static int check(const char * name, const long D, int * inv, const int count, const int * expected, const int expected_count)
+{
+	int r, same;
+
+	if (count == expected_count)
+	{
+		qsort(inv, count, sizeof(int), &cmp_desc);
+	}
+
+	for (r = 0; count == expected_count && r < count && inv[r] == expected[r]; r++);
+	same = (count == expected_count && r == count);
+
+	printf("%s %ld: ", name, D);
+
+	for (r = 0; r < count; r++)
+	{
+		printf("%d ", inv[r]);
+	}
+
+	if (!same)
+	{
+		printf("FAILED, expected");
+
+		for (r = 0; r < expected_count; r++)
+		{
+			printf(" %d", expected[r]);
+		}
+		printf("\n");
+
+		return 1;
+	}
+
+	printf("ok\n");
+	return 0;
+}
+
+static void tables_init(oatab_t * R, oatab_t * Q, const long D)
+{
+	int table_size = next_prime((((int) sqrt(h_upper_bound(-D))) << 1) - 1);
+
+	if (table_size == -1)
+	{
+		perror("Not enough primes in liboptarith/primes.h\n");
+		fflush(stderr);
+		exit(1);
+	}
+
+	form_table_init(R, table_size);
+	form_table_init(Q, table_size);
+}
+
+int main()
+{
+	#ifdef WITH_PARI
+	pari_init(1000000, 0);
+	#endif
+
+	int result[15], row[MAX_RANK + 2], rank, failed = 0;
+	oatab_t R, Q;
+
+	// MAXIMAL ORDER
+	const long D = 15983079;
+	const int ramified[5] = {4, 3, 7, 223, 3413};
+	const int expected[3] = {1044, 2, 2};
+
+	tables_init(&R, &Q, D);
+
+	rank = compute_group_bjt(result, -D, 1, h_lower_bound(-D), 0, &R, &Q);
+	failed |= check("compute_group_bjt", D, result + 1, MAX(rank, 0), expected, 3);
+
+	bjt_seed_t seed;
+	seed.order = 0;
+	seed.split = split_primes(-D);
+	seed.ramified = ramified;
+
+	rank = compute_group_bjt_seeded(result, -D, 1, h_lower_bound(-D), 0, &R, &Q, &seed, NULL);
+	failed |= check("compute_group_bjt_seeded", D, result + 1, MAX(rank, 0), expected, 3);
+
+	oatab_clear(&R);
+	oatab_clear(&Q);
+
+	// ORDER OF INDEX 3^2
+	const long D_ell = 10276435;
+	const long ell = 3;
+	const int expected_ell[5] = {108, 6, 2, 2, 2};
+
+	tables_init(&R, &Q, D_ell);
+
+	rank = compute_group_bjt(result, -D_ell, 1, h_lower_bound(-D_ell), 0, &R, &Q);
+
+	if (rank < 0)
+	{
+		printf("compute_group_bjt %ld: FAILED\n", D_ell);
+		return 1;
+	}
+
+	// the smallest prime factors up to the class number of the order
+	const int h_max = result[0] * ell * (ell + 1) + 1;
+	int * spf = (int *) malloc(h_max * sizeof(int));
+	spf_sieve(h_max, spf);
+
+	compute_group_ell(row, D_ell, result[0], result + 1, rank, ell, spf, &R, &Q, NULL, NULL, NULL);
+	failed |= check("compute_group_ell", D_ell, row + 2, row[1], expected_ell, 5);
+
+	oatab_clear(&R);
+	oatab_clear(&Q);
+	free(spf);
+
+	#ifdef WITH_PARI
+	pari_close();
+	#endif
+
+	return failed;
+}
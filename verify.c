@@ -27,6 +27,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <math.h>
+#include <pthread.h>
 #include <gmp.h>
 //#include <omp.h>
 
@@ -37,13 +39,11 @@
 #include "verify.h"
 #include "functions.h"
 #include "sieve.h"
+#include "gzio.h"
 
-void partial_left_hand_side(mpz_t LHS, const char * file, const char * folder, const int index, const long blocksize, const long x, const int a, const int m, const int * primes, int ** factors)
+void partial_left_hand_side(mpz_t LHS, const char * file, const char * folder, const int index, const long blocksize, const long x, const int a, const int m, const int * primes, const factors_t * factors)
 {
 	char name[500];
-	
-	sprintf(name, "gunzip -c %s/%s%d.gz > %s/file%d", folder, file, index, folder, index);
-	system(name);
 
 	char kron[primes[0] + 1];
 
@@ -51,12 +51,13 @@ void partial_left_hand_side(mpz_t LHS, const char * file, const char * folder, c
 printf("%d mod %d, n = %ld\n", a, m, x);
 #endif
 
-	sprintf(name, "%s/file%d", folder, index);
-	FILE * clgrp = fopen(name, "r");
-	
-	char line[500];
-	char * end;
-	
+	sprintf(name, "%s/%s%d.gz", folder, file, index);
+	gzin_t clgrp;
+	gzin_open(&clgrp, name);
+
+	long record[2];
+	int fields;
+
 	long dist, h, h_omega, r, K, Y, bound, i, j, k, l, t, total, rem;
 	long D = index * blocksize + a;
 	long p, D_next;
@@ -66,12 +67,17 @@ printf("%d mod %d, n = %ld\n", a, m, x);
 	mpz_t sum;
 	mpz_init(sum);
 
-	while (fgets(line, 500, clgrp) != NULL)
+	while ((fields = gzin_line(&clgrp, record, 2)) != 0)
 	{
-		end = NULL;
-		dist = strtol(line, &end, 10);
+		// a malformed line without h, record[1] would be the last h
+		if (fields < 2)
+		{
+			continue;
+		}
+
+		dist = record[0];
 		D += dist * m;
-		h = strtol(end, &end, 10);
+		h = record[1];
 
 #ifdef DEBUG
 printf("h(-%ld) = %ld, ", D, h);
@@ -148,7 +154,7 @@ printf("A Account for H(-%ld): %ld, h_omega=%ld, K=%ld\n", D, h_omega * K, h_ome
 				}
 
 				// compute all kronecker symbols
-				i_factors = factors[i];
+				i_factors = factors_row(factors, i);
 
 				for (k = 1; k <= i_factors[0]; k++)
 				{
@@ -162,7 +168,7 @@ printf("A Account for H(-%ld): %ld, h_omega=%ld, K=%ld\n", D, h_omega * K, h_ome
 				for (k = 1; k < total; k++)
 				{
 					t = div[k];
-					t_factors = factors[t];
+					t_factors = factors_row(factors, t);
 #ifdef DEBUG
 printf("%ld, #factors=%d\n", t, t_factors[0]);
 #endif
@@ -217,18 +223,11 @@ printf("B Account for H(-%ld): %ld, h_omega=%ld, K=%ld\n", D_next,  h_omega * K,
 	mpz_add(LHS, LHS, sum);
 	mpz_clear(sum);
 
-	sprintf(name, "%s/file%d", folder, index);	
-	fclose(clgrp);
-	remove(name);
+	gzin_close(&clgrp);
 }
 
-void left_hand_side(mpz_t LHS, const long D_max, const long files, const int * primes, const char * folder)
+int left_hand_side_stride(const long D_max, const int * primes)
 {
-	struct timeval begin, end;
-	unsigned long exec_time;
-
-	mpz_set_ui(LHS, 0);
-
 	long size = 1;
 	long temp = 1;
 	long D_sqrt = sqrt(D_max) + 1;
@@ -239,127 +238,251 @@ void left_hand_side(mpz_t LHS, const long D_max, const long files, const int * p
 		size++;
 	}
 
-	int ** factors = (int **) malloc(D_sqrt * sizeof(int *));
+	return size;
+}
 
-	for (long i = 0; i < D_sqrt; i++)
-	{
-		factors[i] = (int *) malloc(size * sizeof(int));
-	}
+// PARALLEL LEFT HAND SIDE
+// The pairs (class, file) are numbered k = 4 * file + class, so that the
+// first files, which take the longest, come first. Rank r of procs takes the
+// pairs with k % procs == r, and its threads pull them one at a time. Each
+// thread keeps a sum per class, the sums are added up once the threads are
+// done.
 
-	regular_sieve(D_sqrt, D_sqrt, factors, primes, WITH_INDICES);
+static const int lhs_a[4] = {4, 8, 3, 7};
+static const int lhs_m[4] = {16, 16, 8, 8};
+static const char * lhs_file[4] = { "cl4mod16/cl4mod16.", "cl8mod16/cl8mod16.", "cl3mod8/cl3mod8.", "cl7mod8/cl7mod8." };
 
-	int a[4] = {4, 8, 3, 7};
-	int m[4] = {16, 16, 8, 8};
-	char * file[4] = { "cl4mod16/cl4mod16.", "cl8mod16/cl8mod16.", "cl3mod8/cl3mod8.", "cl7mod8/cl7mod8." };
+typedef struct
+{
+	long D_max, files;
+	const int * primes;
+	const factors_t * factors;
+	const char * folder;
+	int rank, procs;
+	long next;							// next pair of this rank
+} lhs_job_t;
+
+typedef struct
+{
+	lhs_job_t * job;
+	mpz_t sums[4];
+	pthread_t thread;
+} lhs_worker_t;
 
-	mpz_t mod_sum;
-	mpz_init(mod_sum);
+static void * lhs_worker(void * arg)
+{
+	lhs_worker_t * w = (lhs_worker_t *) arg;
+	lhs_job_t * job = w->job;
+	long k;
+	int i;
 
-	for (int i = 0; i < 4; i++)
+	while ((k = job->rank + job->procs * __sync_fetch_and_add(&job->next, 1)) < 4 * job->files)
+	{
+		i = k & 3;
+		partial_left_hand_side(w->sums[i], lhs_file[i], job->folder, k >> 2, job->D_max / job->files, job->D_max / 8, lhs_a[i], lhs_m[i], job->primes, job->factors);
+	}
+
+	return NULL;
+}
+
+void left_hand_side_part(mpz_t * sums, const long D_max, const long files, const int * primes, const factors_t * factors, const char * folder,
+				const int threads, const int rank, const int procs)
+{
+	lhs_job_t job;
+	job.D_max = D_max;
+	job.files = files;
+	job.primes = primes;
+	job.factors = factors;
+	job.folder = folder;
+	job.rank = rank;
+	job.procs = procs;
+	job.next = 0;
+
+	lhs_worker_t * workers = (lhs_worker_t *) malloc(threads * sizeof(lhs_worker_t));
+	int t, i;
+
+	for (t = 0; t < threads; t++)
 	{
-		gettimeofday(&begin, NULL);
-		mpz_set_ui(mod_sum, 0);
+		workers[t].job = &job;
 
-		#pragma omp parallel for
-		for (int j = 0; j < files; j++)
+		for (i = 0; i < 4; i++)
 		{
-			mpz_t sum;
-			mpz_init(sum);
-			partial_left_hand_side(sum, file[i], folder, j, D_max / files, D_max / 8, a[i], m[i], primes, factors);
-			
-			#pragma omp critical
-			{
-				mpz_add(mod_sum, mod_sum, sum);
-			}
-			mpz_clear(sum);
+			mpz_init(workers[t].sums[i]);
 		}
+	}
 
-#ifdef DEBUG
-gmp_printf("Sum %d mod %d: %Zd\n\n", a[i], m[i], mod_sum);
-#endif
-
-		mpz_add(LHS, LHS, mod_sum);
-		gettimeofday(&end, NULL);
-		exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
-		printf("%d mod %d processed in %.3f\n", a[i], m[i], exec_time / 1e6);
-		gmp_printf("%Zd\n", mod_sum);
-		fflush(stdout);
+	for (t = 1; t < threads; t++)
+	{
+		if (pthread_create(&workers[t].thread, NULL, &lhs_worker, workers + t) != 0)
+		{
+			perror("Unable to start a verification thread\n");
+			fflush(stderr);
+			exit(1);
+		}
 	}
 
-	mpz_clear(mod_sum);
+	lhs_worker(workers);
 
-#ifdef DEBUG
-gmp_printf("LHS = %Zd\n\n", LHS);
-#endif
+	for (t = 1; t < threads; t++)
+	{
+		pthread_join(workers[t].thread, NULL);
+	}
 
-	for (long i = 0; i < D_sqrt; i++)
+	for (i = 0; i < 4; i++)
 	{
-		free(factors[i]);
+		mpz_set_ui(sums[i], 0);
+
+		for (t = 0; t < threads; t++)
+		{
+			mpz_add(sums[i], sums[i], workers[t].sums[i]);
+			mpz_clear(workers[t].sums[i]);
+		}
 	}
 
-	free(factors);
+	free(workers);
 }
 
-void partial_right_hand_side(mpz_t sum, const long blocksize, const long l, const int * primes, int ** factors)
+void left_hand_side(mpz_t LHS, const long D_max, const long files, const int * primes, const char * folder)
 {
-	segmented_sieve(sqrt((l + blocksize) << 1), blocksize, l, factors, primes, 0);
+	struct timeval begin, end;
+	unsigned long exec_time;
+
+	gettimeofday(&begin, NULL);
+	mpz_set_ui(LHS, 0);
+
+	long D_sqrt = sqrt(D_max) + 1;
+
+	factors_t factors;
+	factors_init(&factors, D_sqrt, left_hand_side_stride(D_max, primes));
 
-	int * f;
+	regular_sieve(D_sqrt, D_sqrt, &factors, primes, WITH_INDICES);
 
-	if (l == 0)
+	mpz_t sums[4];
+
+	for (int i = 0; i < 4; i++)
 	{
-		factors[1][1] = 2;
+		mpz_init(sums[i]);
 	}
 
-	for (long i = (l == 0) ? 2 : ((l & 1) ? 0 : 1); i < blocksize; i += 2)
+	left_hand_side_part(sums, D_max, files, primes, &factors, folder, 1, 0, 1);
+
+	for (int i = 0; i < 4; i++)
 	{
-		f = factors[i];
-		f[++f[0]] = 2;
+		mpz_add(LHS, LHS, sums[i]);
+		gmp_printf("%d mod %d: %Zd\n", lhs_a[i], lhs_m[i], sums[i]);
+		mpz_clear(sums[i]);
 	}
 
-	const long  max = (l + blocksize) << 1;
-
-	long i, n, root, total;
-	long div[MAX_DIVISORS];
+#ifdef DEBUG
+gmp_printf("LHS = %Zd\n\n", LHS);
+#endif
 
-	unsigned long psi;
+	factors_clear(&factors);
+	gettimeofday(&end, NULL);
+	exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
+	printf("Left hand side processed in %.3f\n", exec_time / 1e6);
+	fflush(stdout);
+}
 
-	char is_square;
+// PARALLEL RIGHT HAND SIDE
+// The right hand side adds up 12 psi(n) for the even n, and 6 sqrt(n) + 1
+// more for the squares, where psi(n) is the sum of the divisors of n above
+// sqrt(n). Each such divisor is n / e for a divisor e below sqrt(n). So the
+// sum over a block runs over e instead of n: for every e < sqrt(n) it adds
+// up the arithmetic progression of the quotients q > e with e * q even in the
+// block. A block costs O(sqrt(n)) and needs no factorisations, and its sum
+// fits in 128 bits, so GMP is only touched once per block.
 
-	long cur_f = (l == 0) ? 1 : 0;
+typedef unsigned __int128 u128_t;
 
-	for (n = (l == 0) ? 2 : (l << 1); n < max; cur_f++, n += 2)
+// the sum of lo, lo + step, ..., up to hi
+static __inline__
+u128_t rhs_progression(const long lo, const long hi, const long step)
+{
+	if (hi < lo)
 	{
-		psi = n;
-		total = divisors_list(div, n, factors[cur_f], primes, 0);
+		return 0;
+	}
 
-		root = sqrt(n);
-		is_square = (root * root == n);
+	const long count = (hi - lo) / step + 1;
 
-		for (i = 1; i < total - 1; i++)
-		{
-			if (div[i] > root)
-			{
-				psi += div[i];
-			}
-		}
+	return (u128_t) count * (2 * lo + (count - 1) * step) / 2;
+}
 
-		psi *= 12;
+void partial_right_hand_side(mpz_t sum, const long blocksize, const long l)
+{
+	// the even n in [first, last)
+	const long first = l << 1;
+	const long last = (l + blocksize) << 1;
+
+	u128_t psi = 0, squares = 0;
+	long e, lo, hi, r;
+
+	for (e = 1; e * (e + 1) < last; e++)
+	{
+		lo = MAX(e + 1, (first + e - 1) / e);
+		hi = (last - 1) / e;
 
-		if (is_square)
+		if (e & 1)
 		{
-			psi += 6 * root + 1;
+			// q has to be even
+			lo += (lo & 1);
+			hi -= (hi & 1);
+			psi += rhs_progression(lo, hi, 2);
 		}
+		else
+		{
+			psi += rhs_progression(lo, hi, 1);
+		}
+	}
 
-#ifdef DEBUG
-printf("%ld: %lu\n", n, psi);
-#endif
+	// the even squares
+	for (r = sqrt(first); r * r < first; r++);
+	r += (r & 1);
 
-		mpz_add_ui(sum, sum, psi);
+	for (; r * r < last; r += 2)
+	{
+		squares += 6 * r + 1;
 	}
+
+	psi = 12 * psi + squares;
+
+	mpz_t temp;
+	mpz_init(temp);
+	mpz_import(temp, 1, -1, sizeof(u128_t), 0, 0, &psi);
+	mpz_add(sum, sum, temp);
+	mpz_clear(temp);
 }
 
-void right_hand_side(mpz_t RHS, const long n_max, const long blocksize, const int * primes)
+typedef struct
+{
+	long blocksize, blocks;
+	int rank, procs;
+	long next;							// next block of this rank
+} rhs_job_t;
+
+typedef struct
+{
+	rhs_job_t * job;
+	mpz_t sum;
+	pthread_t thread;
+} rhs_worker_t;
+
+static void * rhs_worker(void * arg)
+{
+	rhs_worker_t * w = (rhs_worker_t *) arg;
+	rhs_job_t * job = w->job;
+	long i;
+
+	while ((i = job->rank + job->procs * __sync_fetch_and_add(&job->next, 1)) < job->blocks)
+	{
+		partial_right_hand_side(w->sum, job->blocksize, i * job->blocksize + 1);
+	}
+
+	return NULL;
+}
+
+void right_hand_side(mpz_t RHS, const long n_max, const long blocksize, const int threads, const int rank, const int procs)
 {
 	struct timeval begin, end;
 	unsigned long exec_time;
@@ -367,63 +490,56 @@ void right_hand_side(mpz_t RHS, const long n_max, const long blocksize, const in
 	gettimeofday(&begin, NULL);
 	mpz_set_ui(RHS, 0);
 
-	long temp = 1;
-	long size = 1;
-
-	while (temp < (n_max << 1))
-	{
-		temp *= primes[size++];
-		size++;
-	}
+	rhs_job_t job;
+	job.blocksize = blocksize;
+	job.blocks = n_max / blocksize;
+	job.rank = rank;
+	job.procs = procs;
+	job.next = 0;
 
-	const int max_threads = /*omp_get_max_threads()*/1;
+#ifdef DEBUG
+printf("# blocks: %ld\n", job.blocks);
+#endif
 
-	int ** factors[max_threads];
+	rhs_worker_t * workers = (rhs_worker_t *) malloc(threads * sizeof(rhs_worker_t));
+	int t;
 
-	for (int n = 0; n < max_threads; n++)
+	for (t = 0; t < threads; t++)
 	{
-		factors[n] = (int **) malloc(blocksize * sizeof(int *));
+		workers[t].job = &job;
+		mpz_init(workers[t].sum);
+	}
 
-		for (long i = 0; i < blocksize; i++)
+	for (t = 1; t < threads; t++)
+	{
+		if (pthread_create(&workers[t].thread, NULL, &rhs_worker, workers + t) != 0)
 		{
-			factors[n][i] = (int *) malloc((size + 1) * sizeof(int));
+			perror("Unable to start a verification thread\n");
+			fflush(stderr);
+			exit(1);
 		}
 	}
 
-	const long num_blocks = n_max / blocksize;
+	rhs_worker(workers);
 
-#ifdef DEBUG
-printf("# blocks: %d\n", num_blocks);
-#endif
-
-	#pragma omp parallel for
-	for (int i = 0; i < num_blocks; i++)
+	for (t = 0; t < threads; t++)
 	{
-		mpz_t sum;
-		mpz_init(sum);
-		partial_right_hand_side(sum, blocksize, i * blocksize + 1, primes, factors[/*omp_get_thread_num()*/0]);
-		
-		#pragma omp critical
+		if (t > 0)
 		{
-			mpz_add(RHS, RHS, sum);
+			pthread_join(workers[t].thread, NULL);
 		}
-		mpz_clear(sum);
+
+		mpz_add(RHS, RHS, workers[t].sum);
+		mpz_clear(workers[t].sum);
 	}
 
+	free(workers);
+
 #ifdef DEBUG
 gmp_printf("RHS = %Zd\n\n", RHS);
 #endif
 
-	for (int n = 0; n < max_threads; n++)
-	{
-		for (long i = 0; i < blocksize; i++)
-		{
-			free(factors[n][i]);
-		}
-
-		free(factors[n]);
-	}
 	gettimeofday(&end, NULL);
 	exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
-	printf("Right hand side processed in %.3f\n", exec_time / 1e6);
+	printf("Right hand side of rank %d processed in %.3f\n", rank, exec_time / 1e6);
 }
@@ -43,12 +43,22 @@
 // corresponds to 963761198400, smallest # < 2^40 which has largest # of divisors
 #define MAX_DIVISORS 12000 //6720
 
-void partial_left_hand_side(mpz_t LHS, const char * file, const char * folder, const int index, const long blocksize, const long x, const int a, const int m, const int * primes, int ** factors);
+void partial_left_hand_side(mpz_t LHS, const char * file, const char * folder, const int index, const long blocksize, const long x, const int a, const int m, const int * primes, const factors_t * factors);
 
 void left_hand_side(mpz_t LHS, const long D_max, const long files, const int * primes, const char * folder);
 
-void partial_right_hand_side(mpz_t sum, const long blocksize, const long l, const int * primes, int ** factors);
+// the stride of the factor table of the left hand side, which has sqrt(D_max) + 1 rows
+int left_hand_side_stride(const long D_max, const int * primes);
 
-void right_hand_side(mpz_t RHS, const long n_max, const long blocksize, const int * primes);
+// the sum of class i of the pairs (class, file) of rank out of procs in sums[i],
+// computed by threads threads, the classes being 4 mod 16, 8 mod 16, 3 mod 8 and 7 mod 8
+void left_hand_side_part(mpz_t * sums, const long D_max, const long files, const int * primes, const factors_t * factors, const char * folder,
+				const int threads, const int rank, const int procs);
+
+// adds the terms of the even n in [2 l, 2 (l + blocksize)) to sum
+void partial_right_hand_side(mpz_t sum, const long blocksize, const long l);
+
+// the blocks of the rank out of procs, computed by threads threads
+void right_hand_side(mpz_t RHS, const long n_max, const long blocksize, const int threads, const int rank, const int procs);
 
 #endif /* SIEVE_H_ */
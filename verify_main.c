@@ -23,6 +23,8 @@
  
 ******************************************************************************/
 
+#include <mpi.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,18 +39,70 @@
 #include "verify.h"
 #include "functions.h"
 #include "sieve.h"
+#include "shared.h"
+
+// adds up the sums of all ranks on rank 0, through their binary export
+static void mpz_reduce(mpz_t sum, MPI_Comm comm)
+{
+	int rank, procs, r;
+	size_t size;
+	long len;
+	char * buf;
+
+	MPI_Comm_rank(comm, &rank);
+	MPI_Comm_size(comm, &procs);
+
+	if (rank != 0)
+	{
+		buf = (char *) mpz_export(NULL, &size, 1, 1, 0, 0, sum);
+		len = size;
+		MPI_Send(&len, 1, MPI_LONG, 0, 0, comm);
+		MPI_Send(buf, len, MPI_CHAR, 0, 0, comm);
+		free(buf);
+		return;
+	}
+
+	mpz_t temp;
+	mpz_init(temp);
+
+	for (r = 1; r < procs; r++)
+	{
+		MPI_Recv(&len, 1, MPI_LONG, r, 0, comm, MPI_STATUS_IGNORE);
+		buf = (char *) malloc(len + 1);
+		MPI_Recv(buf, len, MPI_CHAR, r, 0, comm, MPI_STATUS_IGNORE);
+		mpz_import(temp, len, 1, 1, 0, 0, buf);
+		mpz_add(sum, sum, temp);
+		free(buf);
+	}
+
+	mpz_clear(temp);
+}
 
 int main(int argc, char ** argv)
 {
-	if (argc != 4)
+	// the ranks run the threads of both sides, every MPI call stays on the
+	// main thread
+	int provided;
+
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+	if (provided < MPI_THREAD_FUNNELED)
 	{
-		printf("Format: ./verify [D_max] [files] [folder]\n");
+		printf("The MPI library does not provide MPI_THREAD_FUNNELED\n");
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+
+	if (argc != 4 && argc != 5)
+	{
+		printf("Format: mpirun -np [#procs] ./verify [D_max] [files] [folder] [threads]\n");
+		printf("Each rank runs [threads] threads, 1 by default.\n");
 		exit(1);
 	}
 
 	long D_max = atol(argv[1]);
 	long files = atol(argv[2]);
 	const char * folder = argv[3];
+	int threads = (argc == 5) ? atoi(argv[4]) : 1;
 
 	if (D_max < 0)
 	{
@@ -56,33 +110,121 @@ int main(int argc, char ** argv)
 		exit(1);
 	}
 
+	if (threads < 1)
+	{
+		perror("threads should be positive.\n");
+		exit(1);
+	}
+
+	#ifdef WITH_PARI
+	// PARI is not thread safe
+	threads = 1;
+	#endif
+
+	int myrank, procs;
+	MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+	MPI_Comm_size(MPI_COMM_WORLD, &procs);
+
 	long D_sqrt = sqrt(D_max) + 1;
 
 	int * primes = (int *) malloc(((unsigned int) (1.25506 * D_sqrt / log(D_sqrt))) * sizeof(int));
 	prime_sieve(D_sqrt, primes);
 	primes = (int *) realloc(primes, (2 + primes[0]) * sizeof(int));
 
-	printf("\n\n%ld discriminants, %ld files, %d threads\n", D_max, files, /*omp_get_max_threads()*/1);
-	fflush(stdout);
+	if (myrank == 0)
+	{
+		printf("\n\n%ld discriminants, %ld files, %d ranks, %d threads\n", D_max, files, procs, threads);
+		fflush(stdout);
+	}
 
 	#ifdef WITH_PARI
 	pari_init(100000, 0);
 	#endif
 
-	mpz_t LHS;
+	struct timeval begin, end;
+	unsigned long exec_time;
+
+	gettimeofday(&begin, NULL);
+
+	// one copy of the factor table per node
+	node_t node;
+	node_init(&node, MPI_COMM_WORLD);
+
+	MPI_Win factors_win;
+	const int stride = left_hand_side_stride(D_max, primes);
+	int * table = (int *) node_shared_alloc(&node, (size_t) D_sqrt * stride * sizeof(int), &factors_win);
+
+	factors_t factors;
+	factors_wrap(&factors, table, D_sqrt, stride);
+
+	if (node.leader)
+	{
+		regular_sieve(D_sqrt, D_sqrt, &factors, primes, WITH_INDICES);
+	}
+
+	node_shared_ready(&node);
+
+	mpz_t LHS, sums[4];
 	mpz_init(LHS);
-	left_hand_side(LHS, D_max, files, primes, folder);
 
-	gmp_printf("Left hand side computed.\n%Zd\n\n", LHS);
-	fflush(stdout);
+	for (int i = 0; i < 4; i++)
+	{
+		mpz_init(sums[i]);
+	}
+
+	left_hand_side_part(sums, D_max, files, primes, &factors, folder, threads, myrank, procs);
+
+	for (int i = 0; i < 4; i++)
+	{
+		mpz_reduce(sums[i], MPI_COMM_WORLD);
+		mpz_add(LHS, LHS, sums[i]);
+	}
+
+	factors_clear(&factors);
+	MPI_Win_free(&factors_win);
+	node_clear(&node);
 
 	#ifdef WITH_PARI
 	pari_close();
 	#endif
 
+	gettimeofday(&end, NULL);
+	exec_time = (end.tv_sec * 1e6 + end.tv_usec) - (begin.tv_sec * 1e6 + begin.tv_usec);
+
+	if (myrank == 0)
+	{
+		// the classes in the order of left_hand_side_part
+		const int a[4] = {4, 8, 3, 7};
+		const int m[4] = {16, 16, 8, 8};
+
+		for (int i = 0; i < 4; i++)
+		{
+			gmp_printf("%d mod %d: %Zd\n", a[i], m[i], sums[i]);
+		}
+
+		printf("Left hand side processed in %.3f\n", exec_time / 1e6);
+		gmp_printf("Left hand side computed.\n%Zd\n\n", LHS);
+		fflush(stdout);
+	}
+
+	for (int i = 0; i < 4; i++)
+	{
+		mpz_clear(sums[i]);
+	}
+
 	mpz_t RHS;
 	mpz_init(RHS);
-	right_hand_side(RHS, D_max / 8, MIN(D_max / 8, FAC_TOTAL), primes);
+	right_hand_side(RHS, D_max / 8, MIN(D_max / 8, FAC_TOTAL), threads, myrank, procs);
+	mpz_reduce(RHS, MPI_COMM_WORLD);
+
+	if (myrank != 0)
+	{
+		mpz_clear(LHS);
+		mpz_clear(RHS);
+		free(primes);
+		MPI_Finalize();
+		return 0;
+	}
 
 	gmp_printf("Right hand side computed.\n%Zd\n\n", RHS);
 	fflush(stdout);
@@ -104,6 +246,9 @@ int main(int argc, char ** argv)
 
 	mpz_clear(LHS);
 	mpz_clear(RHS);
+	free(primes);
+
+	MPI_Finalize();
 
 	return 0;
 }